@@ -0,0 +1,456 @@
+/* kigu arena module
+WHAT:
+This module provides a linear (bump) allocator backed by a large range of reserved virtual address space. Pages of that range
+are only committed as the arena grows into them, so reserving gigabytes up front costs nothing until it's used. The `Arena`
+header is stored at the start of its own reservation, so an arena is a single pointer that never moves.
+
+WHY:
+Most kigu containers and strings allocate through `stl_allocator`, so a request that builds a few hundred strings and arrays
+pays for a few hundred malloc/free pairs (and the locking inside them). When all of those allocations die together, pushing
+them onto an arena and clearing it afterwards replaces every one of those calls with a pointer bump.
+
+NOTES:
+- Pushed memory is always zero filled (which kigu containers expect), but only memory below the arena's high water mark is
+  explicitly zeroed since memory above it is fresh from the OS.
+- Pushes are aligned to KIGU_ARENA_ALIGNMENT (16 by default).
+- The `Allocator` returned by arena_allocator() prefixes each allocation with its size so resize() knows how much to copy.
+  Resizing the most recent allocation grows or shrinks it in place; anything else is pushed again and copied.
+- release() on the `Allocator` is a no-op except for the most recent allocation, which rolls the cursor back.
+- Arenas are not thread safe.
+- Each thread has KIGU_SCRATCH_COUNT (2) scratch arenas which are created the first time the thread calls scratch_begin().
+  scratch_begin() takes the allocator of an outer scratch (or any allocator the result will be built with) so that it
+  hands out the other arena; otherwise temporaries would be pushed on top of (and popped along with) the outer result.
+- Scratch allocators always use the calling thread's arenas, so scratch memory must not be handed to other threads.
+- The scratch arenas and allocators are shared by every translation unit that includes arena.h.
+
+INDEX:
+@arena_create
+  Arena: struct
+  arena_create(upt reserve_size) -> Arena*
+  arena_destroy(Arena* arena) -> void
+@arena_push
+  arena_push(Arena* arena, upt size) -> void*
+  arena_push_array(Arena* arena, T type, upt count) -> T*
+  arena_pos(Arena* arena) -> upt
+  arena_pop_to(Arena* arena, upt pos) -> void
+  arena_clear(Arena* arena) -> void
+  arena_used(Arena* arena) -> upt
+@arena_allocator
+  arena_allocator(Arena* arena) -> Allocator*
+@arena_scratch
+  Scratch: struct
+  scratch_begin(Allocator* conflict) -> Scratch
+  scratch_end(Scratch scratch) -> void
+  scratch_release_thread() -> void
+@arena_tests
+*/
+#pragma once
+#ifndef KIGU_ARENA_H
+#define KIGU_ARENA_H
+
+
+#ifndef KIGU_ARENA_ALIGNMENT
+#  define KIGU_ARENA_ALIGNMENT 16
+#endif
+#ifndef KIGU_ARENA_COMMIT_SIZE
+#  define KIGU_ARENA_COMMIT_SIZE Kilobytes(64)
+#endif
+#ifndef KIGU_ARENA_DEFAULT_RESERVE_SIZE
+#  define KIGU_ARENA_DEFAULT_RESERVE_SIZE Gigabytes(1)
+#endif
+#ifndef KIGU_SCRATCH_RESERVE_SIZE
+#  define KIGU_SCRATCH_RESERVE_SIZE Gigabytes(1)
+#endif
+
+
+#include "common.h"
+#include "memory.h"
+
+
+StartLinkageC();
+//-////////////////////////////////////////////////////////////////////////////////////////////////
+//// @arena_create
+
+
+typedef struct Arena{
+	u8* start;            //first pushable byte (right after this header)
+	u8* cursor;           //next free byte
+	u8* committed;        //end of the committed pages
+	u8* high_water;       //highest the cursor has been; memory past this has never been touched and is zero
+	u8* end;              //end of the reserved address space
+	Allocator* allocator; //allocator that pushes onto this arena (0 until arena_allocator() is called)
+}Arena;
+
+
+//Commits pages so that memory up to `new_cursor` is usable
+global b32
+kigu__arena_commit(Arena* arena, u8* new_cursor){
+	u8* commit_end = (u8*)AlignToPow2((upt)new_cursor, (upt)KIGU_ARENA_COMMIT_SIZE);
+	if(commit_end > arena->end) commit_end = arena->end;
+	if(!os_memory_commit(arena->committed, commit_end - arena->committed)){
+		Assert(!"failed to commit arena memory");
+		return false;
+	}
+	arena->committed = commit_end;
+	return true;
+}
+
+
+//Reserves `reserve_size` bytes of address space and creates an arena at the start of it, returns 0 on failure
+global Arena*
+arena_create(upt reserve_size){
+	upt page_size = os_memory_page_size();
+	reserve_size = AlignToPow2(Max(reserve_size, (upt)KIGU_ARENA_COMMIT_SIZE), page_size);
+	
+	u8* base = (u8*)os_memory_reserve(reserve_size);
+	if(!base){
+		Assert(!"failed to reserve arena address space");
+		return 0;
+	}
+	
+	upt initial_commit = AlignToPow2(Min((upt)KIGU_ARENA_COMMIT_SIZE, reserve_size), page_size);
+	if(!os_memory_commit(base, initial_commit)){
+		os_memory_release(base, reserve_size);
+		Assert(!"failed to commit arena memory");
+		return 0;
+	}
+	
+	Arena* arena = (Arena*)base;
+	arena->start      = base + AlignToPow2(sizeof(Arena), (upt)KIGU_ARENA_ALIGNMENT);
+	arena->cursor     = arena->start;
+	arena->committed  = base + initial_commit;
+	arena->high_water = arena->start;
+	arena->end        = base + reserve_size;
+	arena->allocator  = 0;
+	return arena;
+}
+
+
+//Releases the entire reservation of `arena` (including the arena itself) back to the OS
+global void
+arena_destroy(Arena* arena){
+	if(arena->allocator) allocator_unbind(arena->allocator);
+	os_memory_release(arena, arena->end - (u8*)arena);
+}
+
+
+//-////////////////////////////////////////////////////////////////////////////////////////////////
+//// @arena_push
+
+
+//Moves the cursor of `arena` to `new_cursor`, committing pages and zeroing reused memory in [`from`,`new_cursor`)
+global b32
+kigu__arena_extend(Arena* arena, u8* from, u8* new_cursor){
+	if(new_cursor > arena->end){
+		Assert(!"arena ran out of reserved address space");
+		return false;
+	}
+	if(new_cursor > arena->committed && !kigu__arena_commit(arena, new_cursor)) return false;
+	
+	//only memory that has been used before needs zeroing
+	if(from < arena->high_water) ZeroMemory(from, Min(new_cursor, arena->high_water) - from);
+	if(new_cursor > arena->high_water) arena->high_water = new_cursor;
+	
+	arena->cursor = new_cursor;
+	return true;
+}
+
+
+//Returns `size` zeroed bytes from the top of `arena`, returns 0 if `arena` ran out of reserved space
+global void*
+arena_push(Arena* arena, upt size){
+	u8* result = (u8*)AlignToPow2((upt)arena->cursor, (upt)KIGU_ARENA_ALIGNMENT);
+	if(!kigu__arena_extend(arena, result, result + size)) return 0;
+	return result;
+}
+
+//Returns a `T*` to `count` zeroed slots pushed onto `arena`
+#define arena_push_array(arena,T,count) ((T*)arena_push((arena), sizeof(T)*(count)))
+
+
+//Returns the current position of `arena` which can later be given to arena_pop_to()
+FORCE_INLINE upt
+arena_pos(Arena* arena){
+	return arena->cursor - (u8*)arena;
+}
+
+
+//Pops everything pushed onto `arena` after `pos` (returned by arena_pos())
+global void
+arena_pop_to(Arena* arena, upt pos){
+	u8* new_cursor = (u8*)arena + pos;
+	Assert(new_cursor >= arena->start && new_cursor <= arena->cursor, "invalid arena position");
+	arena->cursor = new_cursor;
+}
+
+
+//Pops everything pushed onto `arena` without decommitting any of its memory
+global void
+arena_clear(Arena* arena){
+	arena->cursor = arena->start;
+}
+
+
+//Returns the number of bytes currently pushed onto `arena`
+FORCE_INLINE upt
+arena_used(Arena* arena){
+	return arena->cursor - arena->start;
+}
+
+
+//-////////////////////////////////////////////////////////////////////////////////////////////////
+//// @arena_allocator
+
+
+//Pushes `size` bytes prefixed by their size onto the arena `context`
+//  the size is stored in the last sizeof(upt) bytes of a KIGU_ARENA_ALIGNMENT sized pad so the result stays aligned
+global void*
+kigu__arena_allocator_reserve(void* context, upt size){
+	StaticAssertAlways(KIGU_ARENA_ALIGNMENT >= sizeof(upt));
+	u8* pad = (u8*)arena_push((Arena*)context, KIGU_ARENA_ALIGNMENT + size);
+	if(!pad) return 0;
+	u8* result = pad + KIGU_ARENA_ALIGNMENT;
+	*((upt*)result - 1) = size;
+	return result;
+}
+
+//Rolls back the cursor if `ptr` is the most recent allocation on the arena `context`, otherwise does nothing
+global void
+kigu__arena_allocator_release(void* context, void* ptr){
+	Arena* arena = (Arena*)context;
+	if(!ptr) return;
+	upt size = *((upt*)ptr - 1);
+	if((u8*)ptr + size == arena->cursor){
+		arena->cursor = (u8*)ptr - KIGU_ARENA_ALIGNMENT;
+	}
+}
+
+//Resizes `ptr` in place if it is the most recent allocation on the arena `context`, otherwise pushes a new copy
+global void*
+kigu__arena_allocator_resize(void* context, void* ptr, upt size){
+	Arena* arena = (Arena*)context;
+	if(!ptr) return kigu__arena_allocator_reserve(context, size);
+	
+	upt* header = (upt*)ptr - 1;
+	if((u8*)ptr + *header == arena->cursor){
+		if(size > *header){
+			if(!kigu__arena_extend(arena, arena->cursor, (u8*)ptr + size)) return 0;
+		}else{
+			arena->cursor = (u8*)ptr + size;
+		}
+		*header = size;
+		return ptr;
+	}
+	
+	void* result = kigu__arena_allocator_reserve(context, size);
+	if(result) CopyMemory(result, ptr, Min(*header, size));
+	return result;
+}
+
+
+//Returns an `Allocator` that allocates from `arena`, the same `Allocator` is returned on subsequent calls
+global Allocator*
+arena_allocator(Arena* arena){
+	if(!arena->allocator){
+		arena->allocator = allocator_bind(arena, kigu__arena_allocator_reserve, kigu__arena_allocator_release, kigu__arena_allocator_resize);
+		if(arena->allocator){
+			arena->allocator->flags     = AllocatorFlags_ZeroReserve | AllocatorFlags_ZeroResize;
+			arena->allocator->alignment = KIGU_ARENA_ALIGNMENT;
+		}
+	}
+	return arena->allocator;
+}
+
+
+//-////////////////////////////////////////////////////////////////////////////////////////////////
+//// @arena_scratch
+
+
+#define KIGU_SCRATCH_COUNT 2
+
+typedef struct Scratch{
+	Allocator* allocator; //allocator that pushes onto the scratch arena
+	Arena* arena;         //the thread's scratch arena
+	upt pos;              //position of the arena when the scratch began
+}Scratch;
+
+inline thread_local Arena* kigu__scratch_arenas[KIGU_SCRATCH_COUNT];
+
+//Returns the calling thread's scratch arena at `index`, creating it if needed
+inline Arena*
+kigu__scratch_arena(u32 index){
+	if(!kigu__scratch_arenas[index]){
+		kigu__scratch_arenas[index] = arena_create(KIGU_SCRATCH_RESERVE_SIZE);
+	}
+	return kigu__scratch_arenas[index];
+}
+
+//NOTE the scratch allocators are shared by all threads, each call is routed to the calling thread's arena
+inline void* kigu__scratch_reserve_0(upt size){ return kigu__arena_allocator_reserve(kigu__scratch_arena(0), size); }
+inline void* kigu__scratch_reserve_1(upt size){ return kigu__arena_allocator_reserve(kigu__scratch_arena(1), size); }
+inline void  kigu__scratch_release_0(void* ptr){ kigu__arena_allocator_release(kigu__scratch_arena(0), ptr); }
+inline void  kigu__scratch_release_1(void* ptr){ kigu__arena_allocator_release(kigu__scratch_arena(1), ptr); }
+inline void* kigu__scratch_resize_0(void* ptr, upt size){ return kigu__arena_allocator_resize(kigu__scratch_arena(0), ptr, size); }
+inline void* kigu__scratch_resize_1(void* ptr, upt size){ return kigu__arena_allocator_resize(kigu__scratch_arena(1), ptr, size); }
+
+inline Allocator kigu__scratch_allocators[KIGU_SCRATCH_COUNT] = {
+	{kigu__scratch_reserve_0, Allocator_ChangeMemory_Noop, Allocator_ChangeMemory_Noop, kigu__scratch_release_0, kigu__scratch_resize_0,
+	 0, AllocatorFlags_ZeroReserve | AllocatorFlags_ZeroResize, KIGU_ARENA_ALIGNMENT},
+	{kigu__scratch_reserve_1, Allocator_ChangeMemory_Noop, Allocator_ChangeMemory_Noop, kigu__scratch_release_1, kigu__scratch_resize_1,
+	 0, AllocatorFlags_ZeroReserve | AllocatorFlags_ZeroResize, KIGU_ARENA_ALIGNMENT},
+};
+
+
+//Begins a temporary region on one of the calling thread's scratch arenas that isn't used by `conflict` (which may be 0)
+//  everything allocated with the returned `Scratch.allocator` is freed by scratch_end()
+global Scratch
+scratch_begin(Allocator* conflict){
+	u32 index = (conflict == &kigu__scratch_allocators[0]) ? 1 : 0;
+	Scratch result;
+	result.allocator = &kigu__scratch_allocators[index];
+	result.arena     = kigu__scratch_arena(index);
+	result.pos       = arena_pos(result.arena);
+	return result;
+}
+
+
+//Frees everything allocated on `scratch` since scratch_begin()
+FORCE_INLINE void
+scratch_end(Scratch scratch){
+	arena_pop_to(scratch.arena, scratch.pos);
+}
+
+
+//Destroys the calling thread's scratch arenas (call this before a thread that used scratch_begin() exits)
+global void
+scratch_release_thread(){
+	forI(KIGU_SCRATCH_COUNT){
+		if(kigu__scratch_arenas[i]){
+			arena_destroy(kigu__scratch_arenas[i]);
+			kigu__scratch_arenas[i] = 0;
+		}
+	}
+}
+
+
+EndLinkageC();
+//-////////////////////////////////////////////////////////////////////////////////////////////////
+//// @arena_tests
+#ifdef KIGU_UNIT_TESTS
+
+
+#include "array.h"
+
+
+global void kigu__arena_unit_tests()
+{
+	{//// push ////
+		Arena* arena = arena_create(Megabytes(1));
+		AssertAlways(arena != 0);
+		AssertAlways(arena_used(arena) == 0);
+		
+		u8* a = (u8*)arena_push(arena, 3);
+		AssertAlways(a == arena->start);
+		AssertAlways(a[0] == 0 && a[1] == 0 && a[2] == 0);
+		a[0] = 1; a[1] = 2; a[2] = 3;
+		
+		u64* b = arena_push_array(arena, u64, 4);
+		AssertAlways((upt)b % KIGU_ARENA_ALIGNMENT == 0);
+		AssertAlways(b[0] == 0 && b[3] == 0);
+		
+		//push past the first commit
+		u8* c = (u8*)arena_push(arena, KIGU_ARENA_COMMIT_SIZE*2);
+		AssertAlways(c != 0);
+		c[KIGU_ARENA_COMMIT_SIZE*2 - 1] = 5;
+		AssertAlways(arena->committed >= arena->cursor);
+		
+		arena_destroy(arena);
+	}
+	
+	{//// pos/pop/clear ////
+		Arena* arena = arena_create(Megabytes(1));
+		
+		upt pos = arena_pos(arena);
+		u8* a = (u8*)arena_push(arena, 64);
+		forI(64) a[i] = 0xff;
+		arena_pop_to(arena, pos);
+		AssertAlways(arena_used(arena) == 0);
+		
+		//reused memory is zeroed again
+		u8* b = (u8*)arena_push(arena, 64);
+		AssertAlways(a == b);
+		forI(64) AssertAlways(b[i] == 0);
+		
+		arena_clear(arena);
+		AssertAlways(arena->cursor == arena->start);
+		
+		arena_destroy(arena);
+	}
+	
+	{//// allocator ////
+		Arena* arena = arena_create(Megabytes(1));
+		Allocator* allocator = arena_allocator(arena);
+		AssertAlways(allocator != 0);
+		AssertAlways(arena_allocator(arena) == allocator);
+		
+		u8* a = (u8*)allocator->reserve(10);
+		AssertAlways((upt)a % KIGU_ARENA_ALIGNMENT == 0);
+		forI(10) a[i] = i;
+		
+		//resizing the last allocation happens in place
+		u8* b = (u8*)allocator->resize(a, 100);
+		AssertAlways(a == b);
+		forI(10) AssertAlways(b[i] == i);
+		forI(90) AssertAlways(b[10+i] == 0);
+		
+		//resizing an older allocation copies it
+		u8* c = (u8*)allocator->reserve(8);
+		u8* d = (u8*)allocator->resize(b, 200);
+		AssertAlways(d != b && d > c);
+		forI(10) AssertAlways(d[i] == i);
+		
+		//releasing the last allocation rolls back
+		u8* e = (u8*)allocator->reserve(32);
+		allocator->release(e);
+		AssertAlways(allocator->reserve(32) == e);
+		
+		//kigu containers work on top of it
+		arena_clear(arena);
+		u64* array1 = 0;
+		array_init(array1, 4, allocator);
+		for(u64 i = 0; i < 1000; i += 1) array_push_value(array1, i);
+		for(u64 i = 0; i < 1000; i += 1) AssertAlways(array1[i] == i);
+		
+		arena_destroy(arena);
+	}
+	
+	{//// scratch ////
+		Scratch outer = scratch_begin(0);
+		u8* a = (u8*)outer.allocator->reserve(16);
+		AssertAlways(a != 0);
+		
+		//nested scratches avoid the arena of the outer scratch
+		Scratch inner = scratch_begin(outer.allocator);
+		AssertAlways(inner.arena != outer.arena);
+		AssertAlways(inner.allocator != outer.allocator);
+		u8* b = (u8*)inner.allocator->reserve(16);
+		AssertAlways(b != 0 && b != a);
+		scratch_end(inner);
+		AssertAlways(arena_pos(inner.arena) == inner.pos);
+		
+		//scratches that don't conflict share the first arena
+		Scratch other = scratch_begin(0);
+		AssertAlways(other.arena == outer.arena);
+		scratch_end(other);
+		
+		scratch_end(outer);
+		AssertAlways(arena_pos(outer.arena) == outer.pos);
+		
+		scratch_release_thread();
+		AssertAlways(kigu__scratch_arenas[0] == 0 && kigu__scratch_arenas[1] == 0);
+	}
+}
+
+
+#endif //#ifdef KIGU_UNIT_TESTS
+#endif //#ifndef KIGU_ARENA_H
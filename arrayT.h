@@ -11,6 +11,9 @@
 #ifndef KIGU_ARRAY_ALLOCATOR
 #  define KIGU_ARRAY_ALLOCATOR stl_allocator
 #endif
+#ifndef KIGU_ARRAY_ALIGNMENT
+#  define KIGU_ARRAY_ALIGNMENT 1 //minimum alignment of array data (64 for data touched by SIMD kernels), alignof(T) if bigger
+#endif
 
 #ifdef TRACY_ENABLE
 #include "tracy/Tracy.hpp"
@@ -24,6 +27,11 @@
 #include <initializer_list>
 
 
+//returns true if growing memory reserved with `alignment` from `allocator` already zero fills the new memory
+FORCE_INLINE b32 kigu__arrayT_resize_zeroes(Allocator* allocator, upt alignment){
+	return HasFlag(allocator->flags, AllocatorFlags_ZeroResize) && alignment <= allocator_alignment(allocator);
+}
+
 template<typename T>
 struct arrayT{
 	u32 count;
@@ -34,6 +42,8 @@ struct arrayT{
 	T*  iter;
 	Allocator* allocator;
 	
+	static constexpr upt alignment = (alignof(T) > KIGU_ARRAY_ALIGNMENT) ? alignof(T) : KIGU_ARRAY_ALIGNMENT;
+	
 	arrayT();
 	arrayT(Allocator* a);
 	arrayT(u32 _count, Allocator* a = KIGU_ARRAY_ALLOCATOR);
@@ -131,7 +141,7 @@ arrayT(u32 _count, Allocator* a){DPZoneScoped;
 	
 	count = 0;
 	space = RoundUpTo(_count, KIGU_ARRAY_SPACE_ALIGNMENT);
-	data  = (T*)allocator->reserve(space*sizeof(T));
+	data  = (T*)allocator_reserve_aligned(allocator, space*sizeof(T), alignment);
 	
 	first = 0;
 	iter  = 0;
@@ -144,7 +154,7 @@ arrayT(std::initializer_list<T> l, Allocator* a){DPZoneScoped;
 	
 	count = l.size();
 	space = RoundUpTo(l.size(), KIGU_ARRAY_SPACE_ALIGNMENT);
-	data  = (T*)allocator->reserve(space*sizeof(T));
+	data  = (T*)allocator_reserve_aligned(allocator, space*sizeof(T), alignment);
 	
 	forI(l.size()) data[i] = *(l.begin()+i);
 	
@@ -162,7 +172,7 @@ arrayT(const arrayT<T>& array, Allocator* a){DPZoneScoped;
 	
 	count = array.count;
 	space = array.space;
-	data  = (T*)allocator->reserve(space*sizeof(T));
+	data  = (T*)allocator_reserve_aligned(allocator, space*sizeof(T), alignment);
 	
 	forI(array.count) data[i] = array.data[i];
 	
@@ -177,7 +187,7 @@ arrayT(T* _data, u32 _count, Allocator* a){DPZoneScoped;
 	
 	count = _count;
 	space = RoundUpTo(_count, KIGU_ARRAY_SPACE_ALIGNMENT);
-	data  = (T*)allocator->reserve(space*sizeof(T));
+	data  = (T*)allocator_reserve_aligned(allocator, space*sizeof(T), alignment);
 	memcpy(data, _data, _count*sizeof(T));
 	
 	first = data;
@@ -191,7 +201,7 @@ arrayT(carray<T> arr, Allocator* a){DPZoneScoped;
 	
 	count = arr.count;
 	space = RoundUpTo(arr.count, KIGU_ARRAY_SPACE_ALIGNMENT);
-	data  = (T*)allocator->reserve(space*sizeof(T));
+	data  = (T*)allocator_reserve_aligned(allocator, space*sizeof(T), alignment);
 	
 	forI(arr.count) data[i] = arr.data[i];
 	
@@ -203,7 +213,7 @@ arrayT(carray<T> arr, Allocator* a){DPZoneScoped;
 template<typename T> inline arrayT<T>::
 ~arrayT(){
 	forI(count){ data[i].~T(); }
-	allocator->release(data);
+	allocator_release_aligned(allocator, data, alignment);
 	space = 0;
 	count = 0;
 	data  = 0;
@@ -219,12 +229,12 @@ template<typename T> inline arrayT<T>& arrayT<T>::
 operator= (const arrayT<T>& rhs){
 	if(!allocator) allocator = KIGU_ARRAY_ALLOCATOR;
 	forI(count){ data[i].~T(); }
-	allocator->release(data);  //TODO maybe resize rather than release and reserve
+	allocator_release_aligned(allocator, data, alignment);  //TODO maybe resize rather than release and reserve
 	
 	allocator = rhs.allocator;
 	space = rhs.space;
 	count = rhs.count;
-	data  = (T*)allocator->reserve(space*sizeof(T));
+	data  = (T*)allocator_reserve_aligned(allocator, space*sizeof(T), alignment);
 	
 	forI(rhs.count) data[i] = rhs.data[i];
 	
@@ -259,7 +269,7 @@ template<typename T> inline void arrayT<T>::
 add(const T& t){DPZoneScoped;
 	if(space == 0){ //if first item, allocate memory
 		space = KIGU_ARRAY_SPACE_ALIGNMENT;
-		data  = (T*)allocator->reserve(space*sizeof(T));
+		data  = (T*)allocator_reserve_aligned(allocator, space*sizeof(T), alignment);
 		
 		first = data;
 		iter  = data;
@@ -269,8 +279,8 @@ add(const T& t){DPZoneScoped;
 		count = 1;
 	}else if(count == space){ //if array is full, resize the memory by the growth factor
 		space *= KIGU_ARRAY_GROWTH_FACTOR;
-		data = (T*)allocator->resize(data, space*sizeof(T));
-		memset(data+count, 0, (space-count)*sizeof(T)); //NOTE STL doesnt guarantee memory is zero on realloc
+		data = (T*)allocator_resize_aligned(allocator, data, space*sizeof(T), alignment);
+		if(!kigu__arrayT_resize_zeroes(allocator, alignment)) memset(data+count, 0, (space-count)*sizeof(T)); //NOTE STL doesnt guarantee memory is zero on realloc
 		
 		iter  = data + (iter - first);
 		first = data;
@@ -302,7 +312,7 @@ insert(const T& t, u32 idx){DPZoneScoped;
 	Assert(idx <= count);
 	if(space == 0){ //if first item, allocate memory
 		space = KIGU_ARRAY_SPACE_ALIGNMENT;
-		data  = (T*)allocator->reserve(space*sizeof(T));
+		data  = (T*)allocator_reserve_aligned(allocator, space*sizeof(T), alignment);
 		
 		first = data;
 		iter  = data;
@@ -312,8 +322,8 @@ insert(const T& t, u32 idx){DPZoneScoped;
 		data[0] = t;
 	}else if(count == space){ //if array is full, resize the memory by the growth factor
 		space *= KIGU_ARRAY_GROWTH_FACTOR;
-		data = (T*)allocator->resize(data, space*sizeof(T));
-		memset(data+count, 0, (space-count)*sizeof(T)); //NOTE STL doesnt guarantee memory is zero on realloc
+		data = (T*)allocator_resize_aligned(allocator, data, space*sizeof(T), alignment);
+		if(!kigu__arrayT_resize_zeroes(allocator, alignment)) memset(data+count, 0, (space-count)*sizeof(T)); //NOTE STL doesnt guarantee memory is zero on realloc
 		memmove(data+idx+1, data+idx, (count-idx)*sizeof(T));
 		memset(data+idx, 0, 1*sizeof(T));
 		
@@ -417,8 +427,8 @@ resize(u32 new_count){DPZoneScoped;
 	if(!new_count){ this->~arrayT(); return; } //this may not be the appropriate thing to do here
 	if(new_count > space){
 		space = new_count;
-		data = (T*)allocator->resize(data, space*sizeof(T));
-		memset(data+count, 0, (new_count-count)*sizeof(T)); //NOTE STL doesnt guarantee memory is zero on realloc
+		data = (T*)allocator_resize_aligned(allocator, data, space*sizeof(T), alignment);
+		if(!kigu__arrayT_resize_zeroes(allocator, alignment)) memset(data+count, 0, (new_count-count)*sizeof(T)); //NOTE STL doesnt guarantee memory is zero on realloc
 		count = new_count;
 		
 		iter  = data + (iter - first);
@@ -429,7 +439,7 @@ resize(u32 new_count){DPZoneScoped;
 		
 		count = new_count;
 		space = new_count;
-		data = (T*)allocator->resize(data, space*sizeof(T));
+		data = (T*)allocator_resize_aligned(allocator, data, space*sizeof(T), alignment);
 		
 		iter  = data + (iter - first); //TODO check that iter isnt beyond last
 		first = data;
@@ -441,8 +451,8 @@ template<typename T> inline void arrayT<T>::
 reserve(u32 new_space){DPZoneScoped;
 	if(new_space > space){
 		space = RoundUpTo(new_space, KIGU_ARRAY_SPACE_ALIGNMENT);
-		data = (T*)allocator->resize(data, space*sizeof(T));
-		memset(data+count, 0, (new_space-count)*sizeof(T)); //NOTE STL doesnt guarantee memory is zero on realloc
+		data = (T*)allocator_resize_aligned(allocator, data, space*sizeof(T), alignment);
+		if(!kigu__arrayT_resize_zeroes(allocator, alignment)) memset(data+count, 0, (new_space-count)*sizeof(T)); //NOTE STL doesnt guarantee memory is zero on realloc
 		
 		iter  = data + (iter - first);
 		first = data;
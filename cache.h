@@ -0,0 +1,341 @@
+/* kigu cache module
+WHAT:
+This module provides `cache`, a key/value container with a fixed budget of entries and/or cost (usually bytes) that evicts
+entries to stay within it. Entries are found through a kigu `map` and kept in an intrusive `Node` list which is either in
+least recently used order (CachePolicy_LRU) or swept by a clock hand that skips entries used since its last pass
+(CachePolicy_CLOCK). get() and put() are O(1) (CLOCK eviction is amortized O(1)).
+
+WHY:
+Decoded assets and parsed configs are cached by name and were being evicted by hand. A cache keeps the hot entries around and
+hands evicted values back through a callback so whatever owns their memory can release it.
+
+NOTES:
+- LRU moves an entry to the front of its list on every get(), so it evicts more accurately; CLOCK only sets a flag on get(),
+  so hits are cheaper (and don't write to the list) at the cost of evicting the least recently used entry only approximately.
+- The `evict` callback is called with the key and value of every entry that leaves the cache: when it's evicted to make room,
+  removed, cleared, or when put() replaces its value. It can release the value's memory back to its allocator.
+- Budgets of 0 are unlimited. An entry whose cost is bigger than `max_cost` on its own is still added, after evicting
+  everything else.
+- `hits` and `misses` only count get(); peek() and has() don't count and don't mark entries as used.
+- Entries are allocated one at a time from the cache's allocator (which also backs the index).
+- Pointers returned by get(), peek(), and put() are valid until that entry leaves the cache.
+- caches are not copyable and not thread safe.
+
+INDEX:
+@cache
+  CachePolicy: enum
+  cache<Key,Value,HashStruct,EqualStruct>(u32 max_entries, upt max_cost, CachePolicy policy, Allocator* allocator)
+    get(const Key& key) -> Value*
+    peek(const Key& key) -> Value*
+    has(const Key& key) -> bool
+    put(const Key& key, const Value& value, upt cost) -> Value*
+    remove(const Key& key) -> bool
+    clear() -> void
+@cache_tests
+*/
+#pragma once
+#ifndef KIGU_CACHE_H
+#define KIGU_CACHE_H
+
+
+#include <new>
+#include "common.h"
+#include "map.h"
+#include "node.h"
+#include "profiling.h"
+
+
+//-////////////////////////////////////////////////////////////////////////////////////////////////
+//// @cache
+
+
+enum CachePolicy{
+	CachePolicy_LRU,   //evict the least recently used entry
+	CachePolicy_CLOCK, //evict the first entry the clock hand finds that hasn't been used since the hand last passed it
+};
+
+template<typename Key, typename Value, typename HashStruct = hash<Key>, typename EqualStruct = hash_equal<Key>>
+struct cache{
+	struct entry{
+		Node  node;
+		Key   key;
+		Value value;
+		upt   cost;
+		b32   referenced; //used since the clock hand last passed (CLOCK only)
+	};
+	
+	map<Key,entry*,HashStruct,EqualStruct> index;
+	Node  list; //sentinel of the entries, most recently used first for LRU and in clock order for CLOCK
+	Node* hand; //next node the clock hand looks at (CLOCK only), the sentinel is skipped
+	CachePolicy policy;
+	u32 max_entries;
+	upt max_cost;
+	upt total_cost;
+	u64 hits;
+	u64 misses;
+	u64 evictions;
+	void (*evict)(void* user, const Key& key, Value& value); //called for every entry that leaves the cache
+	void* evict_user;
+	Allocator* allocator;
+	
+	cache(u32 max_entries, upt max_cost = 0, CachePolicy policy = CachePolicy_LRU, Allocator* a = stl_allocator);
+	~cache();
+	cache(const cache&) = delete;
+	cache& operator=(const cache&) = delete;
+	
+	Value* get(const Key& key); //returns the key's value (or 0) and marks it as used
+	Value* peek(const Key& key); //returns the key's value (or 0) without marking it as used
+	bool   has(const Key& key) const;
+	Value* put(const Key& key, const Value& value, upt cost = 1); //adds or replaces the key's value, evicting to make room
+	bool   remove(const Key& key); //returns false if the key isn't in the cache
+	void   clear();
+	u32    count() const{ return index.count; }
+	
+	void kigu__unlink(entry* e);
+	void kigu__release(entry* e); //removes `e` from the list and index, calls `evict`, and frees it
+	void kigu__evict_one();
+};
+
+/////////////////////
+//// @internals ////
+/////////////////////
+template<typename Key, typename Value, typename HashStruct, typename EqualStruct> inline void cache<Key,Value,HashStruct,EqualStruct>::
+kigu__unlink(entry* e){
+	if(hand == &e->node) hand = hand->next;
+	NodeRemove(&e->node);
+}
+
+template<typename Key, typename Value, typename HashStruct, typename EqualStruct> inline void cache<Key,Value,HashStruct,EqualStruct>::
+kigu__release(entry* e){
+	kigu__unlink(e);
+	index.remove(e->key);
+	total_cost -= e->cost;
+	if(evict) evict(evict_user, e->key, e->value);
+	e->~entry();
+	allocator->release(e);
+}
+
+template<typename Key, typename Value, typename HashStruct, typename EqualStruct> inline void cache<Key,Value,HashStruct,EqualStruct>::
+kigu__evict_one(){DPZoneScoped;
+	Assert(index.count > 0);
+	entry* victim = 0;
+	if(policy == CachePolicy_LRU){
+		victim = CastFromMember(entry, node, list.prev);
+	}else{
+		//sweep the hand, giving every used entry a second chance
+		for(;;){
+			if(hand == &list) hand = list.next;
+			entry* e = CastFromMember(entry, node, hand);
+			hand = hand->next;
+			if(!e->referenced){
+				victim = e;
+				break;
+			}
+			e->referenced = false;
+		}
+	}
+	evictions += 1;
+	kigu__release(victim);
+}
+
+//////////////////////
+//// @contructors ////
+//////////////////////
+template<typename Key, typename Value, typename HashStruct, typename EqualStruct> inline cache<Key,Value,HashStruct,EqualStruct>::
+cache(u32 _max_entries, upt _max_cost, CachePolicy _policy, Allocator* a) : index(a){DPZoneScoped;
+	list.next   = &list;
+	list.prev   = &list;
+	hand        = &list;
+	policy      = _policy;
+	max_entries = _max_entries;
+	max_cost    = _max_cost;
+	total_cost  = 0;
+	hits        = 0;
+	misses      = 0;
+	evictions   = 0;
+	evict       = 0;
+	evict_user  = 0;
+	allocator   = a;
+	if(max_entries) index.reserve(max_entries);
+}
+
+template<typename Key, typename Value, typename HashStruct, typename EqualStruct> inline cache<Key,Value,HashStruct,EqualStruct>::
+~cache(){
+	clear();
+}
+
+////////////////////
+//// @functions ////
+////////////////////
+template<typename Key, typename Value, typename HashStruct, typename EqualStruct> inline Value* cache<Key,Value,HashStruct,EqualStruct>::
+get(const Key& key){DPZoneScoped;
+	entry** found = index.at(key);
+	if(!found){
+		misses += 1;
+		return 0;
+	}
+	
+	hits += 1;
+	entry* e = *found;
+	if(policy == CachePolicy_LRU){
+		if(list.next != &e->node){
+			NodeRemove(&e->node);
+			NodeInsertNext(&list, &e->node);
+		}
+	}else{
+		e->referenced = true;
+	}
+	return &e->value;
+}
+
+template<typename Key, typename Value, typename HashStruct, typename EqualStruct> inline Value* cache<Key,Value,HashStruct,EqualStruct>::
+peek(const Key& key){DPZoneScoped;
+	entry** found = index.at(key);
+	return (found) ? &(*found)->value : 0;
+}
+
+template<typename Key, typename Value, typename HashStruct, typename EqualStruct> inline bool cache<Key,Value,HashStruct,EqualStruct>::
+has(const Key& key)const{DPZoneScoped;
+	return index.has(key);
+}
+
+template<typename Key, typename Value, typename HashStruct, typename EqualStruct> inline Value* cache<Key,Value,HashStruct,EqualStruct>::
+put(const Key& key, const Value& value, upt cost){DPZoneScoped;
+	entry** found = index.at(key);
+	if(found){
+		entry* e = *found;
+		if(evict) evict(evict_user, e->key, e->value);
+		e->value = value;
+		total_cost += cost - e->cost;
+		e->cost = cost;
+		if(policy == CachePolicy_LRU){
+			NodeRemove(&e->node);
+			NodeInsertNext(&list, &e->node);
+		}else{
+			e->referenced = true;
+		}
+		
+		//the new cost might not fit, but the entry that was just put is never the one evicted
+		while(max_cost && total_cost > max_cost && index.count > 1){
+			kigu__unlink(e);
+			kigu__evict_one();
+			if(policy == CachePolicy_LRU) NodeInsertNext(&list, &e->node);
+			else NodeInsertPrev(hand, &e->node);
+		}
+		return &e->value;
+	}
+	
+	while(index.count && ((max_entries && index.count + 1 > max_entries) || (max_cost && total_cost + cost > max_cost))){
+		kigu__evict_one();
+	}
+	
+	entry* e = new(allocator->reserve(sizeof(entry))) entry{Node{}, key, value, cost, false};
+	if(policy == CachePolicy_LRU){
+		NodeInsertNext(&list, &e->node);
+	}else{
+		NodeInsertPrev(hand, &e->node); //behind the hand, so it's the last entry the hand reaches
+	}
+	index.add(key, e);
+	total_cost += cost;
+	return &e->value;
+}
+
+template<typename Key, typename Value, typename HashStruct, typename EqualStruct> inline bool cache<Key,Value,HashStruct,EqualStruct>::
+remove(const Key& key){DPZoneScoped;
+	entry** found = index.at(key);
+	if(!found) return false;
+	kigu__release(*found);
+	return true;
+}
+
+template<typename Key, typename Value, typename HashStruct, typename EqualStruct> inline void cache<Key,Value,HashStruct,EqualStruct>::
+clear(){DPZoneScoped;
+	while(list.next != &list) kigu__release(CastFromMember(entry, node, list.next));
+	hand = &list;
+}
+
+
+//-////////////////////////////////////////////////////////////////////////////////////////////////
+//// @cache_tests
+#ifdef KIGU_UNIT_TESTS
+
+
+global void kigu__cache_unit_tests()
+{
+	{//// LRU ////
+		cache<u32,u32> c(3);
+		c.put(1, 10);
+		c.put(2, 20);
+		c.put(3, 30);
+		AssertAlways(*c.get(1) == 10); //2 is now the least recently used
+		c.put(4, 40);
+		AssertAlways(!c.has(2) && c.has(1) && c.has(3) && c.has(4));
+		AssertAlways(c.get(2) == 0);
+		AssertAlways(c.hits == 1 && c.misses == 1 && c.evictions == 1 && c.count() == 3);
+		
+		//peek doesn't change the order
+		AssertAlways(*c.peek(3) == 30);
+		c.put(5, 50);
+		AssertAlways(!c.has(3));
+		
+		//replacing a value moves it to the front
+		c.put(1, 11);
+		c.put(6, 60);
+		AssertAlways(c.has(1) && *c.peek(1) == 11 && !c.has(4));
+		AssertAlways(c.remove(1) && !c.remove(1) && c.count() == 2);
+	}
+	
+	{//// CLOCK ////
+		cache<u32,u32> c(3, 0, CachePolicy_CLOCK);
+		c.put(1, 10);
+		c.put(2, 20);
+		c.put(3, 30);
+		c.get(1);
+		c.get(3);
+		c.put(4, 40); //1 and 3 get a second chance, 2 is evicted
+		AssertAlways(c.has(1) && !c.has(2) && c.has(3) && c.has(4));
+		c.put(5, 50); //the hand clears 3 and wraps around to 1, which it cleared on the last pass
+		AssertAlways(!c.has(1) && c.has(3) && c.has(4) && c.has(5));
+		AssertAlways(c.evictions == 2);
+		
+		//lots of churn keeps the budget
+		forI(10000){
+			c.put(100 + i, i);
+			if(i % 3 == 0) c.get(100 + i);
+			AssertAlways(c.count() <= 3);
+		}
+		AssertAlways(*c.peek(100 + 9999) == 9999);
+	}
+	
+	{//// cost budget and eviction callback ////
+		struct Released{ upt bytes; u32 calls; } released = {};
+		cache<u32,void*> c(0, 100);
+		c.evict_user = &released;
+		c.evict = [](void* user, const u32& key, void*& value){
+			Released* r = (Released*)user;
+			r->bytes += *(upt*)value;
+			r->calls += 1;
+			stl_allocator->release(value);
+		};
+		auto make = [](upt bytes){
+			upt* value = (upt*)stl_allocator->reserve(sizeof(upt));
+			*value = bytes;
+			return (void*)value;
+		};
+		c.put(1, make(40), 40);
+		c.put(2, make(40), 40);
+		c.put(3, make(40), 40); //evicts 1
+		AssertAlways(!c.has(1) && c.total_cost == 80 && released.calls == 1 && released.bytes == 40);
+		c.put(2, make(90), 90); //replacing 2 releases its old value and evicts 3 to fit
+		AssertAlways(c.has(2) && !c.has(3) && c.total_cost == 90);
+		AssertAlways(released.calls == 3 && released.bytes == 120);
+		c.put(4, make(500), 500); //too big on its own, still added after evicting everything else
+		AssertAlways(c.count() == 1 && c.has(4));
+		c.clear();
+		AssertAlways(c.count() == 0 && c.total_cost == 0 && released.calls == 5 && released.bytes == 710);
+	}
+}
+
+
+#endif //#ifdef KIGU_UNIT_TESTS
+#endif //#ifndef KIGU_CACHE_H
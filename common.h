@@ -214,13 +214,21 @@
 //// compiler-dependent builtins ////
 /////////////////////////////////////
 #if COMPILER_CL
+#  include <intrin.h>
 #  define FORCE_INLINE __forceinline
+#  define THREAD_LOCAL __declspec(thread)
 #  define DebugBreakpoint __debugbreak()
 #  define ByteSwap16(x) _byteswap_ushort(x)
 #  define ByteSwap32(x) _byteswap_ulong(x)
 #  define ByteSwap64(x) _byteswap_uint64(x)
+#  if ARCH_ARM64
+#    define PrefetchRead(ptr) __prefetch((const void*)(ptr))
+#  else
+#    define PrefetchRead(ptr) _mm_prefetch((const char*)(ptr), _MM_HINT_T0)
+#  endif
 #elif COMPILER_CLANG || COMPILER_GCC
 #  define FORCE_INLINE inline __attribute__((always_inline))
+#  define THREAD_LOCAL __thread
 #  if defined(__i386__) || defined(__x86_64__)
 #    define DebugBreakpoint __builtin_debugtrap()
 #  else
@@ -230,6 +238,7 @@
 #  define ByteSwap16(x) __builtin_bswap16(x)
 #  define ByteSwap32(x) __builtin_bswap32(x)
 #  define ByteSwap64(x) __builtin_bswap64(x)
+#  define PrefetchRead(ptr) __builtin_prefetch((const void*)(ptr), 0, 3)
 #else
 #  error "unhandled compiler"
 #endif //#if COMPILER_CL
@@ -329,10 +338,21 @@ global void  Allocator_ReleaseMemory_Noop(void* ptr){}
 #  pragma warning(pop)
 #endif //#if COMPILER_CLANG || COMPILER_GCC
 
+enum{
+	AllocatorFlags_None        = 0,
+	AllocatorFlags_ZeroReserve = (1 << 0), //reserve() always returns zero filled memory
+	AllocatorFlags_ZeroResize  = (1 << 1), //resize() always zero fills the memory past the old size when growing
+}; typedef Flags AllocatorFlags;
+
 struct Allocator{
 	Allocator_ReserveMemory_Func reserve;  //reserves address space from OS
+	Allocator_ChangeMemory_Func  commit;   //commits reserved memory so it is backed by physical pages
+	Allocator_ChangeMemory_Func  decommit; //decommits committed memory back to reserved address space
 	Allocator_ReleaseMemory_Func release;  //release the reserved memory back to OS
 	Allocator_ResizeMemory_Func  resize;   //resizes reserved memory and moves memory if a new location is required
+	Allocator_ReserveMemory_Func reserve_uninitialized; //reserves memory without zero filling it (0 if unsupported)
+	AllocatorFlags flags; //guarantees the allocator makes about its memory (AllocatorFlags_*)
+	u32 alignment;        //alignment of all reserved memory (0 means the same alignment as malloc)
 };
 
 struct str8{
@@ -502,6 +522,7 @@ global_const u64 wcharsize = sizeof(wchar);
 #define ReadBits16(var,start,numbits) ((var) >> (start)) & (((u16)1 << (numbits)) - 1)
 #define ReadBits8 (var,start,numbits) ((var) >> (start)) & (((u8) 1 << (numbits)) - 1)
 
+//see ENUM_LIST_PERFECT_HASH() in perfect_hash.h for turning the strings back into enum values
 #define ENUM_LIST_ENUM(prefix,raw_enum) prefix##_##raw_enum
 #define ENUM_LIST_STRING(prefix,raw_enum) STR8(STRINGIZE(raw_enum))
 #define ENUM_LIST(list_name, list_macro)                           \
@@ -528,6 +549,24 @@ FORCE_INLINE void MoveMemory(void* dst, void* src, upt bytes){memmove(dst,src,by
 
 FORCE_INLINE b32 IsPow2(u64 value){return (value != 0) && ((value & (value-1)) == 0);}
 FORCE_INLINE upt roundUpToPow2(upt x){return (upt)1 << (upt)((upt)log2(f64(--x)) + 1); }
+FORCE_INLINE u32 FloorLog2(u64 value){ //value must be non-zero
+#if COMPILER_CL
+	unsigned long index;
+	_BitScanReverse64(&index, value);
+	return (u32)index;
+#else
+	return 63 - (u32)__builtin_clzll(value);
+#endif //#if COMPILER_CL
+}
+FORCE_INLINE u32 CountTrailingZeros64(u64 value){ //value must be non-zero
+#if COMPILER_CL
+	unsigned long index;
+	_BitScanForward64(&index, value);
+	return (u32)index;
+#else
+	return (u32)__builtin_ctzll(value);
+#endif //#if COMPILER_CL
+}
 
 FORCE_INLINE str8 bytesUnit(upt bytes){return (bytes > Kilobytes(1) ? bytes > Megabytes(1) ? bytes > Gigabytes(1) ? bytes > Terabytes(1) ? STR8("TB") : STR8("GB") : STR8("MB") : STR8("KB") : STR8("B")); }
 FORCE_INLINE f32 bytesDivisor(upt bytes){return (bytes > Kilobytes(1) ? bytes > Megabytes(1) ? bytes > Gigabytes(1) ? bytes > Terabytes(1) ? Terabytes(1) : Gigabytes(1) : Megabytes(1) : Kilobytes(1) : 1); }
@@ -560,6 +599,105 @@ template<typename T> FORCE_INLINE T& deref_if_ptr(T& x){return x;}
 template<typename T> FORCE_INLINE T& deref_if_ptr(T* x){return *x;}
 
 
+//////////////////////// //NOTE wyhash (final version 4, public domain) https://github.com/wangyi-fudan/wyhash
+//// hash functions //// //NOTE reads are little-endian, which is every architecture kigu supports
+////////////////////////
+#define KIGU_HASH_SECRET0 0x2d358dccaa6c78a5ull
+#define KIGU_HASH_SECRET1 0x8bb84b93962eacc9ull
+#define KIGU_HASH_SECRET2 0x4b33a62ed433d4a3ull
+#define KIGU_HASH_SECRET3 0x4d5a2da51de1aa47ull
+
+//sets `a` to the low and `b` to the high 64 bits of a*b
+constexpr void kigu__hash_mum(u64* a, u64* b){
+#if COMPILER_CLANG || COMPILER_GCC
+	__uint128_t r = (__uint128_t)*a * *b;
+	*a = (u64)r;
+	*b = (u64)(r >> 64);
+#else
+	u64 ha = *a >> 32, hb = *b >> 32, la = (u32)*a, lb = (u32)*b;
+	u64 rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+	u64 t = rl + (rm0 << 32);
+	u64 lo = t + (rm1 << 32);
+	u64 hi = rh + (rm0 >> 32) + (rm1 >> 32) + (t < rl) + (lo < t);
+	*a = lo;
+	*b = hi;
+#endif //#if COMPILER_CLANG || COMPILER_GCC
+}
+constexpr u64 HashMix64(u64 a, u64 b){kigu__hash_mum(&a, &b); return a ^ b;}
+
+//the `const char*` reads work at compile-time and the `const u8*` reads are single loads, both give the same values
+constexpr u64 kigu__hash_read8(const char* p){
+	return (u64)(u8)p[0] | ((u64)(u8)p[1] << 8) | ((u64)(u8)p[2] << 16) | ((u64)(u8)p[3] << 24)
+		| ((u64)(u8)p[4] << 32) | ((u64)(u8)p[5] << 40) | ((u64)(u8)p[6] << 48) | ((u64)(u8)p[7] << 56);
+}
+constexpr u64 kigu__hash_read4(const char* p){
+	return (u64)(u8)p[0] | ((u64)(u8)p[1] << 8) | ((u64)(u8)p[2] << 16) | ((u64)(u8)p[3] << 24);
+}
+FORCE_INLINE u64 kigu__hash_read8(const u8* p){u64 v; memcpy(&v, p, 8); return v;}
+FORCE_INLINE u64 kigu__hash_read4(const u8* p){u32 v; memcpy(&v, p, 4); return v;}
+template<typename Byte> constexpr u64 kigu__hash_read3(const Byte* p, u64 count){
+	return ((u64)(u8)p[0] << 16) | ((u64)(u8)p[count >> 1] << 8) | (u64)(u8)p[count-1];
+}
+
+//mixes the 48 bytes at `p` into the three lanes of a hash
+template<typename Byte> constexpr void kigu__hash64_block(const Byte* p, u64* seed, u64* seed1, u64* seed2){
+	*seed  = HashMix64(kigu__hash_read8(p)      ^ KIGU_HASH_SECRET1, kigu__hash_read8(p +  8) ^ *seed);
+	*seed1 = HashMix64(kigu__hash_read8(p + 16) ^ KIGU_HASH_SECRET2, kigu__hash_read8(p + 24) ^ *seed1);
+	*seed2 = HashMix64(kigu__hash_read8(p + 32) ^ KIGU_HASH_SECRET3, kigu__hash_read8(p + 40) ^ *seed2);
+}
+
+//returns the hash of `count` bytes from the last `i` bytes at `p` (1-48 of them, when `count` is more than 16), which reads
+//  the 16 bytes before the end even if that's before `p`
+template<typename Byte> constexpr u64 kigu__hash64_tail(const Byte* p, u64 i, u64 seed, u64 count){
+	while(i > 16){
+		seed = HashMix64(kigu__hash_read8(p) ^ KIGU_HASH_SECRET1, kigu__hash_read8(p + 8) ^ seed);
+		p += 16;
+		i -= 16;
+	}
+	u64 a = kigu__hash_read8(p + i - 16) ^ KIGU_HASH_SECRET1;
+	u64 b = kigu__hash_read8(p + i - 8) ^ seed;
+	kigu__hash_mum(&a, &b);
+	return HashMix64(a ^ KIGU_HASH_SECRET0 ^ count, b ^ KIGU_HASH_SECRET1);
+}
+
+//returns a 64bit hash of `count` bytes at `p` seeded with `seed`, 48 bytes at a time
+template<typename Byte> constexpr u64 kigu__hash64(const Byte* p, u64 count, u64 seed){
+	seed ^= HashMix64(seed ^ KIGU_HASH_SECRET0, KIGU_HASH_SECRET1);
+	if(count > 16){
+		u64 i = count;
+		if(i > 48){
+			u64 seed1 = seed, seed2 = seed;
+			do{
+				kigu__hash64_block(p, &seed, &seed1, &seed2);
+				p += 48;
+				i -= 48;
+			}while(i > 48);
+			seed ^= seed1 ^ seed2;
+		}
+		return kigu__hash64_tail(p, i, seed, count);
+	}
+	
+	u64 a = 0, b = 0;
+	if(count >= 4){
+		a = (kigu__hash_read4(p) << 32) | kigu__hash_read4(p + ((count >> 3) << 2));
+		b = (kigu__hash_read4(p + count - 4) << 32) | kigu__hash_read4(p + count - 4 - ((count >> 3) << 2));
+	}else if(count > 0){
+		a = kigu__hash_read3(p, count);
+	}
+	a ^= KIGU_HASH_SECRET1;
+	b ^= seed;
+	kigu__hash_mum(&a, &b);
+	return HashMix64(a ^ KIGU_HASH_SECRET0 ^ count, b ^ KIGU_HASH_SECRET1);
+}
+
+//returns a 64bit hash of `bytes` bytes at `data` seeded with `seed`
+FORCE_INLINE u64 Hash64(const void* data, upt bytes, u64 seed = 0){return kigu__hash64((const u8*)data, bytes, seed);}
+//returns a 64bit hash of `count` chars at `str` seeded with `seed` at compile-time (the same as Hash64())
+constexpr u64 HashStatic64(const char* str, u64 count, u64 seed = 0){return kigu__hash64(str, count, seed);}
+//returns a 64bit hash of a single integer (or pointer) `value` with one multiply, for small fixed-size keys
+constexpr u64 HashU64(u64 value, u64 seed = 0){return HashMix64(value ^ KIGU_HASH_SECRET0, value ^ seed ^ KIGU_HASH_SECRET1);}
+
+
 /////////////////////// //NOTE the ... is for a programmer message at the assert; it is unused otherwise
 //// assert macros //// //TODO(delle) assert message popup thru the OS
 /////////////////////// 
@@ -636,13 +774,68 @@ template <class F> deferrer<F> operator*(defer_dummy, F f) { return {f}; }
 global void* STLAllocator_Reserve(upt size){void* a = calloc(1,size); Assert(a); return a;}
 global void  STLAllocator_Release(void* ptr){free(ptr);}
 global void* STLAllocator_Resize(void* ptr, upt size){void* a = realloc(ptr,size); Assert(a); return a;}
+global void* STLAllocator_ReserveUninitialized(upt size){void* a = malloc(size); Assert(a); return a;}
 global Allocator stl_allocator_{
 	STLAllocator_Reserve,
+	Allocator_ChangeMemory_Noop,
+	Allocator_ChangeMemory_Noop,
 	STLAllocator_Release,
-	STLAllocator_Resize
+	STLAllocator_Resize,
+	STLAllocator_ReserveUninitialized,
+	AllocatorFlags_ZeroReserve,
+	alignof(max_align_t)
 };
 global Allocator* stl_allocator = &stl_allocator_;
 
+//// allocator helpers ////
+//returns the alignment of all memory reserved by `allocator`
+FORCE_INLINE upt allocator_alignment(Allocator* allocator){
+	return (allocator->alignment) ? (upt)allocator->alignment : (upt)alignof(max_align_t);
+}
+
+//reserves `size` bytes from `allocator` without zero filling them if the allocator supports it
+FORCE_INLINE void* allocator_reserve_uninitialized(Allocator* allocator, upt size){
+	return (allocator->reserve_uninitialized) ? allocator->reserve_uninitialized(size) : allocator->reserve(size);
+}
+
+//reserves `size` bytes aligned to `alignment` (a power of two no greater than 256) from `allocator`
+//  memory must be resized and released with the _aligned functions using the same `alignment`
+//  if `allocator` doesn't already guarantee `alignment`, the allocation is padded and offset to the next aligned address
+//  with the offset stored in the byte before the returned pointer
+global void* allocator_reserve_aligned(Allocator* allocator, upt size, upt alignment){
+	Assert(IsPow2(alignment) && alignment <= 256);
+	if(alignment <= allocator_alignment(allocator)) return allocator->reserve(size);
+	u8* raw = (u8*)allocator->reserve(size + alignment);
+	if(!raw) return 0;
+	u8* result = (u8*)AlignToPow2((upt)raw + 1, alignment);
+	result[-1] = (u8)(result - raw - 1);
+	return result;
+}
+
+//resizes `ptr` (which was reserved with allocator_reserve_aligned()) to `size` bytes aligned to `alignment`
+//  the memory past the old size is only zero filled if the allocator guarantees `alignment` and AllocatorFlags_ZeroResize
+global void* allocator_resize_aligned(Allocator* allocator, void* ptr, upt size, upt alignment){
+	if(alignment <= allocator_alignment(allocator)) return allocator->resize(ptr, size);
+	if(!ptr) return allocator_reserve_aligned(allocator, size, alignment);
+	upt old_offset = (upt)((u8*)ptr)[-1] + 1;
+	u8* raw = (u8*)allocator->resize((u8*)ptr - old_offset, size + alignment);
+	if(!raw) return 0;
+	u8* result = (u8*)AlignToPow2((upt)raw + 1, alignment);
+	upt new_offset = (upt)(result - raw);
+	if(new_offset != old_offset) MoveMemory(result, raw + old_offset, size);
+	result[-1] = (u8)(new_offset - 1);
+	return result;
+}
+
+//releases `ptr` (which was reserved with allocator_reserve_aligned()) back to `allocator`
+global void allocator_release_aligned(Allocator* allocator, void* ptr, upt alignment){
+	if(alignment <= allocator_alignment(allocator) || !ptr){
+		allocator->release(ptr);
+		return;
+	}
+	allocator->release((u8*)ptr - ((upt)((u8*)ptr)[-1] + 1));
+}
+
 
 ///////////////////////////// //TODO remove/rework/rename these
 //// to-be-redone macros ////
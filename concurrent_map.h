@@ -0,0 +1,664 @@
+/* kigu concurrent_map module
+WHAT:
+This module provides `concurrent_map`, a hash table that many threads can read and write at once. Keys are split over a power
+of two number of shards (picked by the high bits of the key's hash), each of which is a flat_map style table with its own spin
+lock for writers and its own sequence counter for readers. Writers lock their shard and bump its sequence counter around every
+change; readers don't lock at all, they read the table and retry if the counter was odd or changed while they were reading
+(a seqlock).
+
+WHY:
+Wrapping a `map` in one mutex makes every worker wait on every other worker, even when they only read. With shards, writers
+only contend when they hash to the same shard, and readers never block writers or each other, so read heavy mixes scale with
+the number of cores.
+
+NOTES:
+- Keys and values must be trivially copyable: readers copy values out by their bytes and tables move them with memcpy. Store
+  pointers (or handles) to values that own memory. str8 keys point at memory the caller owns, like with `map`.
+- get() copies the value out rather than returning a pointer, since another thread could change or remove it at any time.
+- A key's bytes are never overwritten while it is in a table that readers can see (removed keys only mark their slot as
+  deleted and tables are never reused once rehashed), so readers can always compare keys safely. Deleted slots are cleared
+  when their shard rehashes, which is at the same size if the table is mostly deleted slots.
+- A shard's old tables are kept after it rehashes while readers might still be looking at them. Every get() and has() marks
+  the map's epoch (bumped by every rehash) in its thread's reader slot while it reads, and every rehash frees the shard's old
+  tables that were replaced before the oldest marked epoch, so a churning shard only keeps tables that are being read.
+  reclaim() frees every old table but must only be called when no other thread is using the map.
+- Threads share the KIGU_CONCURRENT_MAP_READER_SLOTS reader slots round robin. A reader that finds its slot in use counts
+  itself in a shared counter instead, which stops any table from being freed until it's done.
+- Memory comes from the map's allocator from whichever thread is writing, so the allocator must be thread safe.
+- for_each_shard() visits a shard as a writer (it holds the lock and its sequence is odd), so `fn` can change values, and
+  get() and has() on that shard wait until the visit is done. for_each_parallel() visits shards from several threads.
+- count() is only exact when no other thread is writing.
+- Readers' group loads can overlap with a writer's stores (the sequence counter makes them retry), which ThreadSanitizer
+  reports as races on control bytes.
+
+INDEX:
+@concurrent_map
+  concurrent_map<Key,Value,HashStruct,EqualStruct>(u32 shard_count, Allocator* allocator)
+    add(const Key& key, const Value& value) -> bool
+    set(const Key& key, const Value& value) -> void
+    remove(const Key& key) -> bool
+    get(const Key& key, Value* out) -> bool
+    has(const Key& key) -> bool
+    count() -> u64
+    reserve(u64 new_count) -> void
+    for_each_shard(u32 shard, Fn fn) -> void
+    for_each(Fn fn) -> void
+    for_each_parallel(Fn fn, u32 thread_count) -> void
+    reclaim() -> void
+@concurrent_map_tests
+*/
+#pragma once
+#ifndef KIGU_CONCURRENT_MAP_H
+#define KIGU_CONCURRENT_MAP_H
+
+
+#ifndef KIGU_CONCURRENT_MAP_SHARD_COUNT
+#  define KIGU_CONCURRENT_MAP_SHARD_COUNT 64
+#endif
+#ifndef KIGU_CONCURRENT_MAP_READER_SLOTS
+#  define KIGU_CONCURRENT_MAP_READER_SLOTS 64 //must be a power of two
+#endif
+
+
+#include "common.h"
+#include "memory.h"
+#include "hash.h"
+#include "flat_map.h"
+#include "profiling.h"
+
+#include <new>
+#include <thread>
+#include <type_traits>
+
+
+//-////////////////////////////////////////////////////////////////////////////////////////////////
+//// @concurrent_map
+
+
+//index of the calling thread's reader slot (before wrapping to KIGU_CONCURRENT_MAP_READER_SLOTS), assigned on its first read
+inline thread_local u32 kigu__concurrent_map_reader_index = -1;
+inline volatile u32 kigu__concurrent_map_reader_count;
+
+template<typename Key, typename Value, typename HashStruct = hash<Key>, typename EqualStruct = hash_equal<Key>>
+struct concurrent_map{
+	static_assert(std::is_trivially_copyable<Key>::value && std::is_trivially_copyable<Value>::value,
+				  "concurrent_map keys and values must be trivially copyable");
+	
+	//a table is one allocation holding this header, then the control bytes, keys, and values
+	struct table{
+		u8*    control;
+		Key*   keys;
+		Value* values;
+		u32    capacity;
+		u32    retire_epoch; //the map's epoch when this table was replaced
+		table* retired;      //the table this one replaced, kept while readers might be looking at it
+	};
+	
+	struct alignas(64) shard{ //aligned so threads working on neighboring shards don't share cache lines
+		volatile u32 sequence; //odd while a writer is changing the shard
+		volatile s32 lock;
+		table* current;
+		u32 count;
+		u32 used; //full and deleted slots
+	};
+	
+	struct alignas(64) reader_slot{ //aligned so readers on different threads don't share cache lines
+		volatile u32 epoch; //the epoch the reader using this slot started in, 0 while unused
+	};
+	
+	struct readers{
+		reader_slot slots[KIGU_CONCURRENT_MAP_READER_SLOTS];
+		alignas(64) volatile u32 overflow; //readers that found their slot in use, no table is freed while there are any
+	};
+	
+	shard* shards;
+	readers* reading;
+	u32 shard_count;
+	u32 shard_bits;
+	volatile u32 epoch; //bumped by 2 every time a table is replaced, so it's always odd and never 0
+	Allocator* allocator;
+	
+	concurrent_map(u32 shard_count = KIGU_CONCURRENT_MAP_SHARD_COUNT, Allocator* a = stl_allocator);
+	~concurrent_map();
+	concurrent_map(const concurrent_map&) = delete;
+	concurrent_map& operator=(const concurrent_map&) = delete;
+	
+	bool add(const Key& key, const Value& value); //returns false if the key already exists (its value is left alone)
+	void set(const Key& key, const Value& value); //adds the key or replaces its value
+	bool remove(const Key& key); //returns false if the key doesn't exist
+	bool get(const Key& key, Value* out) const; //copies the key's value into `out` and returns true if the key exists
+	bool has(const Key& key) const;
+	u64  count() const;
+	void reserve(u64 new_count); //makes room for `new_count` keys spread evenly over the shards
+	void reclaim(); //frees every table replaced by rehashes, only call this when no other thread is using the map
+	
+	//calls `fn(const Key&, Value&)` for every key in shard `shard` as a writer, so readers of the shard wait until it's done
+	template<typename Fn> void for_each_shard(u32 shard, Fn fn);
+	template<typename Fn> void for_each(Fn fn);
+	//calls for_each_shard() for every shard spread over `thread_count` threads (the hardware thread count if 0)
+	//  `fn` is called from several threads at once
+	template<typename Fn> void for_each_parallel(Fn fn, u32 thread_count = 0);
+	
+	shard* kigu__shard_of(u64 hashed) const;
+	u32    kigu__find(table* t, const Key& key, u64 hashed) const; //returns the slot holding `key`, or -1
+	table* kigu__table_create(u32 capacity);
+	void   kigu__rehash(shard* s, u32 new_capacity);
+	void   kigu__free_retired(shard* s);
+	void   kigu__write_begin(shard* s);
+	void   kigu__write_end(shard* s);
+	u32    kigu__read_begin() const; //returns the reader slot the calling thread marked, or -1 if it counted as overflow
+	void   kigu__read_end(u32 slot) const;
+};
+
+/////////////////////
+//// @internals ////
+/////////////////////
+template<typename Key, typename Value, typename HashStruct, typename EqualStruct> inline typename concurrent_map<Key,Value,HashStruct,EqualStruct>::shard* concurrent_map<Key,Value,HashStruct,EqualStruct>::
+kigu__shard_of(u64 hashed)const{
+	return &shards[(u32)((hashed >> 32) >> (32 - shard_bits))];
+}
+
+template<typename Key, typename Value, typename HashStruct, typename EqualStruct> inline u32 concurrent_map<Key,Value,HashStruct,EqualStruct>::
+kigu__find(table* t, const Key& key, u64 hashed)const{
+	if(!t) return -1;
+	u8  tag   = kigu__flat_map_tag(hashed);
+	u32 mask  = (t->capacity / KIGU_FLAT_MAP_GROUP_SIZE) - 1;
+	u32 group = (u32)(hashed >> 32) & mask;
+	for(u32 step = 1; step <= mask+1; group = (group + step) & mask, step += 1){
+		const u8* ctrl = t->control + group*KIGU_FLAT_MAP_GROUP_SIZE;
+		for(u64 match = kigu__flat_map_match(ctrl, tag); match; match &= match - 1){
+			u32 slot = group*KIGU_FLAT_MAP_GROUP_SIZE + kigu__flat_map_mask_index(match);
+			if(EqualStruct{}(t->keys[slot], key)) return slot;
+		}
+		if(kigu__flat_map_match_empty(ctrl)) return -1;
+	}
+	return -1; //only reachable by a reader that raced a writer, which will retry
+}
+
+template<typename Key, typename Value, typename HashStruct, typename EqualStruct> inline typename concurrent_map<Key,Value,HashStruct,EqualStruct>::table* concurrent_map<Key,Value,HashStruct,EqualStruct>::
+kigu__table_create(u32 capacity){
+	upt control_offset = RoundUpTo(sizeof(table), (upt)KIGU_FLAT_MAP_GROUP_SIZE);
+	upt keys_offset    = RoundUpTo(control_offset + capacity, alignof(Key));
+	upt values_offset  = RoundUpTo(keys_offset + (upt)capacity*sizeof(Key), alignof(Value));
+	upt alignment      = Max((upt)KIGU_FLAT_MAP_GROUP_SIZE, Max((upt)alignof(Key), (upt)alignof(Value)));
+	u8* memory = (u8*)allocator_reserve_aligned(allocator, values_offset + (upt)capacity*sizeof(Value), alignment);
+	table* t = (table*)memory;
+	t->control  = memory + control_offset;
+	t->keys     = (Key*)(memory + keys_offset);
+	t->values   = (Value*)(memory + values_offset);
+	t->capacity = capacity;
+	t->retired  = 0;
+	memset(t->control, KIGU_FLAT_MAP_EMPTY, capacity);
+	return t;
+}
+
+//NOTE must be called with the shard locked, readers keep using the old table until the new one is published
+template<typename Key, typename Value, typename HashStruct, typename EqualStruct> inline void concurrent_map<Key,Value,HashStruct,EqualStruct>::
+kigu__rehash(shard* s, u32 new_capacity){DPZoneScoped;
+	Assert(IsPow2(new_capacity) && new_capacity >= KIGU_FLAT_MAP_GROUP_SIZE && s->count <= kigu__flat_map_max_load(new_capacity));
+	table* old_table = s->current;
+	table* new_table = kigu__table_create(new_capacity);
+	if(old_table){
+		forI(old_table->capacity){
+			if(!flat_map_slot_full(old_table->control[i])) continue;
+			u64 hashed = kigu__flat_map_mix(HashStruct{}(old_table->keys[i]));
+			u32 mask   = (new_capacity / KIGU_FLAT_MAP_GROUP_SIZE) - 1;
+			u32 group  = (u32)(hashed >> 32) & mask;
+			for(u32 step = 1;; group = (group + step) & mask, step += 1){
+				u64 match = kigu__flat_map_match_empty(new_table->control + group*KIGU_FLAT_MAP_GROUP_SIZE);
+				if(match){
+					u32 slot = group*KIGU_FLAT_MAP_GROUP_SIZE + kigu__flat_map_mask_index(match);
+					new_table->control[slot] = kigu__flat_map_tag(hashed);
+					memcpy(&new_table->keys[slot],   &old_table->keys[i],   sizeof(Key));
+					memcpy(&new_table->values[slot], &old_table->values[i], sizeof(Value));
+					break;
+				}
+			}
+		}
+	}
+	new_table->retired = old_table;
+	s->used = s->count;
+	kigu__store_release(&s->current, new_table);
+	
+	if(old_table){
+		//readers that see the bumped epoch also see the new table
+		kigu__fence_release();
+		old_table->retire_epoch = kigu__atomic_add(&epoch, 2);
+		kigu__free_retired(s);
+	}
+}
+
+//NOTE must be called with the shard locked after publishing a new table
+template<typename Key, typename Value, typename HashStruct, typename EqualStruct> inline void concurrent_map<Key,Value,HashStruct,EqualStruct>::
+kigu__free_retired(shard* s){
+	//pairs with the fence in kigu__read_begin(): either a reader's mark is seen here or that reader sees the new table
+	kigu__fence_full();
+	if(kigu__load_acquire(&reading->overflow)) return;
+	
+	//find the oldest epoch a reader is still in (epochs wrap, so they're compared by their signed difference)
+	b32 any_reader = false;
+	u32 oldest = 0;
+	forI(KIGU_CONCURRENT_MAP_READER_SLOTS){
+		u32 marked = kigu__load_acquire(&reading->slots[i].epoch);
+		if(marked && (!any_reader || (s32)(marked - oldest) < 0)){
+			oldest = marked;
+			any_reader = true;
+		}
+	}
+	
+	//a table replaced in epoch E can only be seen by readers that started in E or before
+	upt alignment = Max((upt)KIGU_FLAT_MAP_GROUP_SIZE, Max((upt)alignof(Key), (upt)alignof(Value)));
+	table** link = &s->current->retired;
+	while(*link){
+		table* t = *link;
+		if(!any_reader || (s32)(oldest - t->retire_epoch) > 0){
+			*link = t->retired;
+			allocator_release_aligned(allocator, t, alignment);
+		}else{
+			link = &t->retired;
+		}
+	}
+}
+
+template<typename Key, typename Value, typename HashStruct, typename EqualStruct> inline void concurrent_map<Key,Value,HashStruct,EqualStruct>::
+kigu__write_begin(shard* s){
+	kigu__spin_lock(&s->lock);
+	kigu__store_relaxed(&s->sequence, s->sequence + 1);
+	kigu__fence_release();
+}
+
+template<typename Key, typename Value, typename HashStruct, typename EqualStruct> inline void concurrent_map<Key,Value,HashStruct,EqualStruct>::
+kigu__write_end(shard* s){
+	kigu__store_release(&s->sequence, s->sequence + 1);
+	kigu__spin_unlock(&s->lock);
+}
+
+template<typename Key, typename Value, typename HashStruct, typename EqualStruct> inline u32 concurrent_map<Key,Value,HashStruct,EqualStruct>::
+kigu__read_begin()const{
+	if(kigu__concurrent_map_reader_index == (u32)-1){
+		kigu__concurrent_map_reader_index = kigu__atomic_add(&kigu__concurrent_map_reader_count, 1);
+	}
+	u32 slot = kigu__concurrent_map_reader_index & (KIGU_CONCURRENT_MAP_READER_SLOTS-1);
+	if(kigu__atomic_cas(&reading->slots[slot].epoch, 0, kigu__load_acquire(&epoch))){
+		kigu__fence_full(); //pairs with the fence in kigu__free_retired()
+		return slot;
+	}
+	kigu__atomic_add(&reading->overflow, 1);
+	kigu__fence_full();
+	return -1;
+}
+
+template<typename Key, typename Value, typename HashStruct, typename EqualStruct> inline void concurrent_map<Key,Value,HashStruct,EqualStruct>::
+kigu__read_end(u32 slot)const{
+	if(slot != (u32)-1){
+		kigu__store_release(&reading->slots[slot].epoch, 0);
+	}else{
+		kigu__fence_release();
+		kigu__atomic_add(&reading->overflow, -1);
+	}
+}
+
+//////////////////////
+//// @contructors ////
+//////////////////////
+template<typename Key, typename Value, typename HashStruct, typename EqualStruct> inline concurrent_map<Key,Value,HashStruct,EqualStruct>::
+concurrent_map(u32 _shard_count, Allocator* a){DPZoneScoped;
+	Assert(_shard_count > 0 && _shard_count <= (1u << 16));
+	allocator   = a;
+	shard_bits  = (IsPow2(_shard_count)) ? FloorLog2(_shard_count) : FloorLog2(_shard_count) + 1;
+	shard_count = 1 << shard_bits;
+	shards = (shard*)allocator_reserve_aligned(allocator, shard_count*sizeof(shard), alignof(shard));
+	memset(shards, 0, shard_count*sizeof(shard));
+	reading = (readers*)allocator_reserve_aligned(allocator, sizeof(readers), alignof(readers));
+	memset(reading, 0, sizeof(readers));
+	epoch = 1;
+}
+
+template<typename Key, typename Value, typename HashStruct, typename EqualStruct> inline concurrent_map<Key,Value,HashStruct,EqualStruct>::
+~concurrent_map(){
+	reclaim();
+	upt alignment = Max((upt)KIGU_FLAT_MAP_GROUP_SIZE, Max((upt)alignof(Key), (upt)alignof(Value)));
+	forI(shard_count){
+		if(shards[i].current) allocator_release_aligned(allocator, shards[i].current, alignment);
+	}
+	allocator_release_aligned(allocator, shards, alignof(shard));
+	allocator_release_aligned(allocator, reading, alignof(readers));
+	shards = 0;
+	reading = 0;
+	shard_count = 0;
+}
+
+////////////////////
+//// @functions ////
+////////////////////
+template<typename Key, typename Value, typename HashStruct, typename EqualStruct> inline bool concurrent_map<Key,Value,HashStruct,EqualStruct>::
+add(const Key& key, const Value& value){DPZoneScoped;
+	u64 hashed = kigu__flat_map_mix(HashStruct{}(key));
+	shard* s = kigu__shard_of(hashed);
+	kigu__spin_lock(&s->lock);
+	if(kigu__find(s->current, key, hashed) != -1){
+		kigu__spin_unlock(&s->lock);
+		return false;
+	}
+	
+	kigu__store_relaxed(&s->sequence, s->sequence + 1);
+	kigu__fence_release();
+	if(!s->current){
+		kigu__rehash(s, KIGU_FLAT_MAP_GROUP_SIZE);
+	}else if(s->used + 1 > kigu__flat_map_max_load(s->current->capacity)){
+		//grow if the table is mostly keys, otherwise rehash at the same size to clear out deleted slots
+		u32 capacity = s->current->capacity;
+		kigu__rehash(s, ((u64)s->count*32 > (u64)capacity*25) ? capacity*2 : capacity);
+	}
+	
+	//keys only go in empty slots, deleted slots keep their key until the table is replaced
+	table* t  = s->current;
+	u32 mask  = (t->capacity / KIGU_FLAT_MAP_GROUP_SIZE) - 1;
+	u32 group = (u32)(hashed >> 32) & mask;
+	for(u32 step = 1;; group = (group + step) & mask, step += 1){
+		u64 match = kigu__flat_map_match_empty(t->control + group*KIGU_FLAT_MAP_GROUP_SIZE);
+		if(match){
+			u32 slot = group*KIGU_FLAT_MAP_GROUP_SIZE + kigu__flat_map_mask_index(match);
+			memcpy(&t->keys[slot],   &key,   sizeof(Key));
+			memcpy(&t->values[slot], &value, sizeof(Value));
+			kigu__store_release(&t->control[slot], kigu__flat_map_tag(hashed));
+			break;
+		}
+	}
+	s->count += 1;
+	s->used  += 1;
+	kigu__write_end(s);
+	return true;
+}
+
+template<typename Key, typename Value, typename HashStruct, typename EqualStruct> inline void concurrent_map<Key,Value,HashStruct,EqualStruct>::
+set(const Key& key, const Value& value){DPZoneScoped;
+	u64 hashed = kigu__flat_map_mix(HashStruct{}(key));
+	shard* s = kigu__shard_of(hashed);
+	for(;;){
+		kigu__spin_lock(&s->lock);
+		u32 slot = kigu__find(s->current, key, hashed);
+		if(slot != -1){
+			kigu__store_relaxed(&s->sequence, s->sequence + 1);
+			kigu__fence_release();
+			memcpy(&s->current->values[slot], &value, sizeof(Value));
+			kigu__write_end(s);
+			return;
+		}
+		kigu__spin_unlock(&s->lock);
+		if(add(key, value)) return; //otherwise another thread added it in between
+	}
+}
+
+template<typename Key, typename Value, typename HashStruct, typename EqualStruct> inline bool concurrent_map<Key,Value,HashStruct,EqualStruct>::
+remove(const Key& key){DPZoneScoped;
+	u64 hashed = kigu__flat_map_mix(HashStruct{}(key));
+	shard* s = kigu__shard_of(hashed);
+	kigu__spin_lock(&s->lock);
+	u32 slot = kigu__find(s->current, key, hashed);
+	if(slot == -1){
+		kigu__spin_unlock(&s->lock);
+		return false;
+	}
+	
+	//the slot always becomes deleted (never empty) so its key isn't overwritten while readers might compare against it
+	kigu__store_relaxed(&s->sequence, s->sequence + 1);
+	kigu__fence_release();
+	kigu__store_relaxed(&s->current->control[slot], (u8)KIGU_FLAT_MAP_DELETED);
+	s->count -= 1;
+	kigu__write_end(s);
+	return true;
+}
+
+template<typename Key, typename Value, typename HashStruct, typename EqualStruct> inline bool concurrent_map<Key,Value,HashStruct,EqualStruct>::
+get(const Key& key, Value* out)const{DPZoneScoped;
+	u64 hashed = kigu__flat_map_mix(HashStruct{}(key));
+	shard* s = kigu__shard_of(hashed);
+	alignas(Value) u8 copy[sizeof(Value)] = {};
+	u32 reader = kigu__read_begin();
+	for(;;){
+		u32 sequence = kigu__load_acquire(&s->sequence);
+		if(sequence & 1) continue; //a writer is in the middle of changing the shard
+		
+		table* t = kigu__load_acquire(&s->current);
+		u32 slot = kigu__find(t, key, hashed);
+		if(slot != -1) memcpy(copy, &t->values[slot], sizeof(Value));
+		
+		kigu__fence_acquire();
+		if(kigu__load_relaxed(&s->sequence) != sequence) continue;
+		kigu__read_end(reader);
+		if(slot == -1) return false;
+		memcpy(out, copy, sizeof(Value));
+		return true;
+	}
+}
+
+template<typename Key, typename Value, typename HashStruct, typename EqualStruct> inline bool concurrent_map<Key,Value,HashStruct,EqualStruct>::
+has(const Key& key)const{DPZoneScoped;
+	u64 hashed = kigu__flat_map_mix(HashStruct{}(key));
+	shard* s = kigu__shard_of(hashed);
+	u32 reader = kigu__read_begin();
+	for(;;){
+		u32 sequence = kigu__load_acquire(&s->sequence);
+		if(sequence & 1) continue;
+		
+		u32 slot = kigu__find(kigu__load_acquire(&s->current), key, hashed);
+		
+		kigu__fence_acquire();
+		if(kigu__load_relaxed(&s->sequence) == sequence){
+			kigu__read_end(reader);
+			return slot != -1;
+		}
+	}
+}
+
+template<typename Key, typename Value, typename HashStruct, typename EqualStruct> inline u64 concurrent_map<Key,Value,HashStruct,EqualStruct>::
+count()const{DPZoneScoped;
+	u64 result = 0;
+	forI(shard_count) result += kigu__load_relaxed(&shards[i].count);
+	return result;
+}
+
+template<typename Key, typename Value, typename HashStruct, typename EqualStruct> inline void concurrent_map<Key,Value,HashStruct,EqualStruct>::
+reserve(u64 new_count){DPZoneScoped;
+	u64 per_shard = (new_count + shard_count - 1) / shard_count;
+	per_shard += per_shard / 8; //keys don't spread perfectly evenly
+	forI(shard_count){
+		shard* s = &shards[i];
+		kigu__write_begin(s);
+		u32 capacity = (s->current) ? s->current->capacity : KIGU_FLAT_MAP_GROUP_SIZE;
+		while(per_shard > kigu__flat_map_max_load(capacity)) capacity *= 2;
+		if(!s->current || capacity > s->current->capacity) kigu__rehash(s, capacity);
+		kigu__write_end(s);
+	}
+}
+
+template<typename Key, typename Value, typename HashStruct, typename EqualStruct> inline void concurrent_map<Key,Value,HashStruct,EqualStruct>::
+reclaim(){DPZoneScoped;
+	upt alignment = Max((upt)KIGU_FLAT_MAP_GROUP_SIZE, Max((upt)alignof(Key), (upt)alignof(Value)));
+	forI(shard_count){
+		if(!shards[i].current) continue;
+		table* t = shards[i].current->retired;
+		shards[i].current->retired = 0;
+		while(t){
+			table* next = t->retired;
+			allocator_release_aligned(allocator, t, alignment);
+			t = next;
+		}
+	}
+}
+
+template<typename Key, typename Value, typename HashStruct, typename EqualStruct> template<typename Fn> inline void concurrent_map<Key,Value,HashStruct,EqualStruct>::
+for_each_shard(u32 shard_index, Fn fn){DPZoneScoped;
+	shard* s = &shards[shard_index];
+	kigu__write_begin(s); //`fn` can change values, so readers retry until it's done
+	table* t = s->current;
+	if(t){
+		forI(t->capacity){
+			if(flat_map_slot_full(t->control[i])) fn((const Key&)t->keys[i], t->values[i]);
+		}
+	}
+	kigu__write_end(s);
+}
+
+template<typename Key, typename Value, typename HashStruct, typename EqualStruct> template<typename Fn> inline void concurrent_map<Key,Value,HashStruct,EqualStruct>::
+for_each(Fn fn){DPZoneScoped;
+	forI(shard_count) for_each_shard(i, fn);
+}
+
+template<typename Key, typename Value, typename HashStruct, typename EqualStruct> template<typename Fn> inline void concurrent_map<Key,Value,HashStruct,EqualStruct>::
+for_each_parallel(Fn fn, u32 thread_count){DPZoneScoped;
+	if(!thread_count) thread_count = Max(std::thread::hardware_concurrency(), 1u);
+	thread_count = Min(thread_count, shard_count);
+	volatile u32 next_shard = 0;
+	auto worker = [&](){
+		for(u32 i = kigu__atomic_add(&next_shard, 1); i < shard_count; i = kigu__atomic_add(&next_shard, 1)){
+			for_each_shard(i, fn);
+		}
+	};
+	std::thread* threads = (std::thread*)StackAlloc(thread_count*sizeof(std::thread));
+	for(u32 i = 1; i < thread_count; i += 1) new(&threads[i]) std::thread(worker);
+	worker();
+	for(u32 i = 1; i < thread_count; i += 1){
+		threads[i].join();
+		threads[i].~thread();
+	}
+}
+
+
+//-////////////////////////////////////////////////////////////////////////////////////////////////
+//// @concurrent_map_tests
+#ifdef KIGU_UNIT_TESTS
+
+
+global void kigu__concurrent_map_unit_tests()
+{
+	{//// single threaded ////
+		concurrent_map<u64,u64> m(4);
+		AssertAlways(m.shard_count == 4 && !m.has(0));
+		forI(10000) AssertAlways(m.add((u64)i, (u64)i * 2));
+		AssertAlways(!m.add(5, 0));
+		AssertAlways(m.count() == 10000);
+		u64 value = 0;
+		forI(10000){
+			AssertAlways(m.get((u64)i, &value) && value == i * 2);
+			AssertAlways(!m.has((u64)i + 10000));
+		}
+		m.set(5, 1);
+		m.set(20000, 3);
+		AssertAlways(m.get(5, &value) && value == 1);
+		AssertAlways(m.get(20000, &value) && value == 3);
+		forI(5000) AssertAlways(m.remove((u64)i * 2));
+		AssertAlways(!m.remove(0));
+		AssertAlways(m.count() == 5001);
+		
+		u64 visited = 0;
+		m.for_each([&](const u64& key, u64& value){ visited += 1; });
+		AssertAlways(visited == 5001);
+		m.reclaim();
+		forI(10000) AssertAlways(m.has((u64)i) == (i % 2 == 1));
+	}
+	
+	{//// readers and writers on several threads ////
+		concurrent_map<u64,u64> m;
+		const u32 thread_count = 4, key_count = 20000;
+		volatile u32 failures = 0;
+		std::thread threads[thread_count];
+		forX(t, thread_count){
+			threads[t] = std::thread([&m, &failures, t](){
+				//each thread adds and removes its own keys while reading everyone's
+				forI(key_count){
+					u64 key = (u64)i * thread_count + t;
+					m.add(key, key * 3);
+					u64 value = 0;
+					if(!m.get(key, &value) || value != key * 3) kigu__atomic_add(&failures, 1);
+					u64 other = (u64)(i / 2) * thread_count + ((t + 1) % thread_count);
+					if(m.get(other, &value) && value != other * 3) kigu__atomic_add(&failures, 1);
+					if(i % 4 == 0) m.remove(key);
+				}
+			});
+		}
+		forX(t, thread_count) threads[t].join();
+		AssertAlways(failures == 0);
+		AssertAlways(m.count() == (u64)thread_count * key_count * 3 / 4);
+		
+		volatile u32 visited = 0;
+		m.for_each_parallel([&](const u64& key, u64& value){
+			AssertAlways(value == key * 3);
+			kigu__atomic_add(&visited, 1);
+		});
+		AssertAlways(visited == m.count());
+	}
+	
+	{//// churn frees replaced tables ////
+		//1000 keys in one shard that keep being removed and added rehash the shard at the same size over and over
+		concurrent_map<u64,u64> m(1);
+		forI(1000) m.add((u64)i, (u64)i);
+		forI(200000){
+			m.remove((u64)i);
+			m.add((u64)i + 1000, (u64)i);
+		}
+		u32 retired = 0;
+		for(auto t = m.shards[0].current->retired; t; t = t->retired) retired += 1;
+		AssertAlways(retired == 0 && m.shards[0].current->capacity <= 2048);
+		AssertAlways(m.count() == 1000 && m.has(200999) && !m.has(199999));
+		
+		//readers keep the tables they might be looking at alive while a writer churns
+		const u32 reader_count = 3;
+		volatile u32 failures = 0, done = 0;
+		forI(500) m.add((u64)i + 1000000, (u64)i);
+		std::thread readers[reader_count];
+		forX(r, reader_count){
+			readers[r] = std::thread([&m, &failures, &done, r](){
+				u64 value = 0;
+				for(u64 i = r; !kigu__load_acquire(&done); i = (i + 7) % 500){
+					if(!m.get(i + 1000000, &value) || value != i) kigu__atomic_add(&failures, 1);
+				}
+			});
+		}
+		forI(200000){
+			m.remove((u64)i + 200000);
+			m.add((u64)i + 2000000, (u64)i);
+			m.remove((u64)i + 2000000);
+			m.add((u64)i + 200000 + 1000, (u64)i);
+		}
+		kigu__store_release(&done, 1);
+		forX(r, reader_count) readers[r].join();
+		AssertAlways(failures == 0);
+		
+		//once nobody is reading, the next rehash frees every replaced table
+		u32 capacity = m.shards[0].current->capacity;
+		m.reserve(capacity);
+		retired = 0;
+		for(auto t = m.shards[0].current->retired; t; t = t->retired) retired += 1;
+		AssertAlways(retired == 0 && m.count() == 1500);
+	}
+	
+	{//// visits change values ////
+		//readers never see a value that for_each() is halfway through writing
+		struct both{ u64 a, b; };
+		concurrent_map<u64,both> m(2);
+		forI(64) m.add((u64)i, both{0, 0});
+		volatile u32 failures = 0, done = 0;
+		std::thread reader([&m, &failures, &done](){
+			both value;
+			for(u64 i = 0; !kigu__load_acquire(&done); i = (i + 1) % 64){
+				if(!m.get(i, &value) || value.a != value.b) kigu__atomic_add(&failures, 1);
+			}
+		});
+		for(u64 pass = 1; pass <= 2000; pass += 1){
+			m.for_each([pass](const u64& key, both& value){
+				*(volatile u64*)&value.a = pass;
+				for(volatile u32 wait = 0; wait < 64; wait += 1){} //gives the reader time to see half of the value
+				*(volatile u64*)&value.b = pass;
+			});
+		}
+		kigu__store_release(&done, 1);
+		reader.join();
+		AssertAlways(failures == 0);
+	}
+}
+
+
+#endif //#ifdef KIGU_UNIT_TESTS
+#endif //#ifndef KIGU_CONCURRENT_MAP_H
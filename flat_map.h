@@ -0,0 +1,509 @@
+/* kigu flat_map module
+WHAT:
+This module provides `flat_map`, a hash table in the style of Swiss tables. Next to its key and value arrays it keeps one
+control byte per slot which is either empty, deleted, or the low 7 bits of the hash of the key in that slot. Slots are grouped
+into runs of 16 and a lookup compares the tag against a whole group's control bytes at once (SSE2 on x86, NEON on ARM64, a
+scalar loop otherwise), so it only compares keys whose tag matched and stops at the first group that has an empty slot.
+
+WHY:
+`map` keeps its hashes apart from its values, but still has to load a slot (and usually the key it points at) for every probe.
+With 7-bit tags 127 out of 128 non-matching keys are ruled out without touching the keys, and since a group is only full when
+the table is nearly full, most lookups of missing keys finish after a single 16 byte load.
+
+NOTES:
+- Keys and values are stored in the table itself, so pointers returned by add() and at() are invalidated by any add() that
+  grows the table (and by remove() of that key).
+- There are no indexes like `map` has; iterate the table with a range for (which yields values) and use key() on the iterator
+  (or iterate slots 0 to `capacity` checking flat_map_slot_full()) for the keys.
+- Like arrayT, keys and values are assigned into zeroed memory (zeroed by the map if the allocator doesn't have
+  AllocatorFlags_ZeroReserve) and moved around with memcpy when the table grows.
+- The table grows once 7/8ths of its slots are used. Removing a key leaves a deleted marker only if its group has no empty
+  slots; deleted markers are cleared when the table rehashes.
+- Capacity is always zero or a power of two that is at least KIGU_FLAT_MAP_GROUP_SIZE (16).
+- flat_map is not copyable.
+
+INDEX:
+@flat_map_group
+  KIGU_FLAT_MAP_SSE2, KIGU_FLAT_MAP_NEON
+  flat_map_slot_full(u8 control) -> b32
+  kigu__flat_map_match(const u8* group, u8 tag) -> u64
+  kigu__flat_map_match_empty(const u8* group) -> u64
+  kigu__flat_map_match_free(const u8* group) -> u64
+  kigu__flat_map_mask_index(u64 mask) -> u32
+@flat_map
+  flat_map<Key,Value,HashStruct,EqualStruct>
+    add(const Key& key, const Value& value) -> Value*
+    has(const Key& key) -> bool
+    at(const Key& key) -> Value*
+    operator[](const Key& key) -> Value&
+    remove(const Key& key) -> void
+    reserve(u32 new_count) -> void
+    clear() -> void
+@flat_map_tests
+*/
+#pragma once
+#ifndef KIGU_FLAT_MAP_H
+#define KIGU_FLAT_MAP_H
+
+
+#include "common.h"
+#include "hash.h"
+#include "profiling.h"
+
+#if ARCH_X64 || (ARCH_X86 && (defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)))
+#  define KIGU_FLAT_MAP_SSE2 1
+#  define KIGU_FLAT_MAP_NEON 0
+#  include <emmintrin.h>
+#elif ARCH_ARM64
+#  define KIGU_FLAT_MAP_SSE2 0
+#  define KIGU_FLAT_MAP_NEON 1
+#  include <arm_neon.h>
+#else
+#  define KIGU_FLAT_MAP_SSE2 0
+#  define KIGU_FLAT_MAP_NEON 0
+#endif
+
+
+//-////////////////////////////////////////////////////////////////////////////////////////////////
+//// @flat_map_group
+
+
+#define KIGU_FLAT_MAP_GROUP_SIZE 16
+#define KIGU_FLAT_MAP_EMPTY   0x80
+#define KIGU_FLAT_MAP_DELETED 0xFE
+
+//number of bits each slot takes up in the masks returned by the group matches
+#if KIGU_FLAT_MAP_NEON
+#  define KIGU_FLAT_MAP_MASK_SHIFT 2
+#else
+#  define KIGU_FLAT_MAP_MASK_SHIFT 0
+#endif
+
+
+//Returns true if the control byte `control` belongs to a slot holding a key
+FORCE_INLINE b32
+flat_map_slot_full(u8 control){
+	return (control & 0x80) == 0;
+}
+
+#if KIGU_FLAT_MAP_NEON
+//Returns a mask with one bit per slot (at bit 4*slot+3) from a comparison result of 0x00 or 0xFF per slot
+FORCE_INLINE u64
+kigu__flat_map_neon_mask(uint8x16_t compare){
+	return vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(compare), 4)), 0) & 0x8888888888888888ull;
+}
+#endif //#if KIGU_FLAT_MAP_NEON
+
+//Returns a mask of the slots in `group` whose control byte is `tag`
+FORCE_INLINE u64
+kigu__flat_map_match(const u8* group, u8 tag){
+#if KIGU_FLAT_MAP_SSE2
+	__m128i ctrl = _mm_load_si128((const __m128i*)group);
+	return (u64)(u32)_mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8((char)tag)));
+#elif KIGU_FLAT_MAP_NEON
+	return kigu__flat_map_neon_mask(vceqq_u8(vld1q_u8(group), vdupq_n_u8(tag)));
+#else
+	u64 mask = 0;
+	forI(KIGU_FLAT_MAP_GROUP_SIZE) if(group[i] == tag) mask |= (u64)1 << i;
+	return mask;
+#endif
+}
+
+//Returns a mask of the empty slots in `group`
+FORCE_INLINE u64
+kigu__flat_map_match_empty(const u8* group){
+	return kigu__flat_map_match(group, KIGU_FLAT_MAP_EMPTY);
+}
+
+//Returns a mask of the empty or deleted slots in `group`
+FORCE_INLINE u64
+kigu__flat_map_match_free(const u8* group){
+#if KIGU_FLAT_MAP_SSE2
+	return (u64)(u32)_mm_movemask_epi8(_mm_load_si128((const __m128i*)group));
+#elif KIGU_FLAT_MAP_NEON
+	return kigu__flat_map_neon_mask(vcltzq_s8(vreinterpretq_s8_u8(vld1q_u8(group))));
+#else
+	u64 mask = 0;
+	forI(KIGU_FLAT_MAP_GROUP_SIZE) if(group[i] & 0x80) mask |= (u64)1 << i;
+	return mask;
+#endif
+}
+
+//Returns the index in its group of the first slot set in `mask` (which must be non-zero)
+FORCE_INLINE u32
+kigu__flat_map_mask_index(u64 mask){
+	return CountTrailingZeros64(mask) >> KIGU_FLAT_MAP_MASK_SHIFT;
+}
+
+
+//-////////////////////////////////////////////////////////////////////////////////////////////////
+//// @flat_map
+
+
+template<typename Key, typename Value, typename HashStruct = hash<Key>, typename EqualStruct = hash_equal<Key>>
+struct flat_map{
+	u8*    control; //`capacity` control bytes, aligned to the group size
+	Key*   keys;
+	Value* values;
+	u32 count;
+	u32 capacity;
+	u32 growth_left; //slots that can be filled before the table needs to rehash
+	Allocator* allocator;
+	
+	flat_map(Allocator* a = stl_allocator);
+	~flat_map();
+	flat_map(const flat_map&) = delete;
+	flat_map& operator=(const flat_map&) = delete;
+	
+	Value& operator[](const Key& key);
+	
+	void   clear();
+	void   reserve(u32 new_count); //makes room for `new_count` keys without growing
+	Value* add(const Key& key); //returns the value of the added or existing key
+	Value* add(const Key& key, const Value& value);
+	void   remove(const Key& key);
+	bool   has(const Key& key) const;
+	Value* at(const Key& key);
+	
+	u32  kigu__find(const Key& key, u64 hashed) const; //returns the slot holding `key`, or -1
+	u32  kigu__find_free(u64 hashed) const; //returns the first empty or deleted slot in the probe sequence of `hashed`
+	void kigu__rehash(u32 new_capacity);
+	
+	struct iterator{
+		flat_map* table;
+		u32 slot;
+		
+		Value& operator*(){ return table->values[slot]; }
+		Key&   key()      { return table->keys[slot]; }
+		bool operator!=(const iterator& rhs){ return slot != rhs.slot; }
+		iterator& operator++(){
+			slot += 1;
+			while(slot < table->capacity && !flat_map_slot_full(table->control[slot])) slot += 1;
+			return *this;
+		}
+	};
+	iterator begin(){DPZoneScoped;
+		iterator it{this, 0};
+		if(capacity && !flat_map_slot_full(control[0])) ++it;
+		return it;
+	}
+	iterator end(){DPZoneScoped; return iterator{this, capacity}; }
+};
+
+//returns a 64 bit hash that spreads the 32 bit hash from a HashStruct over all of its bits
+//  the group is picked from the top 32 bits and the 7 bit tag from bits 25 to 31
+FORCE_INLINE u64
+kigu__flat_map_mix(u32 hashed){
+	return (u64)hashed * 0x9E3779B97F4A7C15ull;
+}
+
+FORCE_INLINE u8
+kigu__flat_map_tag(u64 mixed){
+	return (u8)((mixed >> 25) & 0x7F);
+}
+
+//returns the number of slots the table can fill before rehashing
+FORCE_INLINE u32
+kigu__flat_map_max_load(u32 capacity){
+	return capacity - capacity/8;
+}
+
+/////////////////////
+//// @internals ////
+/////////////////////
+template<typename Key, typename Value, typename HashStruct, typename EqualStruct> inline u32 flat_map<Key,Value,HashStruct,EqualStruct>::
+kigu__find(const Key& key, u64 hashed)const{
+	if(!capacity) return -1;
+	u8  tag   = kigu__flat_map_tag(hashed);
+	u32 mask  = (capacity / KIGU_FLAT_MAP_GROUP_SIZE) - 1;
+	u32 group = (u32)(hashed >> 32) & mask;
+	for(u32 step = 1;; group = (group + step) & mask, step += 1){ //triangular probing visits every group once
+		const u8* ctrl = control + group*KIGU_FLAT_MAP_GROUP_SIZE;
+		for(u64 match = kigu__flat_map_match(ctrl, tag); match; match &= match - 1){
+			u32 slot = group*KIGU_FLAT_MAP_GROUP_SIZE + kigu__flat_map_mask_index(match);
+			if(EqualStruct{}(keys[slot], key)) return slot;
+		}
+		if(kigu__flat_map_match_empty(ctrl)) return -1;
+	}
+}
+
+template<typename Key, typename Value, typename HashStruct, typename EqualStruct> inline u32 flat_map<Key,Value,HashStruct,EqualStruct>::
+kigu__find_free(u64 hashed)const{
+	u32 mask  = (capacity / KIGU_FLAT_MAP_GROUP_SIZE) - 1;
+	u32 group = (u32)(hashed >> 32) & mask;
+	for(u32 step = 1;; group = (group + step) & mask, step += 1){
+		u64 match = kigu__flat_map_match_free(control + group*KIGU_FLAT_MAP_GROUP_SIZE);
+		if(match) return group*KIGU_FLAT_MAP_GROUP_SIZE + kigu__flat_map_mask_index(match);
+	}
+}
+
+template<typename Key, typename Value, typename HashStruct, typename EqualStruct> inline void flat_map<Key,Value,HashStruct,EqualStruct>::
+kigu__rehash(u32 new_capacity){DPZoneScoped;
+	Assert(IsPow2(new_capacity) && new_capacity >= KIGU_FLAT_MAP_GROUP_SIZE && count <= kigu__flat_map_max_load(new_capacity));
+	u8*    old_control  = control;
+	Key*   old_keys     = keys;
+	Value* old_values   = values;
+	u32    old_capacity = capacity;
+	
+	//control bytes, keys, and values share one allocation
+	upt keys_offset   = RoundUpTo((upt)new_capacity, alignof(Key));
+	upt values_offset = RoundUpTo(keys_offset + (upt)new_capacity*sizeof(Key), alignof(Value));
+	upt alignment     = Max((upt)KIGU_FLAT_MAP_GROUP_SIZE, Max((upt)alignof(Key), (upt)alignof(Value)));
+	u8* memory = (u8*)allocator_reserve_aligned(allocator, values_offset + (upt)new_capacity*sizeof(Value), alignment);
+	control  = memory;
+	keys     = (Key*)(memory + keys_offset);
+	values   = (Value*)(memory + values_offset);
+	capacity = new_capacity;
+	growth_left = kigu__flat_map_max_load(new_capacity) - count;
+	memset(control, KIGU_FLAT_MAP_EMPTY, new_capacity);
+	if(!HasFlag(allocator->flags, AllocatorFlags_ZeroReserve)){
+		memset(keys, 0, (values_offset - keys_offset) + (upt)new_capacity*sizeof(Value)); //NOTE keys and values are assigned into zeroed memory
+	}
+	
+	forI(old_capacity){
+		if(!flat_map_slot_full(old_control[i])) continue;
+		u64 hashed = kigu__flat_map_mix(HashStruct{}(old_keys[i]));
+		u32 slot = kigu__find_free(hashed);
+		control[slot] = kigu__flat_map_tag(hashed);
+		memcpy(&keys[slot],   &old_keys[i],   sizeof(Key));
+		memcpy(&values[slot], &old_values[i], sizeof(Value));
+	}
+	if(old_control) allocator_release_aligned(allocator, old_control, alignment);
+}
+
+//////////////////////
+//// @contructors ////
+//////////////////////
+template<typename Key, typename Value, typename HashStruct, typename EqualStruct> inline flat_map<Key,Value,HashStruct,EqualStruct>::
+flat_map(Allocator* a){DPZoneScoped;
+	control     = 0;
+	keys        = 0;
+	values      = 0;
+	count       = 0;
+	capacity    = 0;
+	growth_left = 0;
+	allocator   = a;
+}
+
+template<typename Key, typename Value, typename HashStruct, typename EqualStruct> inline flat_map<Key,Value,HashStruct,EqualStruct>::
+~flat_map(){
+	clear();
+	upt alignment = Max((upt)KIGU_FLAT_MAP_GROUP_SIZE, Max((upt)alignof(Key), (upt)alignof(Value)));
+	if(control) allocator_release_aligned(allocator, control, alignment);
+	control     = 0;
+	keys        = 0;
+	values      = 0;
+	capacity    = 0;
+	growth_left = 0;
+}
+
+////////////////////
+//// @operators ////
+////////////////////
+template<typename Key, typename Value, typename HashStruct, typename EqualStruct> inline Value& flat_map<Key,Value,HashStruct,EqualStruct>::
+operator[](const Key& key){DPZoneScoped;
+	u32 slot = kigu__find(key, kigu__flat_map_mix(HashStruct{}(key)));
+	if(slot != -1){ return values[slot]; }
+	throw "nokey";
+}
+
+////////////////////
+//// @functions ////
+////////////////////
+template<typename Key, typename Value, typename HashStruct, typename EqualStruct> inline void flat_map<Key,Value,HashStruct,EqualStruct>::
+clear(){DPZoneScoped;
+	forI(capacity){
+		if(flat_map_slot_full(control[i])){
+			keys[i].~Key();
+			values[i].~Value();
+			memset(&keys[i],   0, sizeof(Key));
+			memset(&values[i], 0, sizeof(Value));
+		}
+	}
+	if(capacity) memset(control, KIGU_FLAT_MAP_EMPTY, capacity);
+	count = 0;
+	growth_left = kigu__flat_map_max_load(capacity);
+}
+
+template<typename Key, typename Value, typename HashStruct, typename EqualStruct> inline void flat_map<Key,Value,HashStruct,EqualStruct>::
+reserve(u32 new_count){DPZoneScoped;
+	u32 new_capacity = (capacity) ? capacity : KIGU_FLAT_MAP_GROUP_SIZE;
+	while(new_count > kigu__flat_map_max_load(new_capacity)) new_capacity *= 2;
+	if(new_capacity > capacity) kigu__rehash(new_capacity);
+}
+
+template<typename Key, typename Value, typename HashStruct, typename EqualStruct> inline Value* flat_map<Key,Value,HashStruct,EqualStruct>::
+add(const Key& key){DPZoneScoped;
+	return add(key, Value());
+}
+
+template<typename Key, typename Value, typename HashStruct, typename EqualStruct> inline Value* flat_map<Key,Value,HashStruct,EqualStruct>::
+add(const Key& key, const Value& value){DPZoneScoped;
+	u64 hashed = kigu__flat_map_mix(HashStruct{}(key));
+	u32 slot = kigu__find(key, hashed);
+	if(slot != -1){ return &values[slot]; }
+	
+	slot = (capacity) ? kigu__find_free(hashed) : -1;
+	if(slot == -1 || (growth_left == 0 && control[slot] == KIGU_FLAT_MAP_EMPTY)){
+		//grow if the table is mostly keys, otherwise rehash at the same size to clear out deleted markers
+		if(!capacity){
+			kigu__rehash(KIGU_FLAT_MAP_GROUP_SIZE);
+		}else if((u64)count*32 > (u64)capacity*25){
+			kigu__rehash(capacity*2);
+		}else{
+			kigu__rehash(capacity);
+		}
+		slot = kigu__find_free(hashed);
+	}
+	
+	if(control[slot] == KIGU_FLAT_MAP_EMPTY) growth_left -= 1;
+	control[slot] = kigu__flat_map_tag(hashed);
+	keys[slot]    = key;
+	values[slot]  = value;
+	count += 1;
+	return &values[slot];
+}
+
+template<typename Key, typename Value, typename HashStruct, typename EqualStruct> inline void flat_map<Key,Value,HashStruct,EqualStruct>::
+remove(const Key& key){DPZoneScoped;
+	u32 slot = kigu__find(key, kigu__flat_map_mix(HashStruct{}(key)));
+	if(slot == -1) return;
+	
+	//a group with an empty slot has never been full, so no probe sequence continues past it and the slot can become empty
+	//  otherwise it must stay marked so lookups keep probing past this group
+	if(kigu__flat_map_match_empty(control + (slot & ~(KIGU_FLAT_MAP_GROUP_SIZE-1)))){
+		control[slot] = KIGU_FLAT_MAP_EMPTY;
+		growth_left += 1;
+	}else{
+		control[slot] = KIGU_FLAT_MAP_DELETED;
+	}
+	keys[slot].~Key();
+	values[slot].~Value();
+	memset(&keys[slot],   0, sizeof(Key));
+	memset(&values[slot], 0, sizeof(Value));
+	count -= 1;
+}
+
+template<typename Key, typename Value, typename HashStruct, typename EqualStruct> inline bool flat_map<Key,Value,HashStruct,EqualStruct>::
+has(const Key& key)const{DPZoneScoped;
+	return kigu__find(key, kigu__flat_map_mix(HashStruct{}(key))) != -1;
+}
+
+template<typename Key, typename Value, typename HashStruct, typename EqualStruct> inline Value* flat_map<Key,Value,HashStruct,EqualStruct>::
+at(const Key& key){DPZoneScoped;
+	u32 slot = kigu__find(key, kigu__flat_map_mix(HashStruct{}(key)));
+	if(slot != -1){ return &values[slot]; }
+	return 0;
+}
+
+
+//-////////////////////////////////////////////////////////////////////////////////////////////////
+//// @flat_map_tests
+#ifdef KIGU_UNIT_TESTS
+
+
+global void kigu__flat_map_unit_tests()
+{
+	{//// group matching ////
+		alignas(16) u8 group[KIGU_FLAT_MAP_GROUP_SIZE];
+		forI(KIGU_FLAT_MAP_GROUP_SIZE) group[i] = (u8)i;
+		group[3] = KIGU_FLAT_MAP_EMPTY;
+		group[9] = KIGU_FLAT_MAP_DELETED;
+		group[12] = 5;
+		
+		u64 match = kigu__flat_map_match(group, 5);
+		AssertAlways(kigu__flat_map_mask_index(match) == 5);
+		match &= match - 1;
+		AssertAlways(kigu__flat_map_mask_index(match) == 12);
+		match &= match - 1;
+		AssertAlways(match == 0);
+		AssertAlways(kigu__flat_map_mask_index(kigu__flat_map_match_empty(group)) == 3);
+		match = kigu__flat_map_match_free(group);
+		AssertAlways(kigu__flat_map_mask_index(match) == 3);
+		match &= match - 1;
+		AssertAlways(kigu__flat_map_mask_index(match) == 9);
+		match &= match - 1;
+		AssertAlways(match == 0);
+	}
+	
+	{//// add/has/at/remove ////
+		flat_map<u64,u64> m;
+		AssertAlways(!m.has(0) && m.at(0) == 0);
+		forI(100000) AssertAlways(*m.add((u64)i * 3, (u64)i) == i);
+		AssertAlways(m.count == 100000);
+		AssertAlways(IsPow2(m.capacity) && m.count <= kigu__flat_map_max_load(m.capacity));
+		forI(100000){
+			AssertAlways(*m.at((u64)i * 3) == i);
+			AssertAlways(!m.has((u64)i * 3 + 1));
+		}
+		
+		//adding an existing key returns its value unchanged
+		AssertAlways(*m.add(30, 5) == 10);
+		AssertAlways(m.count == 100000);
+		
+		for(u32 i = 0; i < 100000; i += 2) m.remove((u64)i * 3);
+		m.remove(1);
+		AssertAlways(m.count == 50000);
+		forI(100000) AssertAlways(m.has((u64)i * 3) == (i % 2 == 1));
+		
+		u64 sum = 0, visited = 0;
+		for(auto it = m.begin(); it != m.end(); ++it){
+			AssertAlways(*it * 3 == it.key());
+			sum += *it;
+			visited += 1;
+		}
+		AssertAlways(visited == 50000 && sum == 2500000000);
+	}
+	
+	{//// churn reuses deleted slots without growing ////
+		flat_map<u32,u32> m;
+		m.reserve(1000);
+		u32 capacity = m.capacity;
+		forI(1000) m.add(i, i);
+		forI(100000){
+			m.remove(i);
+			m.add(i + 1000, i);
+		}
+		AssertAlways(m.capacity == capacity && m.count == 1000);
+		forI(1000) AssertAlways(*m.at(100000 + i) == 99000 + i);
+		m.clear();
+		AssertAlways(m.count == 0 && !m.has(100500));
+	}
+	
+	{//// colliding hashes and str8 keys ////
+		struct ZeroHash{ u32 operator()(const u32& v)const{ return 0; } };
+		flat_map<u32,u32,ZeroHash> m;
+		forI(100) m.add(i, i+1);
+		forI(100) AssertAlways(*m.at(i) == i+1);
+		m.remove(50);
+		forI(100) AssertAlways(m.has(i) == (i != 50));
+		
+		flat_map<str8,u32> s;
+		s.add(STR8("hello"), 1);
+		s.add(STR8("world"), 2);
+		char buffer[] = "world";
+		AssertAlways((s[str8{(u8*)buffer, 5}] == 2));
+		AssertAlways(!s.has(STR8("worl")));
+	}
+	
+	{//// non-zeroing allocator ////
+		//values check that they are only ever assigned into zeroed memory
+		struct ZeroedValue{
+			u64 value;
+			ZeroedValue(u64 v = 0) : value(v){}
+			ZeroedValue& operator=(const ZeroedValue& rhs){ AssertAlways(value == 0); value = rhs.value; return *this; }
+		};
+		persist auto dirty_reserve = [](upt size) -> void*{ void* result = malloc(size); memset(result, 0xAB, size); return result; };
+		Allocator dirty{dirty_reserve, Allocator_ChangeMemory_Noop, Allocator_ChangeMemory_Noop, free, realloc, 0, AllocatorFlags_None, 0};
+		flat_map<u64,ZeroedValue> m(&dirty);
+		forI(1000) m.add(i, ZeroedValue(i+1));
+		forI(500) m.remove(i*2);
+		forI(500) m.add(i*2 + 1000, ZeroedValue(i+1));
+		forI(500) AssertAlways(m.at(i*2+1)->value == i*2+2);
+		forI(500) AssertAlways(m.at(i*2 + 1000)->value == i+1);
+	}
+}
+
+
+#endif //#ifdef KIGU_UNIT_TESTS
+#endif //#ifndef KIGU_FLAT_MAP_H
@@ -4,50 +4,83 @@
 
 #include "arrayT.h"
 #include "common.h"
+#include "ring_array.h"
 #include "string.h"
 #include "unicode.h"
 #include "profiling.h"
+#include <type_traits>
 
+#if ARCH_X64
+#  if COMPILER_CLANG || COMPILER_GCC
+#    include <cpuid.h>
+#    include <immintrin.h>
+#  endif //#if COMPILER_CLANG || COMPILER_GCC
+#elif ARCH_ARM64
+#  include <arm_acle.h>
+#  include <arm_neon.h>
+#  if OS_LINUX
+#    include <sys/auxv.h>
+#  endif //#if OS_LINUX
+#endif //#if ARCH_X64
+
+//returns the same hash as hash<str8> of the string literal `a` at compile-time
 template<int N>
 static constexpr const u32 compile_time_string_hash(const char(&a)[N]){
-	const char* const p(a);
-	u32 seed = 2166136261;
-	size_t data_size = N-1;
-	const u8* data = (const u8*)&a;
-	while (data_size-- != 0) {
-		seed ^= *data++;
-		seed *= 16777619;
+	return (u32)HashStatic64(a, N-1);
+}
+
+//returns a 64bit hash of the `bytes` bytes at `data`, which are read as one or two words (with one multiply) if they fit
+FORCE_INLINE u64
+kigu__hash_wide(const void* data, upt bytes){
+	if(bytes <= 8){
+		u64 word = 0;
+		memcpy(&word, data, bytes);
+		return HashU64(word, bytes);
+	}else if(bytes <= 16){
+		u64 words[2] = {};
+		memcpy(words, data, bytes);
+		return HashMix64(words[0] ^ KIGU_HASH_SECRET0, words[1] ^ KIGU_HASH_SECRET1 ^ bytes);
 	}
-	return seed;
+	return Hash64(data, bytes);
 }
 
+//NOTE hashes every byte of `T`, including padding, so padded structs must be zeroed or use HASH_MEMBERS()
 template<class T>
 struct hash {
 	
 	hash() {};
 	
 	inline u32 operator()(const T& v)const {DPZoneScoped;
-		u32 seed = 2166136261;
-		size_t data_size = sizeof(T);
-		const u8* data = (const u8*)&v;
-		while (data_size-- != 0) {
-			seed ^= *data++;
-			seed *= 16777619;
-		}
-		return seed;
-		
+		return (u32)kigu__hash_wide(&v, sizeof(T));
 	}
 	
 	inline u32 operator()(T* v)const {DPZoneScoped;
-		u32 seed = 2166136261;
-		size_t data_size = sizeof(T);
-		const u8* data = (const u8*)v;
-		while (data_size-- != 0) {
-			seed ^= *data++;
-			seed *= 16777619;
-		}
-		return seed;
-		
+		return (u32)kigu__hash_wide(v, sizeof(T));
+	}
+};
+
+//small fixed-size keys skip the byte loop and mix the value once
+#define KIGU_HASH_INTEGER(type)                                   \
+  template<>                                                      \
+  struct hash<type> {                                             \
+    inline u32 operator()(const type& v)const {                   \
+      return (u32)HashU64((u64)v);                                \
+    }                                                             \
+  }
+KIGU_HASH_INTEGER(u8);
+KIGU_HASH_INTEGER(u16);
+KIGU_HASH_INTEGER(u32);
+KIGU_HASH_INTEGER(u64);
+KIGU_HASH_INTEGER(s8);
+KIGU_HASH_INTEGER(s16);
+KIGU_HASH_INTEGER(s32);
+KIGU_HASH_INTEGER(s64);
+#undef KIGU_HASH_INTEGER
+
+template<class T>
+struct hash<T*> {
+	inline u32 operator()(T* const& v)const {
+		return (u32)HashU64((u64)(upt)v);
 	}
 };
 
@@ -61,40 +94,410 @@ struct hash<str8> {
 template<> 
 struct hash<cstring> {
 	inline u32 operator()(cstring s) {DPZoneScoped;
-		u32 seed = 2166136261;
-		u32 size = s.count;
-		while (size-- != 0) {
-			seed ^= s.str[size];
-			seed *= 16777619;
-		}
-		return seed;
+		return (u32)Hash64(s.str, s.count);
 	}
 };
 
 template<> 
 struct hash<const char*> {
 	inline u32 operator()(const char* s) {DPZoneScoped;
-		u32 seed = 2166136261;
-		u32 size = strlen(s)+1;
-		while (size-- != 0) {
-			seed ^= s[size];
-			seed *= 16777619;
-		}
-		return seed;
+		return (u32)Hash64(s, strlen(s));
 	}
 };
 
 template<class T> 
 struct hash<arrayT<T>> {
 	inline u32 operator()(arrayT<T>* s) {DPZoneScoped;
-		u32 seed = 2166136261;
-		u32 size = s->size;
-		while (size-- != 0) {
-			seed ^= s->operator[](size - 1);
-			seed *= 16777619;
+		return (u32)Hash64(s->data, s->count*sizeof(T));
+	}
+};
+
+//equality used alongside hash<T> by hash tables to tell apart keys with the same hash
+//  compares raw bytes to match the generic hash<T>
+template<class T>
+struct hash_equal {
+	inline bool operator()(const T& a, const T& b)const {
+		return memcmp(&a, &b, sizeof(T)) == 0;
+	}
+};
+
+template<> 
+struct hash_equal<str8> {
+	inline bool operator()(str8 a, str8 b)const {
+		return str8_equal_lazy(a, b);
+	}
+};
+
+template<> 
+struct hash_equal<cstring> {
+	inline bool operator()(cstring a, cstring b)const {
+		return (a.count == b.count) && (memcmp(a.str, b.str, a.count) == 0);
+	}
+};
+
+template<> 
+struct hash_equal<const char*> {
+	inline bool operator()(const char* a, const char* b)const {
+		return strcmp(a, b) == 0;
+	}
+};
+
+//////////////////////////// //NOTE HASH_MEMBERS() takes a list macro like ENUM_LIST(): #define Vertex_members(X) X(id) X(kind)
+//// memberwise hashing ////
+////////////////////////////
+//Returns `seed` with `value` mixed into it, for hashing several values in order
+constexpr u64
+hash_combine(u64 seed, u64 value){
+	return HashMix64(seed ^ KIGU_HASH_SECRET0, value ^ KIGU_HASH_SECRET1) ^ seed;
+}
+
+//members that are hashed and compared by their bits
+template<class T> constexpr bool kigu__hash_member_bitwise = std::is_integral<T>::value || std::is_enum<T>::value || std::is_pointer<T>::value;
+
+//Returns the value of integer, enum, and pointer members, or their hash<> otherwise
+template<class T> FORCE_INLINE u64
+kigu__hash_member(const T& member){
+	if constexpr(kigu__hash_member_bitwise<T>){
+		if constexpr(std::is_pointer<T>::value) return (u64)(upt)member;
+		else return (u64)member;
+	}else{
+		return hash<T>{}(member);
+	}
+}
+
+//Defines hash<type> and hash_equal<type> over only the members in `list_macro`, so padding and unlisted members are ignored
+//  if the members are all integers, enums, or pointers and fill the whole type (so there is no padding), the type is hashed
+//  as one or two words and compared with memcmp
+#define HASH_MEMBERS_COMBINE(member) result = hash_combine(result, kigu__hash_member(v.member));
+#define HASH_MEMBERS_EQUAL(member) && hash_equal<decltype(a.member)>{}(a.member, b.member)
+#define HASH_MEMBERS_SIZE(member) + sizeof(v.member)
+#define HASH_MEMBERS_BITWISE(member) && kigu__hash_member_bitwise<decltype(v.member)>
+#define HASH_MEMBERS(type, list_macro)                                                                              \
+  template<> struct hash<type> {                                                                                    \
+    inline u32 operator()(const type& v)const {                                                                     \
+      if constexpr((true list_macro(HASH_MEMBERS_BITWISE)) && (0 list_macro(HASH_MEMBERS_SIZE)) == sizeof(type)){    \
+        return (u32)kigu__hash_wide(&v, sizeof(type));                                                              \
+      }else{                                                                                                        \
+        u64 result = 0;                                                                                             \
+        list_macro(HASH_MEMBERS_COMBINE)                                                                            \
+        return (u32)result;                                                                                         \
+      }                                                                                                             \
+    }                                                                                                               \
+  };                                                                                                                \
+  template<> struct hash_equal<type> {                                                                              \
+    inline bool operator()(const type& a, const type& b)const {                                                     \
+      const type& v = a;                                                                                            \
+      if constexpr((true list_macro(HASH_MEMBERS_BITWISE)) && (0 list_macro(HASH_MEMBERS_SIZE)) == sizeof(type)){    \
+        return memcmp(&a, &b, sizeof(type)) == 0;                                                                   \
+      }else{                                                                                                        \
+        return true list_macro(HASH_MEMBERS_EQUAL);                                                                 \
+      }                                                                                                             \
+    }                                                                                                               \
+  }
+
+
+//////////////////////// //NOTE give the same hash as Hash64() (and str8_hash64()) of all the bytes as if they were contiguous
+//// streaming hash ////
+////////////////////////
+struct hash_state{
+	u64 seed;       //seed given to hash_state_init()
+	u64 lanes[3];   //lanes of the 48 byte blocks mixed so far
+	u64 count;      //total bytes given to the state
+	u32 buffered;   //bytes not mixed yet (1-48 after the first block is mixed)
+	u8  buffer[64]; //the 16 bytes before the unmixed bytes (which the last read can reach back to), then the unmixed bytes
+};
+
+//Starts a hash seeded with `seed`
+global void
+hash_state_init(hash_state* state, u64 seed = 0){
+	u64 mixed = seed ^ HashMix64(seed ^ KIGU_HASH_SECRET0, KIGU_HASH_SECRET1);
+	state->seed     = seed;
+	state->lanes[0] = mixed;
+	state->lanes[1] = mixed;
+	state->lanes[2] = mixed;
+	state->count    = 0;
+	state->buffered = 0;
+}
+
+//Adds `bytes` bytes at `data` to the hash
+global void
+hash_state_update(hash_state* state, const void* data, upt bytes){DPZoneScoped;
+	const u8* p = (const u8*)data;
+	state->count += bytes;
+	
+	//a block is only mixed once there's a byte after it, since the last 1-48 bytes are mixed by hash_state_final()
+	if(state->buffered + bytes <= 48){
+		if(bytes) memcpy(state->buffer + 16 + state->buffered, p, bytes);
+		state->buffered += (u32)bytes;
+		return;
+	}
+	
+	const u8* mixed_end = p;
+	if(state->buffered){
+		upt fill = 48 - state->buffered;
+		memcpy(state->buffer + 16 + state->buffered, p, fill);
+		p     += fill;
+		bytes -= fill;
+		kigu__hash64_block(state->buffer + 16, &state->lanes[0], &state->lanes[1], &state->lanes[2]);
+		mixed_end = state->buffer + 64;
+	}
+	for(; bytes > 48; bytes -= 48, p += 48){
+		kigu__hash64_block(p, &state->lanes[0], &state->lanes[1], &state->lanes[2]);
+		mixed_end = p + 48;
+	}
+	
+	memmove(state->buffer, mixed_end - 16, 16);
+	memcpy(state->buffer + 16, p, bytes);
+	state->buffered = (u32)bytes;
+}
+
+//Adds the contents of `a` to the hash
+FORCE_INLINE void
+hash_state_update_str8(hash_state* state, str8 a){
+	hash_state_update(state, a.str, a.count);
+}
+
+//Adds the items of `ring` to the hash in order from its start (wrapping around the end of its memory)
+template<typename T> global void
+hash_state_update_ring(hash_state* state, ring_array<T>* ring){
+	if(!ring->count) return;
+	u32 first = Min(ring->count, ring->capacity - ring->start);
+	hash_state_update(state, ring->data + ring->start, first * sizeof(T));
+	hash_state_update(state, ring->data, (ring->count - first) * sizeof(T));
+}
+
+//Returns the hash of everything given to `state` so far, more can still be added after
+global u64
+hash_state_final(hash_state* state){DPZoneScoped;
+	if(state->count <= 48) return kigu__hash64((const u8*)state->buffer + 16, state->count, state->seed);
+	return kigu__hash64_tail((const u8*)state->buffer + 16, state->buffered, state->lanes[0] ^ state->lanes[1] ^ state->lanes[2], state->count);
+}
+
+
+////////////////////////// //NOTE the instructions are picked by the first call, which is shared by every translation unit
+//// hardware hashing ////
+//////////////////////////
+//hash_crc32c() gives the same checksum on every machine, so it can be stored (in serialized buffers, etc). hash_aes64() only
+//  gives the same hash on machines that both do or both don't have AES instructions, so it's for in-memory tables only.
+#if COMPILER_CLANG || COMPILER_GCC
+#  if ARCH_X64
+#    define KIGU_HASH_TARGET_CRC __attribute__((target("sse4.2")))
+#    define KIGU_HASH_TARGET_AES __attribute__((target("sse4.2,aes")))
+#  elif ARCH_ARM64 && COMPILER_GCC
+#    define KIGU_HASH_TARGET_CRC __attribute__((target("+crc")))
+#    define KIGU_HASH_TARGET_AES __attribute__((target("+crypto")))
+#  elif ARCH_ARM64
+#    define KIGU_HASH_TARGET_CRC __attribute__((target("crc")))
+#    define KIGU_HASH_TARGET_AES __attribute__((target("aes")))
+#  endif
+#endif //#if COMPILER_CLANG || COMPILER_GCC
+#ifndef KIGU_HASH_TARGET_CRC
+#  define KIGU_HASH_TARGET_CRC
+#  define KIGU_HASH_TARGET_AES
+#endif
+
+struct HashCPUFeatures{
+	b32 crc32c; //SSE4.2 on x64, CRC32 on ARM64
+	b32 aes;    //AES-NI on x64, AES on ARM64
+};
+
+//Returns which of the hashing instructions the CPU supports
+inline HashCPUFeatures
+hash_detect_cpu_features(){
+	HashCPUFeatures result = {};
+#if ARCH_X64
+	int info[4] = {};
+#  if COMPILER_CL
+	__cpuid(info, 1);
+#  else
+	unsigned int a, b, c, d;
+	if(__get_cpuid(1, &a, &b, &c, &d)) info[2] = (int)c;
+#  endif //#if COMPILER_CL
+	result.crc32c = (info[2] >> 20) & 1;
+	result.aes    = result.crc32c && ((info[2] >> 25) & 1);
+#elif ARCH_ARM64
+#  if OS_LINUX
+	unsigned long hwcap = getauxval(AT_HWCAP);
+	result.crc32c = (hwcap >> 7) & 1; //HWCAP_CRC32
+	result.aes    = (hwcap >> 3) & 1; //HWCAP_AES
+#  else
+	//every ARM64 Mac and Windows device has both
+	result.crc32c = true;
+	result.aes    = true;
+#  endif //#if OS_LINUX
+#endif //#if ARCH_X64
+	return result;
+}
+
+//Returns which of the hashing instructions the CPU supports, they're only detected by the first call
+inline HashCPUFeatures
+hash_cpu_features(){
+	static HashCPUFeatures features = hash_detect_cpu_features();
+	return features;
+}
+
+//// crc32c ////
+struct kigu__crc32c_table_t{
+	u32 table[8][256] = {};
+	
+	constexpr kigu__crc32c_table_t(){
+		for(u32 i = 0; i < 256; i += 1){
+			u32 crc = i;
+			for(u32 bit = 0; bit < 8; bit += 1) crc = (crc >> 1) ^ (0x82F63B78 & (0u - (crc & 1))); //reversed Castagnoli polynomial
+			table[0][i] = crc;
+		}
+		for(u32 i = 0; i < 256; i += 1){
+			for(u32 slice = 1; slice < 8; slice += 1) table[slice][i] = (table[slice-1][i] >> 8) ^ table[0][table[slice-1][i] & 0xFF];
 		}
-		return seed;
 	}
 };
+global constexpr kigu__crc32c_table_t kigu__crc32c_table;
+
+//Returns the CRC32C of `bytes` bytes at `data` continuing from `crc` without hardware instructions (slice-by-8)
+inline u32
+kigu__hash_crc32c_software(const void* data, upt bytes, u32 crc){DPZoneScoped;
+	const u8* p = (const u8*)data;
+	const u32 (*t)[256] = kigu__crc32c_table.table;
+	crc = ~crc;
+	for(; bytes >= 8; bytes -= 8, p += 8){
+		u64 v;
+		memcpy(&v, p, 8);
+		v ^= crc;
+		crc = t[7][v & 0xFF] ^ t[6][(v >> 8) & 0xFF] ^ t[5][(v >> 16) & 0xFF] ^ t[4][(v >> 24) & 0xFF]
+			^ t[3][(v >> 32) & 0xFF] ^ t[2][(v >> 40) & 0xFF] ^ t[1][(v >> 48) & 0xFF] ^ t[0][v >> 56];
+	}
+	for(; bytes; bytes -= 1, p += 1) crc = (crc >> 8) ^ t[0][(crc ^ *p) & 0xFF];
+	return ~crc;
+}
+
+#if ARCH_X64 || ARCH_ARM64
+//Returns the CRC32C of `bytes` bytes at `data` continuing from `crc` with the CRC32C instructions, 8 bytes at a time
+KIGU_HASH_TARGET_CRC inline u32
+kigu__hash_crc32c_hardware(const void* data, upt bytes, u32 crc){DPZoneScoped;
+	const u8* p = (const u8*)data;
+	crc = ~crc;
+	for(; bytes >= 8; bytes -= 8, p += 8){
+		u64 v;
+		memcpy(&v, p, 8);
+#  if ARCH_X64
+		crc = (u32)_mm_crc32_u64(crc, v);
+#  else
+		crc = __crc32cd(crc, v);
+#  endif //#if ARCH_X64
+	}
+	for(; bytes; bytes -= 1, p += 1){
+#  if ARCH_X64
+		crc = _mm_crc32_u8(crc, *p);
+#  else
+		crc = __crc32cb(crc, *p);
+#  endif //#if ARCH_X64
+	}
+	return ~crc;
+}
+#endif //#if ARCH_X64 || ARCH_ARM64
+
+inline u32 kigu__hash_crc32c_resolve(const void* data, upt bytes, u32 crc);
+//starts out as kigu__hash_crc32c_resolve() so it can be called before any dynamic initializers run
+inline u32 (*kigu__hash_crc32c)(const void* data, upt bytes, u32 crc) = kigu__hash_crc32c_resolve;
+
+//Points kigu__hash_crc32c at the implementation the CPU supports, then calls it
+//NOTE threads that race through here all store the same pointer
+inline u32
+kigu__hash_crc32c_resolve(const void* data, upt bytes, u32 crc){
+#if ARCH_X64 || ARCH_ARM64
+	kigu__hash_crc32c = (hash_cpu_features().crc32c) ? kigu__hash_crc32c_hardware : kigu__hash_crc32c_software;
+#else
+	kigu__hash_crc32c = kigu__hash_crc32c_software;
+#endif //#if ARCH_X64 || ARCH_ARM64
+	return kigu__hash_crc32c(data, bytes, crc);
+}
+
+//Returns the CRC32C (Castagnoli) checksum of `bytes` bytes at `data`, pass the previous result as `crc` to continue it
+FORCE_INLINE u32
+hash_crc32c(const void* data, upt bytes, u32 crc = 0){
+	return kigu__hash_crc32c(data, bytes, crc);
+}
+
+//// aes ////
+#if ARCH_X64 || ARCH_ARM64
+#  if ARCH_X64
+typedef __m128i kigu__aes_block;
+KIGU_HASH_TARGET_AES FORCE_INLINE kigu__aes_block kigu__aes_load(const u8* p){return _mm_loadu_si128((const __m128i*)p);}
+KIGU_HASH_TARGET_AES FORCE_INLINE kigu__aes_block kigu__aes_set(u64 lo, u64 hi){return _mm_set_epi64x((s64)hi, (s64)lo);}
+KIGU_HASH_TARGET_AES FORCE_INLINE kigu__aes_block kigu__aes_xor(kigu__aes_block a, kigu__aes_block b){return _mm_xor_si128(a, b);}
+KIGU_HASH_TARGET_AES FORCE_INLINE kigu__aes_block kigu__aes_round(kigu__aes_block state, kigu__aes_block key){return _mm_aesenc_si128(state, key);}
+KIGU_HASH_TARGET_AES FORCE_INLINE u64 kigu__aes_fold(kigu__aes_block a){return (u64)_mm_cvtsi128_si64(a) ^ (u64)_mm_extract_epi64(a, 1);}
+#  else
+typedef uint8x16_t kigu__aes_block;
+KIGU_HASH_TARGET_AES FORCE_INLINE kigu__aes_block kigu__aes_load(const u8* p){return vld1q_u8(p);}
+KIGU_HASH_TARGET_AES FORCE_INLINE kigu__aes_block kigu__aes_set(u64 lo, u64 hi){return vreinterpretq_u8_u64(vcombine_u64(vcreate_u64(lo), vcreate_u64(hi)));}
+KIGU_HASH_TARGET_AES FORCE_INLINE kigu__aes_block kigu__aes_xor(kigu__aes_block a, kigu__aes_block b){return veorq_u8(a, b);}
+//same as x64's aesenc: AESE xors the key before the round, so it's given zero and the key is xored after MixColumns
+KIGU_HASH_TARGET_AES FORCE_INLINE kigu__aes_block kigu__aes_round(kigu__aes_block state, kigu__aes_block key){return veorq_u8(vaesmcq_u8(vaeseq_u8(state, vdupq_n_u8(0))), key);}
+KIGU_HASH_TARGET_AES FORCE_INLINE u64 kigu__aes_fold(kigu__aes_block a){return vgetq_lane_u64(vreinterpretq_u64_u8(a), 0) ^ vgetq_lane_u64(vreinterpretq_u64_u8(a), 1);}
+#  endif //#if ARCH_X64
+
+//Returns a 64bit hash of `bytes` bytes at `data` seeded with `seed` using one AES round per 16 bytes, 64 bytes at a time
+KIGU_HASH_TARGET_AES inline u64
+kigu__hash_aes64_hardware(const void* data, upt bytes, u64 seed){DPZoneScoped;
+	const u8* p = (const u8*)data;
+	kigu__aes_block key = kigu__aes_set(seed ^ KIGU_HASH_SECRET2, (u64)bytes ^ KIGU_HASH_SECRET3);
+	kigu__aes_block lanes[4] = {
+		kigu__aes_xor(key, kigu__aes_set(KIGU_HASH_SECRET0, KIGU_HASH_SECRET1)),
+		kigu__aes_xor(key, kigu__aes_set(KIGU_HASH_SECRET1, KIGU_HASH_SECRET2)),
+		kigu__aes_xor(key, kigu__aes_set(KIGU_HASH_SECRET2, KIGU_HASH_SECRET3)),
+		kigu__aes_xor(key, kigu__aes_set(KIGU_HASH_SECRET3, KIGU_HASH_SECRET0)),
+	};
+	
+	if(bytes < 16){
+		//the length is in the key, so zero padding doesn't collide with zero bytes
+		u8 buffer[16] = {};
+		if(bytes) memcpy(buffer, p, bytes);
+		lanes[0] = kigu__aes_round(lanes[0], kigu__aes_load(buffer));
+	}else{
+		upt remaining = bytes;
+		for(; remaining > 64; remaining -= 64, p += 64){
+			lanes[0] = kigu__aes_round(lanes[0], kigu__aes_load(p));
+			lanes[1] = kigu__aes_round(lanes[1], kigu__aes_load(p + 16));
+			lanes[2] = kigu__aes_round(lanes[2], kigu__aes_load(p + 32));
+			lanes[3] = kigu__aes_round(lanes[3], kigu__aes_load(p + 48));
+		}
+		
+		//the last 1-64 bytes in 16 byte blocks, the last of which ends at the end of the data (overlapping the one before it)
+		upt blocks = (remaining + 15) / 16;
+		for(upt i = 0; i < blocks - 1; i += 1) lanes[i] = kigu__aes_round(lanes[i], kigu__aes_load(p + 16*i));
+		lanes[blocks - 1] = kigu__aes_round(lanes[blocks - 1], kigu__aes_load(p + remaining - 16));
+	}
+	
+	kigu__aes_block result = kigu__aes_round(kigu__aes_round(lanes[0], lanes[1]), kigu__aes_round(lanes[2], lanes[3]));
+	result = kigu__aes_round(result, key);
+	result = kigu__aes_round(result, key);
+	result = kigu__aes_round(result, key);
+	return kigu__aes_fold(result);
+}
+#endif //#if ARCH_X64 || ARCH_ARM64
+
+inline u64 kigu__hash_aes64_resolve(const void* data, upt bytes, u64 seed);
+//starts out as kigu__hash_aes64_resolve() so it can be called before any dynamic initializers run
+inline u64 (*kigu__hash_aes64)(const void* data, upt bytes, u64 seed) = kigu__hash_aes64_resolve;
+
+//Points kigu__hash_aes64 at the implementation the CPU supports, then calls it
+//NOTE threads that race through here all store the same pointer
+inline u64
+kigu__hash_aes64_resolve(const void* data, upt bytes, u64 seed){
+#if ARCH_X64 || ARCH_ARM64
+	kigu__hash_aes64 = (hash_cpu_features().aes) ? kigu__hash_aes64_hardware : Hash64;
+#else
+	kigu__hash_aes64 = Hash64;
+#endif //#if ARCH_X64 || ARCH_ARM64
+	return kigu__hash_aes64(data, bytes, seed);
+}
+
+//Returns a 64bit hash of `bytes` bytes at `data` seeded with `seed` using AES instructions (or Hash64() if the CPU has none)
+//NOTE only meant for large keys, since calling through the function pointer costs more than hashing a few bytes
+FORCE_INLINE u64
+hash_aes64(const void* data, upt bytes, u64 seed = 0){
+	return kigu__hash_aes64(data, bytes, seed);
+}
 
-#endif //KIGU_HASH_H
\ No newline at end of file
+#endif //KIGU_HASH_H
@@ -0,0 +1,341 @@
+/* kigu intern module
+WHAT:
+This module provides string interning: every unique str8 given to an `Interner` is copied once into the interner's own
+storage and given a stable u32 id. Interning the same contents again returns the same id and the same canonical str8 (same
+pointer), so interned strings can be compared by id (or by pointer) and ids can be used as map keys.
+
+WHY:
+Parsers and asset tables compare and hash the same identifiers over and over, and str8_equal() decodes both strings codepoint
+by codepoint while str8_hash64() walks every byte. Interning pays for one hash and one comparison per token when it's read,
+and everything after that only deals with u32 ids.
+
+NOTES:
+- Id 0 is the empty string: interning an empty str8 returns 0, and intern_find() returns 0 for strings that aren't interned.
+- Canonical strings are null-terminated and never move or get freed until intern_deinit(), and ids are handed out in order.
+- String contents are stored in one reserved address range (KIGU_INTERN_RESERVE_SIZE, 16GB) and the id to str8 table in
+  another (KIGU_INTERN_ID_RESERVE_SIZE, 4GB, which is 268M ids), both arenas that commit pages as they grow.
+- Interners made with `thread_safe` can be used from any number of threads at once. Lookups of strings that are already
+  interned don't lock (the index is a concurrent_map); new strings are added under the interner's lock. Call intern_reclaim()
+  when no other thread is using a thread safe interner to free old index tables (see concurrent_map.h).
+- Other interners index their strings with a flat_map, so a lookup is one hash and a probe without any atomics.
+- intern_array() and intern_arrayT() look up the whole batch before taking the lock once for all of the new strings.
+
+INDEX:
+@intern_init
+  Interner: struct
+  intern_init(Interner* interner, b32 thread_safe) -> void
+  intern_deinit(Interner* interner) -> void
+  intern_reclaim(Interner* interner) -> void
+@intern
+  intern(Interner* interner, str8 string) -> u32
+  intern_canonical(Interner* interner, str8 string) -> str8
+  intern_find(Interner* interner, str8 string) -> u32
+  intern_str8(Interner* interner, u32 id) -> str8
+  intern_count(Interner* interner) -> u32
+  intern_array(Interner* interner, str8* strings, u32 count, u32* out_ids) -> void
+  intern_arrayT(Interner* interner, arrayT<str8>* strings, arrayT<u32>* out_ids) -> void
+@intern_tests
+*/
+#pragma once
+#ifndef KIGU_INTERN_H
+#define KIGU_INTERN_H
+
+
+#ifndef KIGU_INTERN_RESERVE_SIZE
+#  define KIGU_INTERN_RESERVE_SIZE Gigabytes(16)
+#endif
+#ifndef KIGU_INTERN_ID_RESERVE_SIZE
+#  define KIGU_INTERN_ID_RESERVE_SIZE Gigabytes(4)
+#endif
+
+
+#include "common.h"
+#include "memory.h"
+#include "arena.h"
+#include "arrayT.h"
+#include "unicode.h"
+#include "concurrent_map.h"
+#include "flat_map.h"
+#include "profiling.h"
+
+
+//-////////////////////////////////////////////////////////////////////////////////////////////////
+//// @intern_init
+
+
+typedef struct Interner{
+	Arena* chars; //contents of the interned strings, packed back to back
+	Arena* ids;   //str8 of each id, indexed by id
+	concurrent_map<str8,u32>* index; //index of thread safe interners
+	flat_map<str8,u32>* local_index; //index of interners that aren't thread safe
+	u32 count; //number of ids handed out, including id 0
+	b32 thread_safe;
+	volatile s32 lock; //held while adding strings to a thread safe interner
+}Interner;
+
+
+//Initializes `interner`, which can be used from several threads at once if `thread_safe` is true
+global void
+intern_init(Interner* interner, b32 thread_safe){DPZoneScoped;
+	interner->chars = arena_create(KIGU_INTERN_RESERVE_SIZE);
+	interner->ids   = arena_create(KIGU_INTERN_ID_RESERVE_SIZE);
+	interner->index = 0;
+	interner->local_index = 0;
+	if(thread_safe){
+		interner->index = (concurrent_map<str8,u32>*)stl_allocator->reserve(sizeof(concurrent_map<str8,u32>));
+		new(interner->index) concurrent_map<str8,u32>(KIGU_CONCURRENT_MAP_SHARD_COUNT);
+	}else{
+		interner->local_index = (flat_map<str8,u32>*)stl_allocator->reserve(sizeof(flat_map<str8,u32>));
+		new(interner->local_index) flat_map<str8,u32>();
+	}
+	interner->thread_safe = thread_safe;
+	interner->lock = 0;
+	
+	//id 0 is the empty string
+	kigu__arena_extend(interner->ids, interner->ids->cursor, interner->ids->cursor + sizeof(str8));
+	interner->count = 1;
+}
+
+
+//Frees all of the memory of `interner`, every id and canonical string it handed out becomes invalid
+global void
+intern_deinit(Interner* interner){DPZoneScoped;
+	if(interner->index){
+		interner->index->~concurrent_map();
+		stl_allocator->release(interner->index);
+	}
+	if(interner->local_index){
+		interner->local_index->~flat_map();
+		stl_allocator->release(interner->local_index);
+	}
+	arena_destroy(interner->chars);
+	arena_destroy(interner->ids);
+	*interner = Interner{};
+}
+
+
+//Frees index tables that were replaced as the index grew, only call this when no other thread is using `interner`
+FORCE_INLINE void
+intern_reclaim(Interner* interner){
+	if(interner->index) interner->index->reclaim();
+}
+
+
+//-////////////////////////////////////////////////////////////////////////////////////////////////
+//// @intern
+
+
+//Returns the canonical string of `id`
+FORCE_INLINE str8
+intern_str8(Interner* interner, u32 id){
+	Assert(id < kigu__load_acquire(&interner->count), "invalid intern id");
+	return ((str8*)interner->ids->start)[id];
+}
+
+
+//Returns the number of ids handed out by `interner` (including id 0)
+FORCE_INLINE u32
+intern_count(Interner* interner){
+	return kigu__load_acquire(&interner->count);
+}
+
+
+//Writes the id of `string` to `out_id` and returns true if it has been interned
+FORCE_INLINE b32
+kigu__intern_get(Interner* interner, str8 string, u32* out_id){
+	if(interner->local_index){
+		u32* id = interner->local_index->at(string);
+		if(id) *out_id = *id;
+		return id != 0;
+	}
+	return interner->index->get(string, out_id);
+}
+
+
+//Returns the id of `string` if it has been interned, otherwise 0
+global u32
+intern_find(Interner* interner, str8 string){DPZoneScoped;
+	u32 id = 0;
+	if(string.count) kigu__intern_get(interner, string, &id);
+	return id;
+}
+
+
+//Copies `string` into `interner` and gives it the next id
+//NOTE must be called with the lock held on thread safe interners, and `string` must not already be interned
+global u32
+kigu__intern_add(Interner* interner, str8 string){
+	u8* chars = interner->chars->cursor;
+	if(!kigu__arena_extend(interner->chars, chars, chars + string.count + 1)) return 0;
+	CopyMemory(chars, string.str, string.count);
+	chars[string.count] = '\0';
+	
+	u32 id = interner->count;
+	str8* canonical = (str8*)interner->ids->cursor;
+	if(!kigu__arena_extend(interner->ids, (u8*)canonical, (u8*)(canonical + 1))) return 0;
+	*canonical = str8{chars, string.count};
+	
+	//the id's string is written before the id is published to other threads through the count and the index
+	kigu__store_release(&interner->count, id + 1);
+	if(interner->local_index){
+		interner->local_index->add(*canonical, id);
+	}else{
+		interner->index->add(*canonical, id);
+	}
+	return id;
+}
+
+
+//Returns the id of `string`, interning it if it hasn't been yet
+global u32
+intern(Interner* interner, str8 string){DPZoneScoped;
+	if(!string.count) return 0;
+	u32 id = 0;
+	if(kigu__intern_get(interner, string, &id)) return id;
+	
+	if(interner->thread_safe){
+		kigu__spin_lock(&interner->lock);
+		if(!interner->index->get(string, &id)) id = kigu__intern_add(interner, string); //another thread might have added it
+		kigu__spin_unlock(&interner->lock);
+		return id;
+	}
+	return kigu__intern_add(interner, string);
+}
+
+
+//Returns the canonical string with the same contents as `string`, interning it if it hasn't been yet
+FORCE_INLINE str8
+intern_canonical(Interner* interner, str8 string){
+	return intern_str8(interner, intern(interner, string));
+}
+
+
+//Interns `count` strings from `strings`, writing their ids to `out_ids`
+global void
+intern_array(Interner* interner, str8* strings, u32 count, u32* out_ids){DPZoneScoped;
+	//find everything that's already interned without locking, marking the rest with -1
+	u32 missing = 0;
+	forI(count){
+		out_ids[i] = 0;
+		if(strings[i].count && !kigu__intern_get(interner, strings[i], &out_ids[i])){
+			out_ids[i] = -1;
+			missing += 1;
+		}
+	}
+	if(!missing) return;
+	
+	if(interner->thread_safe) kigu__spin_lock(&interner->lock);
+	if(interner->local_index){
+		interner->local_index->reserve(interner->local_index->count + missing);
+	}else{
+		interner->index->reserve(interner->index->count() + missing);
+	}
+	forI(count){
+		if(out_ids[i] != -1) continue;
+		if(!kigu__intern_get(interner, strings[i], &out_ids[i])){ //duplicates in the batch (or other threads) might have added it
+			out_ids[i] = kigu__intern_add(interner, strings[i]);
+		}
+	}
+	if(interner->thread_safe) kigu__spin_unlock(&interner->lock);
+}
+
+
+//Interns every string in `strings`, replacing the contents of `out_ids` with their ids
+global void
+intern_arrayT(Interner* interner, arrayT<str8>* strings, arrayT<u32>* out_ids){DPZoneScoped;
+	out_ids->clear();
+	if(!strings->count) return;
+	out_ids->resize(strings->count);
+	intern_array(interner, strings->data, strings->count, out_ids->data);
+}
+
+
+//-////////////////////////////////////////////////////////////////////////////////////////////////
+//// @intern_tests
+#ifdef KIGU_UNIT_TESTS
+
+
+global void kigu__intern_unit_tests()
+{
+	{//// intern/find/str8 ////
+		Interner interner;
+		intern_init(&interner, false);
+		AssertAlways(intern(&interner, str8{}) == 0);
+		AssertAlways(intern_str8(&interner, 0).count == 0);
+		AssertAlways(interner.local_index && !interner.index);
+		AssertAlways(intern_find(&interner, STR8("hello")) == 0);
+		
+		u32 hello = intern(&interner, STR8("hello"));
+		u32 world = intern(&interner, STR8("world"));
+		AssertAlways(hello == 1 && world == 2 && intern_count(&interner) == 3);
+		
+		//the same contents from a different buffer give the same id and canonical string
+		char buffer[] = "hello";
+		str8 copy = str8{(u8*)buffer, 5};
+		AssertAlways(intern(&interner, copy) == hello);
+		AssertAlways(intern_find(&interner, copy) == hello);
+		str8 canonical = intern_canonical(&interner, copy);
+		AssertAlways(canonical.str == intern_str8(&interner, hello).str && canonical.str != copy.str);
+		AssertAlways(str8_equal_lazy(canonical, copy) && canonical.str[5] == '\0');
+		
+		//many strings keep their ids and canonical strings as the storage grows
+		char name[32];
+		forI(100000){
+			int length = snprintf(name, sizeof(name), "identifier_%d", (int)i);
+			AssertAlways(intern(&interner, str8{(u8*)name, (s64)length}) == 3 + i);
+		}
+		AssertAlways(intern_str8(&interner, hello).str == canonical.str);
+		forI(100000){
+			int length = snprintf(name, sizeof(name), "identifier_%d", (int)i);
+			AssertAlways(str8_equal_lazy(intern_str8(&interner, 3 + i), str8{(u8*)name, (s64)length}));
+		}
+		intern_deinit(&interner);
+	}
+	
+	{//// batches ////
+		Interner interner;
+		intern_init(&interner, false);
+		intern(&interner, STR8("b"));
+		arrayT<str8> strings;
+		strings.add(STR8("a"));
+		strings.add(STR8("b"));
+		strings.add(str8{});
+		strings.add(STR8("a"));
+		strings.add(STR8("c"));
+		arrayT<u32> ids;
+		intern_arrayT(&interner, &strings, &ids);
+		AssertAlways(ids.count == 5);
+		AssertAlways(ids[0] == 2 && ids[1] == 1 && ids[2] == 0 && ids[3] == 2 && ids[4] == 3);
+		intern_deinit(&interner);
+	}
+	
+	{//// threads ////
+		Interner interner;
+		intern_init(&interner, true);
+		AssertAlways(interner.index && !interner.local_index);
+		const u32 thread_count = 4, string_count = 20000;
+		volatile u32 failures = 0;
+		std::thread threads[thread_count];
+		forX(t, thread_count){
+			threads[t] = std::thread([&interner, &failures, t](){
+				//every thread interns the same strings in a different order
+				char name[32];
+				forI(string_count){
+					u32 index = (i * 7919 + t * 1009) % string_count;
+					int length = snprintf(name, sizeof(name), "token%u", index);
+					u32 id = intern(&interner, str8{(u8*)name, (s64)length});
+					if(!str8_equal_lazy(intern_str8(&interner, id), str8{(u8*)name, (s64)length})) kigu__atomic_add(&failures, 1);
+				}
+			});
+		}
+		forX(t, thread_count) threads[t].join();
+		AssertAlways(failures == 0);
+		AssertAlways(intern_count(&interner) == string_count + 1);
+		intern_reclaim(&interner);
+		intern_deinit(&interner);
+	}
+}
+
+
+#endif //#ifdef KIGU_UNIT_TESTS
+#endif //#ifndef KIGU_INTERN_H
@@ -0,0 +1,396 @@
+/* kigu allocator benchmarks
+Runs workloads built from kigu containers against each of kigu's allocators and prints a table of:
+  ns/op   average time of one operation of the workload (an operation is one push, add, append, node, etc)
+  rss     how much the peak resident set size of the process grew by during the workload
+  frag    fraction of that growth that wasn't live memory requested by the workload (measured with a tracker.h run)
+
+Build and run it as its own program with optimizations on, eg:
+  g++ -std=c++17 -O2 kigu_benchmarks.cpp -o kigu_benchmarks && ./kigu_benchmarks
+  cl /std:c++17 /O2 kigu_benchmarks.cpp && kigu_benchmarks.exe
+
+The handoff workloads run on one thread and then on one thread per core (up to 16), with every thread releasing blocks another
+thread reserved, which shows how well the thread safe allocators scale with cores.
+
+On Linux and Mac each workload/allocator pair runs in a forked child process so that every run starts with a fresh heap and
+RSS baseline. On Windows they run one after another in the same process, so the rss and frag columns are less meaningful.
+*/
+#include <atomic>
+#include <chrono>
+#include <new>
+#include <thread>
+
+#include "common.h"
+#include "memory.h"
+#include "arena.h"
+#include "slab.h"
+#include "tcache.h"
+#include "vmem.h"
+#include "tracker.h"
+#include "array.h"
+#include "arrayT.h"
+#include "map.h"
+#include "node.h"
+#include "unicode.h"
+
+#if OS_WINDOWS
+#  include <psapi.h>
+#  pragma comment(lib, "psapi")
+#else
+#  include <sys/resource.h>
+#  include <sys/wait.h>
+#endif //#if OS_WINDOWS
+
+#define BENCH_KIGU_TIMER_START(name) std::chrono::time_point<std::chrono::steady_clock> name = std::chrono::steady_clock::now()
+#define BENCH_KIGU_TIMER_END(name) std::chrono::duration<f64, std::nano>(std::chrono::steady_clock::now() - name).count()
+
+
+//-////////////////////////////////////////////////////////////////////////////////////////////////
+//// @bench_rss
+
+
+//returns the highest resident set size the process has had in bytes (0 if unknown), which includes transient peaks like the
+//old and new buffers of a growing array both being alive
+local upt bench_rss_peak(){
+#if OS_WINDOWS
+	PROCESS_MEMORY_COUNTERS counters;
+	if(GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) return counters.PeakWorkingSetSize;
+	return 0;
+#else
+	struct rusage usage;
+	if(getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+#  if OS_MAC
+	return (upt)usage.ru_maxrss; //bytes on Mac
+#  else
+	return (upt)usage.ru_maxrss * 1024; //kilobytes elsewhere
+#  endif //#if OS_MAC
+#endif //#if OS_WINDOWS
+}
+
+//resets the peak RSS to the current RSS where the OS allows it, forked children start with their parent's peak otherwise
+local void bench_rss_peak_reset(){
+#if OS_LINUX
+	FILE* file = fopen("/proc/self/clear_refs", "w");
+	if(file){
+		fputs("5", file);
+		fclose(file);
+	}
+#endif //#if OS_LINUX
+}
+
+
+//-////////////////////////////////////////////////////////////////////////////////////////////////
+//// @bench_workloads
+
+
+//every workload builds up containers with `allocator`, frees everything, and returns the number of operations it did
+typedef u64 (*BenchWorkload)(Allocator* allocator);
+
+//many arrays that grow one push at a time
+local u64 bench_array_push(Allocator* allocator){
+	const u32 array_count = 64, push_count = 50000;
+	u32* arrays[array_count] = {};
+	forX(a, array_count){
+		array_init(arrays[a], 1, allocator);
+		forI(push_count) array_push_value(arrays[a], (u32)i);
+	}
+	forX(a, array_count) array_deinit(arrays[a]);
+	return (u64)array_count * push_count;
+}
+
+//one array that grows to hundreds of megabytes (where copy-free growth matters)
+local u64 bench_array_push_large(Allocator* allocator){
+	const u64 push_count = 32000000;
+	u64* array = 0;
+	array_init(array, 1, allocator);
+	forI(push_count) array_push_value(array, (u64)i);
+	array_deinit(array);
+	return push_count;
+}
+
+//arrays that keep adding and removing items
+local u64 bench_arrayT_add_remove(Allocator* allocator){
+	const u32 array_count = 32, add_count = 20000;
+	u64 ops = 0;
+	{
+		arrayT<arrayT<u64>> arrays(allocator);
+		forX(a, array_count) arrays.add(arrayT<u64>(allocator));
+		forX(round, 4){
+			forX(a, array_count){
+				forI(add_count) arrays[a].add((u64)i);
+				ops += add_count;
+			}
+			forX(a, array_count){
+				for(u32 i = 0; i < add_count; i += 2){
+					arrays[a].remove_unordered(arrays[a].count / 2);
+					ops += 1;
+				}
+			}
+		}
+	}
+	return ops;
+}
+
+//maps with keys added one at a time
+local u64 bench_map_add(Allocator* allocator){
+	const u32 map_count = 16, key_count = 100000;
+	{
+		map<u64,u64>* maps = (map<u64,u64>*)stl_allocator->reserve(map_count*sizeof(map<u64,u64>));
+		forX(m, map_count){
+			new(&maps[m]) map<u64,u64>(allocator);
+			forI(key_count) maps[m].add((u64)i * 2654435761u, (u64)i);
+		}
+		forX(m, map_count) maps[m].~map();
+		stl_allocator->release(maps);
+	}
+	return (u64)map_count * key_count;
+}
+
+//strings built by concatenating onto the previous string and freeing it
+local u64 bench_str8_concat(Allocator* allocator){
+	const u32 chain_count = 256, concat_count = 256;
+	str8 piece = STR8("the quick brown fox jumps over the lazy dog ");
+	str8* chains = (str8*)stl_allocator->reserve(chain_count*sizeof(str8));
+	forX(c, chain_count){
+		chains[c] = str8_copy(piece, allocator);
+		forI(concat_count){
+			str8 next = str8_concat(chains[c], piece, allocator);
+			allocator->release(chains[c].str);
+			chains[c] = next;
+		}
+	}
+	forX(c, chain_count) allocator->release(chains[c].str);
+	stl_allocator->release(chains);
+	return (u64)chain_count * concat_count;
+}
+
+//many string builders appending small pieces
+local u64 bench_dstr8_append(Allocator* allocator){
+	const u32 builder_count = 512, append_count = 2000;
+	str8 pieces[4] = {STR8("a"), STR8("hello "), STR8("0123456789"), STR8("some longer piece of text ")};
+	dstr8* builders = (dstr8*)stl_allocator->reserve(builder_count*sizeof(dstr8));
+	forX(b, builder_count){
+		dstr8_init(&builders[b], str8{}, allocator);
+		forI(append_count) dstr8_append(&builders[b], pieces[i % 4]);
+	}
+	forX(b, builder_count) dstr8_deinit(&builders[b]);
+	stl_allocator->release(builders);
+	return (u64)builder_count * append_count;
+}
+
+//a tree where nodes keep getting removed and replaced
+local u64 bench_tnode_churn(Allocator* allocator){
+	const u32 node_count = 200000, churn_count = 400000;
+	TNode** nodes = (TNode**)stl_allocator->reserve(node_count*sizeof(TNode*));
+	TNode* root = (TNode*)allocator->reserve(sizeof(TNode));
+	forI(node_count){
+		nodes[i] = (TNode*)allocator->reserve(sizeof(TNode));
+		insert_last((i < 64) ? root : nodes[(i * 7) % 64], nodes[i]);
+	}
+	
+	//replace leaves at pseudo-random positions
+	u32 seed = 12345;
+	forI(churn_count){
+		seed = seed * 1664525 + 1013904223;
+		u32 index = 64 + (seed >> 8) % (node_count - 64);
+		TNode* parent = nodes[index]->parent;
+		remove(nodes[index]);
+		allocator->release(nodes[index]);
+		nodes[index] = (TNode*)allocator->reserve(sizeof(TNode));
+		insert_last(parent, nodes[index]);
+	}
+	
+	for(s64 i = node_count-1; i >= 0; i -= 1) allocator->release(nodes[i]);
+	allocator->release(root);
+	stl_allocator->release(nodes);
+	return (u64)node_count + churn_count;
+}
+
+//waits until `target` threads in total have arrived at `arrived` (which only ever counts up, so it can be reused by raising
+//`target` by the thread count every time)
+local void bench_barrier(std::atomic<u32>* arrived, u32 target){
+	arrived->fetch_add(1);
+	while(arrived->load(std::memory_order_acquire) < target) std::this_thread::yield();
+}
+
+//threads that each reserve a batch of small blocks, then release the batch of the next thread over (so every release is a
+//cross thread release); ns/op is wall time over the operations of every thread, so it divides by the thread count when an
+//allocator scales linearly with cores
+local u64 bench_threaded_handoff(Allocator* allocator, u32 thread_count){
+	const u32 round_count = 64, batch_count = 8192;
+	void** batches = (void**)stl_allocator->reserve(thread_count*batch_count*sizeof(void*));
+	std::atomic<u32> arrived{0};
+	auto worker = [=, &arrived](u32 t){
+		forX(round, round_count){
+			void** batch = batches + t*batch_count;
+			forI(batch_count) batch[i] = allocator->reserve(16 + ((i * 7 + round) % 32)*16);
+			bench_barrier(&arrived, (round*2 + 1)*thread_count);
+			void** other = batches + ((t + 1) % thread_count)*batch_count;
+			forI(batch_count) allocator->release(other[i]);
+			bench_barrier(&arrived, (round*2 + 2)*thread_count);
+		}
+		tcache_flush_thread(); //so the blocks cached by tcache aren't lost when the thread exits (a noop otherwise)
+	};
+	std::thread* threads = (std::thread*)stl_allocator->reserve(thread_count*sizeof(std::thread));
+	for(u32 t = 1; t < thread_count; t += 1) new(&threads[t]) std::thread(worker, t);
+	worker(0);
+	for(u32 t = 1; t < thread_count; t += 1){
+		threads[t].join();
+		threads[t].~thread();
+	}
+	stl_allocator->release(threads);
+	stl_allocator->release(batches);
+	return (u64)thread_count * round_count * batch_count * 2;
+}
+
+local u64 bench_threaded_handoff_1(Allocator* allocator){
+	return bench_threaded_handoff(allocator, 1);
+}
+
+local u64 bench_threaded_handoff_n(Allocator* allocator){
+	return bench_threaded_handoff(allocator, Clamp(std::thread::hardware_concurrency(), 2u, 16u));
+}
+
+struct BenchWorkloadInfo{
+	const char* name;
+	BenchWorkload run;
+	b32 large;    //only run with allocators meant for large containers and the general ones
+	b32 threaded; //reserves and releases from several threads at once (only run with the thread safe small block allocators)
+};
+
+local BenchWorkloadInfo bench_workloads[] = {
+	{"array_push",        bench_array_push,         false, false},
+	{"array_push_large",  bench_array_push_large,   true,  false},
+	{"arrayT_add_remove", bench_arrayT_add_remove,  false, false},
+	{"map_add",           bench_map_add,            false, false},
+	{"str8_concat",       bench_str8_concat,        false, false},
+	{"dstr8_append",      bench_dstr8_append,       false, false},
+	{"tnode_churn",       bench_tnode_churn,        false, false},
+	{"handoff_1_thread",  bench_threaded_handoff_1, false, true },
+	{"handoff_n_threads", bench_threaded_handoff_n, false, true },
+};
+
+
+//-////////////////////////////////////////////////////////////////////////////////////////////////
+//// @bench_allocators
+
+
+local Arena* bench_arena;
+local Allocator* bench_arena_begin(){ bench_arena = arena_create(Gigabytes(16)); return arena_allocator(bench_arena); }
+local void bench_arena_end(){ arena_destroy(bench_arena); }
+
+local Allocator* bench_stl_begin(){ return stl_allocator; }
+local Allocator* bench_slab_begin(){ return slab_allocator; }
+local Allocator* bench_tcache_begin(){ return tcache_allocator; }
+local Allocator* bench_vmem_remap_begin(){ return vmem_remap_allocator; }
+local Allocator* bench_vmem_stable_begin(){ return vmem_stable_allocator; }
+local Allocator* bench_vmem_huge_begin(){ return vmem_huge_allocator; }
+local void bench_noop_end(){}
+
+struct BenchAllocatorInfo{
+	const char* name;
+	Allocator* (*begin)();
+	void (*end)();
+	b32 large_only;  //page granular allocators that are only meant for large containers
+	b32 thread_safe;
+};
+
+local BenchAllocatorInfo bench_allocators[] = {
+	{"stl",         bench_stl_begin,         bench_noop_end,  false, true },
+	{"slab",        bench_slab_begin,        bench_noop_end,  false, true },
+	{"tcache",      bench_tcache_begin,      bench_noop_end,  false, true },
+	{"arena",       bench_arena_begin,       bench_arena_end, false, false},
+	{"vmem_remap",  bench_vmem_remap_begin,  bench_noop_end,  true,  true },
+	{"vmem_stable", bench_vmem_stable_begin, bench_noop_end,  true,  true },
+	{"vmem_huge",   bench_vmem_huge_begin,   bench_noop_end,  true,  true },
+};
+
+
+//-////////////////////////////////////////////////////////////////////////////////////////////////
+//// @bench_run
+
+
+//trackers aren't thread safe, so threaded workloads are tracked through an allocator that locks around the tracker's
+struct BenchLockedTracker{
+	volatile s32 lock;
+	Allocator* tracked;
+};
+
+local void* bench_locked_reserve(void* context, upt size){
+	BenchLockedTracker* locked = (BenchLockedTracker*)context;
+	kigu__spin_lock(&locked->lock);
+	void* result = locked->tracked->reserve(size);
+	kigu__spin_unlock(&locked->lock);
+	return result;
+}
+
+local void bench_locked_release(void* context, void* ptr){
+	BenchLockedTracker* locked = (BenchLockedTracker*)context;
+	kigu__spin_lock(&locked->lock);
+	locked->tracked->release(ptr);
+	kigu__spin_unlock(&locked->lock);
+}
+
+local void* bench_locked_resize(void* context, void* ptr, upt size){
+	BenchLockedTracker* locked = (BenchLockedTracker*)context;
+	kigu__spin_lock(&locked->lock);
+	void* result = locked->tracked->resize(ptr, size);
+	kigu__spin_unlock(&locked->lock);
+	return result;
+}
+
+//runs `workload` with `allocator` twice (once timed and measuring RSS, once through a tracker to find the live bytes at the
+//peak) and prints a row of the results
+local void bench_run(BenchWorkloadInfo* workload, BenchAllocatorInfo* allocator){
+	//timed run
+	bench_rss_peak_reset();
+	upt rss_base = bench_rss_peak();
+	Allocator* a = allocator->begin();
+	BENCH_KIGU_TIMER_START(timer);
+	u64 ops = workload->run(a);
+	f64 ns = BENCH_KIGU_TIMER_END(timer);
+	allocator->end();
+	upt rss = bench_rss_peak() - rss_base;
+	
+	//tracked run
+	a = allocator->begin();
+	Tracker tracker;
+	tracker_init(&tracker, a);
+	if(workload->threaded){
+		BenchLockedTracker locked = {0, tracker_allocator(&tracker)};
+		Allocator* bound = allocator_bind(&locked, bench_locked_reserve, bench_locked_release, bench_locked_resize);
+		workload->run(bound);
+		allocator_unbind(bound);
+	}else{
+		workload->run(tracker_allocator(&tracker));
+	}
+	upt live = tracker_stats(&tracker).peak_bytes;
+	tracker_deinit(&tracker);
+	allocator->end();
+	
+	f64 frag = (rss > live) ? 1.0 - (f64)live / (f64)rss : 0.0;
+	printf("%-20s %-12s %10.2f %10.2f %-2s %7.1f%%\n", workload->name, allocator->name, ns / (f64)ops,
+		   (f64)rss / bytesDivisor(rss), (char*)bytesUnit(rss).str, frag * 100.0);
+	fflush(stdout);
+}
+
+int main(){
+	printf("%-20s %-12s %10s %13s %8s\n", "workload", "allocator", "ns/op", "rss", "frag");
+	fflush(stdout); //so forked children don't print it again
+	forX(w, ArrayCount(bench_workloads)){
+		forX(a, ArrayCount(bench_allocators)){
+			if(bench_allocators[a].large_only && !bench_workloads[w].large) continue;
+			if(!bench_allocators[a].thread_safe && bench_workloads[w].threaded) continue;
+#if OS_WINDOWS
+			bench_run(&bench_workloads[w], &bench_allocators[a]);
+#else
+			pid_t child = fork();
+			if(child == 0){
+				bench_run(&bench_workloads[w], &bench_allocators[a]);
+				_exit(0);
+			}
+			waitpid(child, 0, 0);
+#endif //#if OS_WINDOWS
+		}
+	}
+	return 0;
+}
@@ -570,13 +570,362 @@ local void TEST_kigu_cstring(){
 }
 
 #include "hash.h"
+struct TestHashPadded{ u8 kind; u64 id; str8 name; f32 weight; };
+#define TestHashPadded_members(X) X(kind) X(id) X(name)
+HASH_MEMBERS(TestHashPadded, TestHashPadded_members);
+struct TestHashPacked{ u32 x; u32 y; TestHashPadded* owner; };
+#define TestHashPacked_members(X) X(x) X(y) X(owner)
+HASH_MEMBERS(TestHashPacked, TestHashPacked_members);
+struct TestHashNested{ TestHashPacked cell; u16 layer; };
+#define TestHashNested_members(X) X(cell) X(layer)
+HASH_MEMBERS(TestHashNested, TestHashNested_members);
 local void TEST_kigu_hash(){
-	printf("[KIGU-TEST] TODO:   hash\n");
+	{//reference values (wyhash final 4 test vectors, seeded with their index)
+		const char* inputs[] = {"", "a", "abc", "message digest", "abcdefghijklmnopqrstuvwxyz",
+			"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789",
+			"12345678901234567890123456789012345678901234567890123456789012345678901234567890"};
+		u64 expected[] = {0x93228a4de0eec5a2, 0xc5bac3db178713c4, 0xa97f2f7b1d9b3314, 0x786d1f1df3801df4,
+			0xdca5a8138ad37c87, 0xb9e734f117cfaf70, 0x6cc5eab49a92d617};
+		forI(ArrayCount(inputs)){
+			AssertAlways(Hash64(inputs[i], strlen(inputs[i]), i) == expected[i]);
+			AssertAlways(str8_hash64(str8{(u8*)inputs[i], (s64)strlen(inputs[i])}, i) == expected[i]);
+		}
+	}
+	
+	{//the compile-time variants match the runtime ones
+		static_assert(str8_static_hash64("abc", 2) == 0xa97f2f7b1d9b3314, "");
+		static_assert(compile_time_string_hash("message digest") == (u32)str8_static_hash64("message digest"), "");
+		AssertAlways(hash<str8>{}(STR8("message digest")) == compile_time_string_hash("message digest"));
+		
+		char buffer[256];
+		forI(sizeof(buffer)) buffer[i] = (char)(i * 37 + 11);
+		forI(sizeof(buffer)){ //every length hits each of the tail cases
+			AssertAlways(Hash64(buffer, i, 7) == HashStatic64(buffer, i, 7));
+		}
+	}
+	
+	{//every byte and the seed change the hash
+		u8 buffer[100] = {};
+		u64 base = Hash64(buffer, sizeof(buffer));
+		AssertAlways(base != Hash64(buffer, sizeof(buffer), 1));
+		AssertAlways(base != Hash64(buffer, sizeof(buffer) - 1));
+		forI(sizeof(buffer)){
+			buffer[i] = 1;
+			AssertAlways(Hash64(buffer, sizeof(buffer)) != base);
+			buffer[i] = 0;
+		}
+	}
+	
+	{//small keys spread over the low bits that hash tables use
+		u32 buckets[256] = {};
+		forI(256*64){
+			buckets[hash<u32>{}((u32)i * 256) & 255] += 1;
+			AssertAlways(hash<u64>{}((u64)i) == hash<s64>{}((s64)i));
+		}
+		forI(256) AssertAlways(buckets[i] > 16 && buckets[i] < 128);
+		
+		int a, b;
+		AssertAlways(hash<int*>{}(&a) != hash<int*>{}(&b));
+		AssertAlways(hash<int*>{}(&a) == hash<int*>{}(&a));
+	}
+	
+	{//memberwise hashing ignores padding and unlisted members
+		alignas(TestHashPadded) u8 garbage[2][sizeof(TestHashPadded)];
+		memset(garbage[0], 0xAA, sizeof(TestHashPadded));
+		memset(garbage[1], 0x55, sizeof(TestHashPadded));
+		char name_copy[] = "grass";
+		TestHashPadded* a = (TestHashPadded*)garbage[0];
+		TestHashPadded* b = (TestHashPadded*)garbage[1];
+		a->kind = 3; a->id = 12345; a->name = STR8("grass"); a->weight = 1.0f;
+		b->kind = 3; b->id = 12345; b->name = str8{(u8*)name_copy, 5}; b->weight = 2.0f;
+		AssertAlways(memcmp(a, b, sizeof(TestHashPadded)) != 0);
+		AssertAlways(hash<TestHashPadded>{}(*a) == hash<TestHashPadded>{}(*b));
+		AssertAlways(hash_equal<TestHashPadded>{}(*a, *b));
+		b->id = 12346;
+		AssertAlways(hash<TestHashPadded>{}(*a) != hash<TestHashPadded>{}(*b));
+		AssertAlways(!hash_equal<TestHashPadded>{}(*a, *b));
+		
+		//types without padding are hashed as two words
+		TestHashPacked packed = {1, 2, a};
+		AssertAlways(hash<TestHashPacked>{}(packed) == (u32)kigu__hash_wide(&packed, sizeof(packed)));
+		TestHashPacked swapped = {2, 1, a};
+		AssertAlways(hash<TestHashPacked>{}(packed) != hash<TestHashPacked>{}(swapped));
+		AssertAlways(hash_equal<TestHashPacked>{}(packed, TestHashPacked{1, 2, a}));
+		
+		TestHashNested nested_a = {packed, 7}, nested_b = {swapped, 7};
+		AssertAlways(hash<TestHashNested>{}(nested_a) != hash<TestHashNested>{}(nested_b));
+		AssertAlways(hash_equal<TestHashNested>{}(nested_a, TestHashNested{{1, 2, a}, 7}));
+		
+		//combining depends on the order
+		AssertAlways(hash_combine(hash_combine(0, 1), 2) != hash_combine(hash_combine(0, 2), 1));
+	}
+	
+	{//streaming gives the same hash as hashing everything at once
+		u8 buffer[400];
+		forI(sizeof(buffer)) buffer[i] = (u8)(i * 89 + 3);
+		upt steps[] = {1, 3, 16, 17, 47, 48, 49, 100};
+		forX(length, sizeof(buffer)){
+			forX(step, ArrayCount(steps)){
+				hash_state state;
+				hash_state_init(&state, 5);
+				for(upt offset = 0; offset < (upt)length; offset += steps[step]){
+					hash_state_update(&state, buffer + offset, Min(steps[step], (upt)length - offset));
+				}
+				AssertAlways(hash_state_final(&state) == Hash64(buffer, length, 5));
+			}
+		}
+		
+		//pieces of a key, a growing dstr8, and a ring that wraps
+		hash_state state;
+		hash_state_init(&state);
+		hash_state_update_str8(&state, STR8("assets/"));
+		hash_state_update_str8(&state, STR8("textures/"));
+		AssertAlways(hash_state_final(&state) == str8_hash64(STR8("assets/textures/")));
+		hash_state_update_str8(&state, STR8("grass.png"));
+		AssertAlways(hash_state_final(&state) == str8_hash64(STR8("assets/textures/grass.png")));
+		
+		dstr8 builder;
+		dstr8_init(&builder, str8{}, stl_allocator);
+		hash_state_init(&state);
+		forI(100){
+			s64 before = builder.count;
+			dstr8_append(&builder, STR8("segment_"));
+			hash_state_update_str8(&state, str8{builder.str + before, builder.count - before});
+			AssertAlways(hash_state_final(&state) == str8_hash64(builder.fin));
+		}
+		dstr8_deinit(&builder);
+		
+		ring_array<u32> ring;
+		ring.init(37);
+		u32 values[60];
+		forI(60){ values[i] = i; ring.add((u32)i); }
+		hash_state_init(&state);
+		hash_state_update_ring(&state, &ring);
+		AssertAlways(ring.start != 0 && hash_state_final(&state) == Hash64(values + 23, 37*sizeof(u32)));
+		ring.free();
+	}
+	
+	{//crc32c gives the same checksums with and without hardware instructions
+		AssertAlways(hash_crc32c("123456789", 9) == 0xE3069283);
+		AssertAlways(kigu__hash_crc32c_software("123456789", 9, 0) == 0xE3069283);
+		AssertAlways(hash_crc32c("56789", 5, hash_crc32c("1234", 4)) == 0xE3069283);
+		
+		u8 buffer[300];
+		forI(sizeof(buffer)) buffer[i] = (u8)(i * 131 + 7);
+		forI(sizeof(buffer)) AssertAlways(hash_crc32c(buffer, i) == kigu__hash_crc32c_software(buffer, i, 0));
+	}
+	
+	{//aes hash changes with every length, byte, and seed
+		u8 buffer[300] = {};
+		u64 lengths[sizeof(buffer)];
+		forI(sizeof(buffer)){
+			lengths[i] = hash_aes64(buffer, i);
+			forX(j, i) AssertAlways(lengths[j] != lengths[i]);
+		}
+		u64 base = hash_aes64(buffer, sizeof(buffer));
+		AssertAlways(base == hash_aes64(buffer, sizeof(buffer)));
+		AssertAlways(base != hash_aes64(buffer, sizeof(buffer), 1));
+		forI(sizeof(buffer)){
+			buffer[i] = 0x80;
+			AssertAlways(hash_aes64(buffer, sizeof(buffer)) != base);
+			buffer[i] = 0;
+		}
+	}
 }
 
 #include "map.h"
+#include "vmem.h"
 local void TEST_kigu_map(){
-	printf("[KIGU-TEST] TODO:   map\n");
+	{//add, has, at, findkey
+		map<u64,u64> m;
+		forI(100000) AssertAlways(m.add((u64)i * 3, (u64)i) == i);
+		AssertAlways(m.count == 100000);
+		AssertAlways(IsPow2(m.slots.count) && m.count*100 <= m.slots.count*KIGU_MAP_MAX_LOAD_PERCENT);
+		forI(100000){
+			AssertAlways(m.has((u64)i * 3));
+			AssertAlways(!m.has((u64)i * 3 + 1));
+			AssertAlways(*m.at((u64)i * 3) == i);
+			AssertAlways(m.findkey((u64)i * 3) == i);
+			AssertAlways(m[(u64)i * 3] == i);
+		}
+		AssertAlways(m.at(1) == 0);
+		AssertAlways(m.findkey(1) == -1);
+		
+		//adding an existing key returns its index and doesn't change its value
+		AssertAlways(m.add(30, 5) == 10);
+		AssertAlways(*m.at(30) == 10);
+		AssertAlways(m.count == 100000);
+	}
+	
+	{//keys with the same hash don't alias
+		struct ZeroHash{ u32 operator()(const u32& v)const{ return 0; } };
+		map<u32,u32,ZeroHash> m;
+		forI(50) m.add(i, i+1);
+		forI(50) AssertAlways(*m.at(i) == i+1);
+		AssertAlways(!m.has(50));
+		m.remove(10);
+		forI(50) AssertAlways(m.has(i) == (i != 10));
+	}
+	
+	{//remove moves the last entry into the removed index and keeps every other key findable
+		map<u64,u64> m;
+		forI(10000) m.add(i, i);
+		for(u32 i = 0; i < 10000; i += 2) m.remove(i);
+		m.remove(1234567);
+		AssertAlways(m.count == 5000);
+		forI(10000){
+			if(i % 2){
+				AssertAlways(*m.at(i) == i);
+				AssertAlways(m.keys[m.findkey(i)] == i);
+			}else{
+				AssertAlways(!m.has(i));
+			}
+		}
+		for(u32 i = 1; i < 10000; i += 2) m.remove(i);
+		AssertAlways(m.count == 0);
+		forI(m.slots.count) AssertAlways(m.slots[i].index == 0);
+	}
+	
+	{//str8 keys compare their contents
+		map<str8,u32> m;
+		m.add(STR8("hello"), 1);
+		m.add(STR8("world"), 2);
+		char buffer[] = "hello";
+		AssertAlways(*m.at(str8{(u8*)buffer, 5}) == 1);
+		AssertAlways(!m.has(STR8("hell")));
+	}
+	
+	{//reserve, swap, clear
+		map<u32,u32> m;
+		m.reserve(1000);
+		u32 capacity = m.slots.count;
+		forI(1000) m.add(i, i);
+		AssertAlways(m.slots.count == capacity);
+		m.swap(0, 999);
+		AssertAlways(m.findkey(0) == 999 && m.findkey(999) == 0);
+		AssertAlways(m.data[0] == 999 && *m.at(0) == 0);
+		m.clear();
+		AssertAlways(m.count == 0 && !m.has(0));
+		m.add(7, 8);
+		AssertAlways(*m.at(7) == 8);
+	}
+	
+	{//incremental growth keeps every key findable while the old table is moved
+		map<u32,u32> m;
+		m.incremental = true;
+		u32 most_remaining = 0;
+		forI(200000){
+			m.add(i, i);
+			most_remaining = Max(most_remaining, m.migration_remaining());
+			if(m.migrating() && (i % 1000) == 0){
+				//removes and swaps while migrating work on keys in either table
+				AssertAlways(*m.at(i / 2) == i / 2 && m.has(i));
+				m.remove(i / 3 + 1);
+				AssertAlways(!m.has(i / 3 + 1));
+				m.add(i / 3 + 1, i / 3 + 1);
+				m.swap(m.findkey(i / 2), m.findkey(i));
+				AssertAlways(*m.at(i) == i && *m.at(i / 2) == i / 2);
+			}
+		}
+		AssertAlways(m.count == 200000 && m.migrations > 0 && most_remaining > 0);
+		forI(200000) AssertAlways(*m.at(i) == i);
+		while(m.migrating()) m.at(0);
+		forI(200000) AssertAlways(m.keys[m.findkey(i)] == i);
+		for(u32 i = 0; i < 200000; i += 2) m.remove(i);
+		AssertAlways(m.count == 100000);
+		forI(200000) AssertAlways(m.has(i) == (i % 2 == 1));
+		AssertAlways(m.migrated_entries >= 100000);
+	}
+	
+	{//batch inserts keep the first value of repeated keys and grow the table at most once
+		map<u64,u32> m;
+		m.add(5, 500);
+		arrayT<u64> keys;
+		arrayT<u32> values;
+		forI(100000){
+			keys.add((u64)i);
+			values.add(i);
+		}
+		keys.add(7);
+		values.add(123);
+		m.insert_batch(keys.data, values.data, keys.count);
+		AssertAlways(m.count == 100000 && *m.at(5) == 500 && *m.at(7) == 7);
+		AssertAlways(m.count*100 <= m.slots.count*KIGU_MAP_MAX_LOAD_PERCENT && m.slots.count <= 2*131072);
+		forI(100000) AssertAlways(m.has(i) && m.keys[m.findkey(i)] == i && m.hashes[m.findkey(i)] == hash<u64>{}(i));
+		AssertAlways(m.hashes.data[m.count] == 0); //hashes of skipped keys are cleared
+		
+		pair<u64,u32> pairs[] = {{1,10},{2,20},{1,11},{3,30}};
+		m.build_from(carray<pair<u64,u32>>{pairs, ArrayCount(pairs)});
+		AssertAlways(m.count == 3 && *m.at(1) == 10 && *m.at(2) == 20 && *m.at(3) == 30 && !m.has(5));
+		m.insert_batch(keys.data, values.data, 0);
+		AssertAlways(m.count == 3);
+		
+		map<u32,u32> incremental;
+		incremental.incremental = true;
+		forI(1000) incremental.add(i, i);
+		while(!incremental.migrating()) incremental.add(incremental.count, incremental.count);
+		u32 first = incremental.count;
+		arrayT<u32> more;
+		forI(5000) more.add(first + i);
+		incremental.insert_batch(more.data, more.data, more.count);
+		AssertAlways(!incremental.migrating() && incremental.count == first + 5000);
+		forI(first + 5000) AssertAlways(*incremental.at(i) == i);
+		
+		//with a stable allocator no add copies an array bigger than KIGU_MAP_STABLE_ARRAY_BYTES, moves more than
+		//  KIGU_MAP_MIGRATE_SLOTS slots of the old table, or releases more than KIGU_MAP_RELEASE_BYTES of it
+		map<u64,u64> big;
+		big.incremental = true;
+		big.stable_allocator = vmem_stable_allocator;
+		const u32 release_slots = (u32)(KIGU_MAP_RELEASE_BYTES / sizeof(MapSlot));
+		double worst = 0;
+		for(u64 i = 0; i < 2*1024*1024; i += 1){
+			u64* keys = big.keys.data;
+			u32 keys_space = big.keys.space;
+			Allocator* keys_allocator = big.keys.allocator;
+			b32 was_migrating = big.migrating();
+			u32 remaining = big.migration_remaining();
+			u32 old_space = big.old_slots.space;
+			u64 migrations = big.migrations;
+			TEST_KIGU_TIMER_START(timer);
+			big.add(i*2654435761ull, i);
+			double elapsed = TEST_KIGU_TIMER_END(timer);
+			if(elapsed > worst) worst = elapsed;
+			
+			if(keys_allocator == vmem_stable_allocator) AssertAlways(big.keys.data == keys);
+			if(big.keys.data != keys) AssertAlways((upt)keys_space*sizeof(u64) <= KIGU_MAP_STABLE_ARRAY_BYTES);
+			if(big.migrations != migrations){
+				u32 old_count = big.slots.count / 2; //the table doubled and its first slots were moved
+				AssertAlways(!was_migrating && big.migration_remaining() == Max(old_count, (u32)KIGU_MAP_MIGRATE_SLOTS) - KIGU_MAP_MIGRATE_SLOTS);
+			}else if(was_migrating){
+				AssertAlways(remaining - big.migration_remaining() == Min(remaining, (u32)KIGU_MAP_MIGRATE_SLOTS));
+			}else if(old_space){
+				AssertAlways(big.old_slots.space == ((old_space > release_slots) ? old_space - release_slots : 0));
+			}
+		}
+		AssertAlways(big.keys.allocator == vmem_stable_allocator && big.hashes.allocator == vmem_stable_allocator);
+		AssertAlways(big.data.allocator == vmem_stable_allocator && big.slots.allocator == vmem_stable_allocator);
+		AssertAlways(big.migrations > 0 && !big.migrating() && !big.old_slots.space);
+		AssertAlways(big.count == 2*1024*1024 && *big.at(12345*2654435761ull) == 12345);
+		print_verbose("[KIGU-TEST] worst incremental map add took %fms\n", worst);
+		
+		//without one the map only uses its own allocator
+		map<u64,u64> plain;
+		plain.incremental = true;
+		forI(300000) plain.add((u64)i, (u64)i);
+		AssertAlways(plain.keys.allocator == stl_allocator && plain.hashes.allocator == stl_allocator);
+		AssertAlways(plain.data.allocator == stl_allocator && plain.slots.allocator == stl_allocator);
+		AssertAlways(plain.old_slots.allocator == stl_allocator && !plain.old_slots.space);
+	}
+	
+	{//initializer list and set
+		map<u32,u32> m = {{1,10},{2,20},{3,30}};
+		AssertAlways(m.count == 3 && *m.at(2) == 20);
+		set<u32> s;
+		s.add(5, 5);
+		AssertAlways(s.has(5) && !s.has(6));
+	}
+	
+	printf("[KIGU-TEST] PASSED: map\n");
 }
 
 #include "optional.h"
@@ -838,8 +1187,51 @@ local void TEST_kigu_string(){
 }
 
 #include "string_utils.h"
+local u32 test_string_utils_reserves;
+local u32 test_string_utils_resizes;
+local void* TestStringUtilsReserve(upt size){ test_string_utils_reserves += 1; return calloc(1, size); }
+local void* TestStringUtilsResize(void* ptr, upt size){ test_string_utils_resizes += 1; return realloc(ptr, size); }
 local void TEST_kigu_string_utils(){
-	printf("[KIGU-TEST] TODO:   string_utils\n");
+	Allocator counting{TestStringUtilsReserve, Allocator_ChangeMemory_Noop, Allocator_ChangeMemory_Noop, free, TestStringUtilsResize,
+		0, AllocatorFlags_ZeroReserve, alignof(max_align_t)};
+	
+	{//to_dstr8v reserves the result once
+		test_string_utils_reserves = 0;
+		test_string_utils_resizes = 0;
+		dstr8 s = to_dstr8v(&counting, "x = ", 42, ", y = ", (u64)7, ", name = ", STR8("kigu"));
+		AssertAlways(test_string_utils_reserves == 1 && test_string_utils_resizes == 0);
+		AssertAlways(str8_equal_lazy(dstr8_peek(&s), STR8("x = 42, y = 7, name = kigu")));
+		AssertAlways(s.space >= s.count+1 && s.str[s.count] == '\0');
+		dstr8_deinit(&s);
+		
+		s = to_dstr8v(&counting, str8{});
+		AssertAlways(s.count == 0 && s.str && s.str[0] == '\0');
+		dstr8_deinit(&s);
+	}
+	
+	{//variadic dstr8_append grows the builder at most once
+		dstr8 s;
+		dstr8_init(&s, STR8("list:"), &counting);
+		test_string_utils_reserves = 0;
+		test_string_utils_resizes = 0;
+		dstr8_append(&s, " ", 1, " ", 2.5, " ", STR8("three"), " ", -4);
+		AssertAlways(test_string_utils_reserves == 0 && test_string_utils_resizes <= 1);
+		AssertAlways(str8_equal_lazy(dstr8_peek(&s), STR8("list: 1 2.5 three -4")));
+		dstr8_deinit(&s);
+	}
+	
+	{//results built on a scratch arena aren't popped by the nested scratch used for the pieces
+		Scratch outer = scratch_begin(0);
+		dstr8 s = to_dstr8v(outer.allocator, "a", 1, "b", 2);
+		dstr8_append(&s, "c", 3, "d", 4);
+		dstr8 t = to_dstr8v(outer.allocator, "after");
+		AssertAlways(str8_equal_lazy(dstr8_peek(&s), STR8("a1b2c3d4")));
+		AssertAlways(str8_equal_lazy(dstr8_peek(&t), STR8("after")));
+		AssertAlways(t.str >= s.str + s.count || t.str + t.count <= s.str); //the results don't overlap
+		scratch_end(outer);
+	}
+	
+	printf("[KIGU-TEST] PASSED: string_utils\n");
 }
 
 #include "pair.h"
@@ -1467,6 +1859,116 @@ local void TEST_kigu_utils(){
 	printf("[KIGU-TEST] TODO:   utils\n");
 }
 
+#include "arena.h"
+#include "slab.h"
+#include "tcache.h"
+#include "vmem.h"
+//defined in kigu_tests_linkage.cpp
+Arena* TEST_kigu_linkage_arena_create();
+void   TEST_kigu_linkage_arena_destroy(Arena* arena);
+Scratch TEST_kigu_linkage_scratch_begin(Allocator* conflict);
+Arena*  TEST_kigu_linkage_scratch_arena(u32 index);
+u32 TEST_kigu_linkage_crc32c(const char* string, upt count);
+//this translation unit's initializers run first, so this hashes before any of the other translation unit's initializers
+local u32 TEST_kigu_linkage_early_crc32c = TEST_kigu_linkage_crc32c("123456789", 9);
+void* TEST_kigu_linkage_slab_reserve(upt size);
+void  TEST_kigu_linkage_slab_release(void* ptr);
+void* TEST_kigu_linkage_tcache_reserve(upt size);
+void  TEST_kigu_linkage_tcache_release(void* ptr);
+void* TEST_kigu_linkage_vmem_huge_reserve(upt size);
+void  TEST_kigu_linkage_vmem_huge_release(void* ptr);
+upt   TEST_kigu_linkage_vmem_huge_count();
+local void TEST_kigu_linkage(){
+	{//// bound allocators ////
+		//an allocator bound in one translation unit can be used and unbound in the other, which frees its slot for both
+		Arena* a = TEST_kigu_linkage_arena_create();
+		AssertAlways(allocator_context(a->allocator) == a);
+		u8* bytes = (u8*)a->allocator->reserve(64);
+		AssertAlways(bytes >= a->start && bytes < a->cursor);
+		Allocator* bound = a->allocator;
+		arena_destroy(a);
+		
+		Arena* b = arena_create(Megabytes(1));
+		AssertAlways(arena_allocator(b) == bound && allocator_context(bound) == b);
+		TEST_kigu_linkage_arena_destroy(b);
+		Arena* c = TEST_kigu_linkage_arena_create();
+		AssertAlways(c->allocator == bound);
+		arena_destroy(c);
+	}
+	
+	{//// scratch arenas ////
+		//both translation units hand out the same scratch arenas, so a scratch from either is a conflict for the other
+		Scratch outer = TEST_kigu_linkage_scratch_begin(0);
+		Scratch inner = scratch_begin(outer.allocator);
+		AssertAlways(outer.arena == kigu__scratch_arenas[0] && inner.arena == kigu__scratch_arenas[1]);
+		Scratch again = TEST_kigu_linkage_scratch_begin(inner.allocator);
+		AssertAlways(again.arena == outer.arena && again.allocator == outer.allocator);
+		scratch_end(again);
+		scratch_end(inner);
+		scratch_end(outer);
+		scratch_release_thread();
+		AssertAlways(!TEST_kigu_linkage_scratch_arena(0) && !TEST_kigu_linkage_scratch_arena(1));
+	}
+	
+	{//// hash dispatch ////
+		//the hardware hash functions are picked by the first call, even if it comes from another translation unit's initializer
+		AssertAlways(TEST_kigu_linkage_early_crc32c == 0xE3069283);
+		AssertAlways(TEST_kigu_linkage_crc32c("123456789", 9) == hash_crc32c("123456789", 9));
+	}
+	
+	{//// slab ////
+		//blocks released in the other translation unit go back to the free list shared with this one
+		u8* a = (u8*)slab_allocator->reserve(100);
+		forI(100) a[i] = 0xff;
+		TEST_kigu_linkage_slab_release(a);
+		u8* b = (u8*)TEST_kigu_linkage_slab_reserve(100);
+		AssertAlways(b == a);
+		forI(100) AssertAlways(b[i] == 0);
+		slab_allocator->release(b);
+		AssertAlways(slab_allocator->reserve(100) == a);
+		slab_allocator->release(a);
+		
+		//directly mapped allocations too
+		u8* c = (u8*)TEST_kigu_linkage_slab_reserve(Megabytes(1));
+		AssertAlways(c != 0 && !kigu__slab_owns(c));
+		c[Megabytes(1)-1] = 1;
+		slab_allocator->release(c);
+	}
+	
+	{//// tcache ////
+		//the calling thread has one cache, so a block released in the other translation unit is the next one reserved here
+		u8* a = (u8*)tcache_allocator->reserve(48);
+		forI(48) a[i] = 0xff;
+		TEST_kigu_linkage_tcache_release(a);
+		u8* b = (u8*)tcache_allocator->reserve(48);
+		AssertAlways(b == a);
+		forI(48) AssertAlways(b[i] == 0);
+		tcache_allocator->release(b);
+		AssertAlways(TEST_kigu_linkage_tcache_reserve(48) == a);
+		TEST_kigu_linkage_tcache_release(a);
+		tcache_flush_thread();
+	}
+	
+	{//// vmem huge list ////
+		//both translation units see every huge allocation, and releasing the head of the list in either keeps it intact
+		upt base_count = vmem_huge_stats().allocation_count;
+		void* a = vmem_huge_allocator->reserve(KIGU_VMEM_HUGE_THRESHOLD);
+		void* b = TEST_kigu_linkage_vmem_huge_reserve(KIGU_VMEM_HUGE_THRESHOLD);
+		void* c = vmem_huge_allocator->reserve(KIGU_VMEM_HUGE_THRESHOLD);
+		AssertAlways(vmem_huge_stats().allocation_count == base_count + 3);
+		AssertAlways(TEST_kigu_linkage_vmem_huge_count() == base_count + 3);
+		TEST_kigu_linkage_vmem_huge_release(c);
+		AssertAlways(vmem_huge_stats().allocation_count == base_count + 2);
+		vmem_huge_allocator->release(b);
+		AssertAlways(TEST_kigu_linkage_vmem_huge_count() == base_count + 1);
+		TEST_kigu_linkage_vmem_huge_release(a);
+		AssertAlways(vmem_huge_stats().allocation_count == base_count);
+		AssertAlways(TEST_kigu_linkage_vmem_huge_count() == base_count);
+	}
+	
+	printf("[KIGU-TEST] PASSED: linkage\n");
+}
+
 local void TEST_kigu(){
 	TEST_kigu_array();
 	TEST_kigu_array_utils();
@@ -1482,4 +1984,5 @@ local void TEST_kigu(){
 	TEST_kigu_pair();
 	TEST_kigu_unicode();
 	TEST_kigu_utils();
+	TEST_kigu_linkage();
 }
\ No newline at end of file
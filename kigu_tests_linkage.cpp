@@ -0,0 +1,30 @@
+/* kigu linkage tests
+A second translation unit for kigu_tests.cpp, compile and link them together, eg:
+  g++ -std=c++17 kigu_tests.cpp kigu_tests_linkage.cpp
+
+Modules with process wide state must share it between every translation unit that includes them, so TEST_kigu_linkage() in
+kigu_tests.cpp releases memory reserved by the functions below and these release memory it reserved.
+*/
+#include "common.h"
+#include "arena.h"
+#include "hash.h"
+#include "slab.h"
+#include "tcache.h"
+#include "vmem.h"
+
+
+Arena* TEST_kigu_linkage_arena_create(){ Arena* arena = arena_create(Megabytes(1)); arena_allocator(arena); return arena; }
+void   TEST_kigu_linkage_arena_destroy(Arena* arena){ arena_destroy(arena); }
+Scratch TEST_kigu_linkage_scratch_begin(Allocator* conflict){ return scratch_begin(conflict); }
+Arena*  TEST_kigu_linkage_scratch_arena(u32 index){ return kigu__scratch_arenas[index]; }
+
+u32 TEST_kigu_linkage_crc32c(const char* string, upt count){ return hash_crc32c(string, count); }
+
+void* TEST_kigu_linkage_slab_reserve(upt size){ return slab_allocator->reserve(size); }
+void  TEST_kigu_linkage_slab_release(void* ptr){ slab_allocator->release(ptr); }
+void* TEST_kigu_linkage_tcache_reserve(upt size){ return tcache_allocator->reserve(size); }
+void  TEST_kigu_linkage_tcache_release(void* ptr){ tcache_allocator->release(ptr); }
+
+void* TEST_kigu_linkage_vmem_huge_reserve(upt size){ return vmem_huge_allocator->reserve(size); }
+void  TEST_kigu_linkage_vmem_huge_release(void* ptr){ vmem_huge_allocator->release(ptr); }
+upt   TEST_kigu_linkage_vmem_huge_count(){ return vmem_huge_stats().allocation_count; }
@@ -2,27 +2,80 @@
 #ifndef KIGU_MAP_H
 #define KIGU_MAP_H
 
+#ifndef KIGU_MAP_MIN_CAPACITY
+#  define KIGU_MAP_MIN_CAPACITY 16
+#endif
+#ifndef KIGU_MAP_MAX_LOAD_PERCENT
+#  define KIGU_MAP_MAX_LOAD_PERCENT 75 //the table grows once more than this percent of its slots are used
+#endif
+#ifndef KIGU_MAP_MIGRATE_SLOTS
+#  define KIGU_MAP_MIGRATE_SLOTS 32 //old slots moved to the new table by each add, remove, or at() of an incremental map
+#endif
+#ifndef KIGU_MAP_PREFETCH_DISTANCE
+#  define KIGU_MAP_PREFETCH_DISTANCE 8 //keys ahead of the current one whose slots insert_batch() prefetches
+#endif
+#ifndef KIGU_MAP_STABLE_ARRAY_BYTES
+#  define KIGU_MAP_STABLE_ARRAY_BYTES Megabytes(1) //arrays and tables bigger than this move to the map's `stable_allocator`
+#endif
+#ifndef KIGU_MAP_RELEASE_BYTES
+#  define KIGU_MAP_RELEASE_BYTES Kilobytes(256) //bytes of a moved old table released by each add, remove, or at()
+#endif
+
 #include "common.h"
 #include "arrayT.h"
 #include "hash.h"
 #include "pair.h"
 #include "profiling.h"
 
-template<typename Key, typename Value, typename HashStruct = hash<Key>>
+//NOTE keys, hashes, and values are stored densely (in insertion order until a remove) and are indexed by an open addressed
+//     table of slots using linear probing and backward shift deletion (so there are no tombstones outside of old tables)
+//NOTE removing a key moves the last key/value into its index, so indexes and pointers into the map are invalidated by
+//     remove, and pointers are invalidated by add
+//NOTE `incremental` maps don't rebuild the whole table when it grows: the old table is kept alongside the new one and every
+//     add, remove, at(), and operator[] moves KIGU_MAP_MIGRATE_SLOTS of its slots over, so no single add costs O(n). Keys
+//     removed from the old table before they're moved leave a KIGU__MAP_SLOT_REMOVED slot behind so the old table's probe
+//     runs stay intact
+//NOTE the dense arrays of an `incremental` map still grow by copying, unless its `stable_allocator` is set to an allocator
+//     that resizes in place (like vmem_stable_allocator from vmem.h). Then once an array would grow past
+//     KIGU_MAP_STABLE_ARRAY_BYTES it's moved to the stable allocator (one copy of at most that many bytes) and never copied
+//     again, tables bigger than that are reserved from it, and an old table from it keeps its space (with a count of zero)
+//     once it's been moved and is shrunk by KIGU_MAP_RELEASE_BYTES with every add, remove, and at(), since freeing it all at
+//     once takes time proportional to its size. Everything else (and every map without a stable allocator) uses `allocator`
+//NOTE insert_batch() and build_from() reserve room for every key up front (so the arrays and table grow at most once), hash
+//     every key in one pass, then insert them while prefetching the slots of the keys KIGU_MAP_PREFETCH_DISTANCE ahead. Keys
+//     that are already in the map (or repeated in the batch) keep their first value, like add()
+#define KIGU__MAP_SLOT_REMOVED 0xFFFFFFFF
+struct MapSlot{
+	u32 hash;
+	u32 index; //index into the dense arrays plus one, zero if the slot is empty
+};
+
+template<typename Key, typename Value, typename HashStruct = hash<Key>, typename EqualStruct = hash_equal<Key>>
 struct map{
-	arrayT<u32>   hashes;
-	arrayT<Value> data;
+	arrayT<u32>     hashes;
+	arrayT<Key>     keys;
+	arrayT<Value>   data;
+	arrayT<MapSlot> slots; //count is always zero or a power of two
 	u32 count;
-	
+	b32 incremental; //grow the table a few slots at a time (see above)
+	arrayT<MapSlot> old_slots; //table being moved into `slots`, empty unless migrating() or a moved table is being released
+	u32 migrate_cursor;   //slots of `old_slots` that have been moved
+	u64 migrations;       //number of times the table grew incrementally
+	u64 migrated_entries; //number of keys moved from an old table to a new one
+	Allocator* stable_allocator; //allocator that resizes in place, so an incremental map never copies (see above), 0 by default
+
 	map(Allocator* a = stl_allocator);
 	map(std::initializer_list<pair<Key,Value>> list, Allocator* a = stl_allocator);
-	
+
 	Value& operator[](const Key& key);
 	Value& operator[](u32 idx);
-	
+
 	void   clear();
+	void   reserve(u32 new_count); //makes room for `new_count` keys without growing
 	u32    add(const Key& key); //returns index of added or existing key
 	u32    add(const Key& key, const Value& value);
+	void   insert_batch(const Key* keys, const Value* values, u32 n); //adds `n` keys and values
+	void   build_from(carray<pair<Key,Value>> pairs); //replaces the contents with `pairs`
 	void   remove(const Key& key);
 	void   swap(u32 idx1, u32 idx2);
 	bool   has(const Key& key) const;
@@ -31,48 +84,271 @@ struct map{
 	Value* atIdx(u32 index);
 	Value  atIdxPtrVal(u32 index); //use when value is already a pointer
 	u32    findkey(const Key& key) const; //returns index of key if it exists
-	
+	bool   migrating() const{ return old_slots.count != 0; }
+	u32    migration_remaining() const{ return old_slots.count - migrate_cursor; } //slots of the old table left to move
+
+	u32  kigu__find_slot(const Key& key, u32 hashed) const; //returns the slot holding `key`, or -1
+	u32  kigu__find_old_slot(const Key& key, u32 hashed) const; //returns the slot of the old table holding `key`, or -1
+	MapSlot* kigu__find(const Key& key, u32 hashed); //returns the slot holding `key` in either table, or 0
+	const MapSlot* kigu__find(const Key& key, u32 hashed) const;
+	MapSlot* kigu__find_slot_of(u32 idx); //returns the slot holding index `idx` in either table
+	void kigu__insert_slot(u32 hashed, u32 idx);
+	void kigu__rehash(u32 new_capacity);
+	void kigu__migrate(u32 slot_count); //moves the next `slot_count` slots of the old table
+	void kigu__remove_index(u32 idx); //moves the last key/value into `idx` (its slot must already be gone)
+	void kigu__release_old_slots();
+	void kigu__release_old_slots_step(); //releases KIGU_MAP_RELEASE_BYTES of a moved old table
+	template<typename KeyOf, typename ValueOf> void kigu__insert_batch(u32 n, KeyOf key_of, ValueOf value_of);
+
 	Value* begin(){DPZoneScoped; return data.begin(); }
 	Value* end()  {DPZoneScoped; return data.end(); }
 	const Value* begin()const{DPZoneScoped; return data.begin(); }
 	const Value* end()  const{DPZoneScoped; return data.end(); }
 };
 
-template<typename Key, typename HashStruct = hash<Key>>
-using set = map<Key,Key,HashStruct>;
+template<typename Key, typename HashStruct = hash<Key>, typename EqualStruct = hash_equal<Key>>
+using set = map<Key,Key,HashStruct,EqualStruct>;
+
+//swaps the contents of two tables (arrayT only points to its own allocation, so its bytes can be swapped)
+FORCE_INLINE void
+kigu__map_swap_tables(arrayT<MapSlot>* a, arrayT<MapSlot>* b){
+	u8 temp[sizeof(arrayT<MapSlot>)];
+	memcpy(temp, (void*)a, sizeof(arrayT<MapSlot>));
+	memcpy((void*)a, (void*)b, sizeof(arrayT<MapSlot>));
+	memcpy((void*)b, temp, sizeof(arrayT<MapSlot>));
+}
+
+//returns the slot a hash starts probing from in a table of `mask`+1 slots
+//  the hash is multiplied so weak hashes (sequential integers, pointers) still spread over the table
+FORCE_INLINE u32
+kigu__map_home(u32 hashed, u32 mask){
+	return (u32)(((u64)hashed * 0x9E3779B97F4A7C15ull) >> 32) & mask;
+}
+
+//moves `array` to `stable` if growing it to `space` items would copy more than KIGU_MAP_STABLE_ARRAY_BYTES, so it grows without
+//  copying from then on
+template<typename T> FORCE_INLINE void
+kigu__map_stabilize(arrayT<T>* array, u32 space, Allocator* stable){
+	if(array->allocator == stable || space <= array->space || (upt)space*sizeof(T) <= KIGU_MAP_STABLE_ARRAY_BYTES) return;
+	if(array->data){
+		T* moved = (T*)allocator_reserve_aligned(stable, (upt)array->space*sizeof(T), arrayT<T>::alignment);
+		memcpy((void*)moved, (void*)array->data, (upt)array->count*sizeof(T));
+		if(!HasFlag(stable->flags, AllocatorFlags_ZeroReserve) || arrayT<T>::alignment > allocator_alignment(stable)){
+			memset((void*)(moved + array->count), 0, (upt)(array->space - array->count)*sizeof(T)); //arrayT expects zeroed space
+		}
+		allocator_release_aligned(array->allocator, array->data, arrayT<T>::alignment);
+		array->iter  = moved + (array->iter - array->first);
+		array->last  = moved + (array->last - array->first);
+		array->first = moved;
+		array->data  = moved;
+	}
+	array->allocator = stable;
+}
+
+/////////////////////
+//// @internals ////
+/////////////////////
+template<typename Key, typename Value, typename HashStruct, typename EqualStruct> inline u32 map<Key,Value,HashStruct,EqualStruct>::
+kigu__find_slot(const Key& key, u32 hashed)const{
+	if(!slots.count) return -1;
+	u32 mask = slots.count-1;
+	for(u32 i = kigu__map_home(hashed, mask);; i = (i+1) & mask){
+		const MapSlot& slot = slots.data[i];
+		if(!slot.index) return -1;
+		if(slot.hash == hashed && EqualStruct{}(keys.data[slot.index-1], key)) return i;
+	}
+}
+
+template<typename Key, typename Value, typename HashStruct, typename EqualStruct> inline u32 map<Key,Value,HashStruct,EqualStruct>::
+kigu__find_old_slot(const Key& key, u32 hashed)const{
+	if(!old_slots.count) return -1;
+	u32 mask = old_slots.count-1;
+	for(u32 i = kigu__map_home(hashed, mask);; i = (i+1) & mask){
+		const MapSlot& slot = old_slots.data[i];
+		if(!slot.index) return -1;
+		//slots before the cursor were already moved (and their indexes may be stale)
+		if(i >= migrate_cursor && slot.index != KIGU__MAP_SLOT_REMOVED && slot.hash == hashed
+		   && EqualStruct{}(keys.data[slot.index-1], key)) return i;
+	}
+}
+
+template<typename Key, typename Value, typename HashStruct, typename EqualStruct> inline MapSlot* map<Key,Value,HashStruct,EqualStruct>::
+kigu__find(const Key& key, u32 hashed){
+	u32 slot = kigu__find_slot(key, hashed);
+	if(slot != -1) return &slots.data[slot];
+	slot = kigu__find_old_slot(key, hashed);
+	if(slot != -1) return &old_slots.data[slot];
+	return 0;
+}
+
+template<typename Key, typename Value, typename HashStruct, typename EqualStruct> inline const MapSlot* map<Key,Value,HashStruct,EqualStruct>::
+kigu__find(const Key& key, u32 hashed)const{
+	return const_cast<map*>(this)->kigu__find(key, hashed);
+}
+
+template<typename Key, typename Value, typename HashStruct, typename EqualStruct> inline MapSlot* map<Key,Value,HashStruct,EqualStruct>::
+kigu__find_slot_of(u32 idx){
+	u32 mask = slots.count-1;
+	for(u32 i = kigu__map_home(hashes.data[idx], mask); slots.data[i].index; i = (i+1) & mask){
+		if(slots.data[i].index == idx+1) return &slots.data[i];
+	}
+	mask = old_slots.count-1;
+	for(u32 i = kigu__map_home(hashes.data[idx], mask);; i = (i+1) & mask){
+		if(i >= migrate_cursor && old_slots.data[i].index == idx+1) return &old_slots.data[i];
+	}
+}
+
+template<typename Key, typename Value, typename HashStruct, typename EqualStruct> inline void map<Key,Value,HashStruct,EqualStruct>::
+kigu__insert_slot(u32 hashed, u32 idx){
+	u32 mask = slots.count-1;
+	u32 i = kigu__map_home(hashed, mask);
+	while(slots.data[i].index) i = (i+1) & mask;
+	slots.data[i].hash  = hashed;
+	slots.data[i].index = idx+1;
+}
+
+template<typename Key, typename Value, typename HashStruct, typename EqualStruct> inline void map<Key,Value,HashStruct,EqualStruct>::
+kigu__rehash(u32 new_capacity){DPZoneScoped;
+	Assert(IsPow2(new_capacity) && (u64)count*100 <= (u64)new_capacity*KIGU_MAP_MAX_LOAD_PERCENT);
+	kigu__release_old_slots(); //every key is reinserted from the dense arrays anyways
+	slots.clear();
+	slots.resize(new_capacity);
+	forI(count) kigu__insert_slot(hashes.data[i], i);
+}
+
+template<typename Key, typename Value, typename HashStruct, typename EqualStruct> inline void map<Key,Value,HashStruct,EqualStruct>::
+kigu__migrate(u32 slot_count){DPZoneScoped;
+	u32 end = (slot_count < old_slots.count - migrate_cursor) ? migrate_cursor + slot_count : old_slots.count;
+	for(; migrate_cursor < end; migrate_cursor += 1){
+		MapSlot slot = old_slots.data[migrate_cursor];
+		if(slot.index && slot.index != KIGU__MAP_SLOT_REMOVED){
+			kigu__insert_slot(slot.hash, slot.index-1);
+			migrated_entries += 1;
+		}
+	}
+	if(migrate_cursor == old_slots.count){
+		if(stable_allocator && old_slots.allocator == stable_allocator){
+			old_slots.count = 0; //released a bit at a time by kigu__release_old_slots_step()
+			migrate_cursor = 0;
+		}else{
+			kigu__release_old_slots();
+		}
+	}
+}
+
+template<typename Key, typename Value, typename HashStruct, typename EqualStruct> inline void map<Key,Value,HashStruct,EqualStruct>::
+kigu__release_old_slots_step(){
+	upt size = (upt)old_slots.space*sizeof(MapSlot);
+	if(size <= KIGU_MAP_RELEASE_BYTES){
+		kigu__release_old_slots();
+		return;
+	}
+	old_slots.space -= (u32)(KIGU_MAP_RELEASE_BYTES/sizeof(MapSlot));
+	old_slots.data = (MapSlot*)allocator_resize_aligned(old_slots.allocator, old_slots.data, (upt)old_slots.space*sizeof(MapSlot), arrayT<MapSlot>::alignment);
+	old_slots.first = old_slots.data;
+	old_slots.iter  = old_slots.data;
+	old_slots.last  = old_slots.data;
+}
+
+template<typename Key, typename Value, typename HashStruct, typename EqualStruct> inline void map<Key,Value,HashStruct,EqualStruct>::
+kigu__release_old_slots(){
+	if(!old_slots.space) return;
+	arrayT<MapSlot> released(old_slots.allocator); //frees the old table when it goes out of scope
+	kigu__map_swap_tables(&released, &old_slots);
+	migrate_cursor = 0;
+}
+
+template<typename Key, typename Value, typename HashStruct, typename EqualStruct> template<typename KeyOf, typename ValueOf> inline void map<Key,Value,HashStruct,EqualStruct>::
+kigu__insert_batch(u32 n, KeyOf key_of, ValueOf value_of){DPZoneScoped;
+	if(!n) return;
+	if(old_slots.count) kigu__migrate(old_slots.count);
+	reserve(count + n);
+	
+	//the hashes are written past the end of `hashes` (which has room for all of them), every key added moves its hash down to
+	//  `count`, which is never past the hash of the key being added
+	u32 base = count;
+	u32* batch = hashes.data + base;
+	forI(n) batch[i] = HashStruct{}(key_of(i));
+	
+	u32 mask = slots.count-1;
+	forI(n){
+		if(i + KIGU_MAP_PREFETCH_DISTANCE < n) PrefetchRead(&slots.data[kigu__map_home(batch[i + KIGU_MAP_PREFETCH_DISTANCE], mask)]);
+		u32 hashed = batch[i];
+		if(kigu__find_slot(key_of(i), hashed) != -1) continue;
+		hashes.add(hashed);
+		keys.add(key_of(i));
+		data.add(value_of(i));
+		kigu__insert_slot(hashed, count);
+		count++;
+	}
+	if(count < base + n) memset(hashes.data + count, 0, (base + n - count)*sizeof(u32)); //arrayT expects zeroed space
+}
+
+template<typename Key, typename Value, typename HashStruct, typename EqualStruct> inline void map<Key,Value,HashStruct,EqualStruct>::
+kigu__remove_index(u32 idx){
+	u32 last = count-1;
+	if(idx != last){
+		kigu__find_slot_of(last)->index = idx+1;
+		hashes[idx] = hashes[last];
+		keys[idx]   = keys[last];
+		data[idx]   = data[last];
+	}
+	hashes.pop();
+	keys.pop();
+	data.pop();
+	count--;
+}
 
 //////////////////////
 //// @contructors ////
 //////////////////////
-template<typename Key, typename Value, typename HashStruct> inline map<Key,Value,HashStruct>::
+template<typename Key, typename Value, typename HashStruct, typename EqualStruct> inline map<Key,Value,HashStruct,EqualStruct>::
 map(Allocator* a){DPZoneScoped;
 	hashes.allocator = a;
+	keys.allocator = a;
 	data.allocator = a;
+	slots.allocator = a;
 	count = 0;
+	incremental = false;
+	old_slots.allocator = a;
+	migrate_cursor = 0;
+	migrations = 0;
+	migrated_entries = 0;
+	stable_allocator = 0;
 }
 
-template<typename Key, typename Value, typename HashStruct> inline map<Key,Value,HashStruct>::
+template<typename Key, typename Value, typename HashStruct, typename EqualStruct> inline map<Key,Value,HashStruct,EqualStruct>::
 map(std::initializer_list<pair<Key,Value>> list, Allocator* a){DPZoneScoped;
 	hashes.allocator = a;
+	keys.allocator = a;
 	data.allocator = a;
+	slots.allocator = a;
 	count = 0;
-	
-	for (auto& p : list){
-		add(p.first, p.second);
-	}
+	incremental = false;
+	old_slots.allocator = a;
+	migrate_cursor = 0;
+	migrations = 0;
+	migrated_entries = 0;
+	stable_allocator = 0;
+
+	const pair<Key,Value>* pairs = list.begin();
+	kigu__insert_batch((u32)list.size(), [pairs](u32 i) -> const Key&{ return pairs[i].first; },
+					   [pairs](u32 i) -> const Value&{ return pairs[i].second; });
 }
 
 ////////////////////
 //// @operators ////
 ////////////////////
-template<typename Key, typename Value, typename HashStruct> inline Value& map<Key,Value,HashStruct>::
+template<typename Key, typename Value, typename HashStruct, typename EqualStruct> inline Value& map<Key,Value,HashStruct,EqualStruct>::
 operator[](const Key& key){DPZoneScoped;
-	u32 hashed = HashStruct{}(key);
-	forI(hashes.count){ if(hashed == hashes[i]){ return data[i]; } }
+	if(old_slots.count) kigu__migrate(KIGU_MAP_MIGRATE_SLOTS);
+	else if(old_slots.space) kigu__release_old_slots_step();
+	MapSlot* slot = kigu__find(key, HashStruct{}(key));
+	if(slot){ return data[slot->index-1]; }
 	throw "nokey";
 }
 
-template<typename Key, typename Value, typename HashStruct> inline Value& map<Key,Value,HashStruct>::
+template<typename Key, typename Value, typename HashStruct, typename EqualStruct> inline Value& map<Key,Value,HashStruct,EqualStruct>::
 operator[](u32 idx){
 	return data[idx];
 }
@@ -80,90 +356,178 @@ operator[](u32 idx){
 ////////////////////
 //// @functions ////
 ////////////////////
-template<typename Key, typename Value, typename HashStruct> inline void map<Key,Value,HashStruct>::
+template<typename Key, typename Value, typename HashStruct, typename EqualStruct> inline void map<Key,Value,HashStruct,EqualStruct>::
 clear(){DPZoneScoped;
 	hashes.clear();
+	keys.clear();
 	data.clear();
+	if(slots.count) memset(slots.data, 0, slots.count*sizeof(MapSlot));
+	kigu__release_old_slots();
 	count = 0;
 }
 
-template<typename Key, typename Value, typename HashStruct> inline u32 map<Key,Value,HashStruct>::
+template<typename Key, typename Value, typename HashStruct, typename EqualStruct> inline void map<Key,Value,HashStruct,EqualStruct>::
+reserve(u32 new_count){DPZoneScoped;
+	if(incremental && stable_allocator){
+		kigu__map_stabilize(&hashes, new_count, stable_allocator);
+		kigu__map_stabilize(&keys, new_count, stable_allocator);
+		kigu__map_stabilize(&data, new_count, stable_allocator);
+	}
+	hashes.reserve(new_count);
+	keys.reserve(new_count);
+	data.reserve(new_count);
+
+	u32 capacity = (slots.count) ? slots.count : KIGU_MAP_MIN_CAPACITY;
+	while((u64)new_count*100 > (u64)capacity*KIGU_MAP_MAX_LOAD_PERCENT) capacity *= 2;
+	if(capacity > slots.count) kigu__rehash(capacity);
+}
+
+template<typename Key, typename Value, typename HashStruct, typename EqualStruct> inline u32 map<Key,Value,HashStruct,EqualStruct>::
 add(const Key& key){DPZoneScoped;
-	u32 hashed = HashStruct{}(key);
-	forI(hashes.count){ if(hashed == hashes[i]){ return i; } }
-	hashes.add(hashed);
-	data.add(Value());
-	count++;
-	return count-1;
+	return add(key, Value());
 }
 
-template<typename Key, typename Value, typename HashStruct> inline u32 map<Key,Value,HashStruct>::
+template<typename Key, typename Value, typename HashStruct, typename EqualStruct> inline u32 map<Key,Value,HashStruct,EqualStruct>::
 add(const Key& key, const Value& value){DPZoneScoped;
 	u32 hashed = HashStruct{}(key);
-	forI(hashes.count){ if(hashed == hashes[i]){ return i; } }
+	MapSlot* slot = kigu__find(key, hashed);
+	if(slot){ return slot->index-1; }
+
+	if(old_slots.count) kigu__migrate(KIGU_MAP_MIGRATE_SLOTS);
+	else if(old_slots.space) kigu__release_old_slots_step();
+	if(!slots.count || (u64)(count+1)*100 > (u64)slots.count*KIGU_MAP_MAX_LOAD_PERCENT){
+		if(incremental && slots.count){
+			//the old table is always moved before the new one fills up, unless KIGU_MAP_MIGRATE_SLOTS is tiny
+			if(old_slots.count) kigu__migrate(old_slots.count);
+			kigu__release_old_slots();
+			
+			//the new table is reserved zeroed rather than resized and memset, since large calloc()s are zeroed by the OS as
+			//their pages are touched
+			u32 capacity = slots.count*2;
+			Allocator* table_allocator = slots.allocator;
+			if(stable_allocator && (upt)capacity*sizeof(MapSlot) > KIGU_MAP_STABLE_ARRAY_BYTES) table_allocator = stable_allocator;
+			arrayT<MapSlot> grown(capacity, table_allocator);
+			if(!HasFlag(table_allocator->flags, AllocatorFlags_ZeroReserve) || arrayT<MapSlot>::alignment > allocator_alignment(table_allocator)){
+				memset(grown.data, 0, capacity*sizeof(MapSlot));
+			}
+			grown.count = capacity;
+			grown.first = grown.data;
+			grown.iter  = grown.data;
+			grown.last  = grown.data + (capacity-1);
+			kigu__map_swap_tables(&slots, &old_slots);
+			kigu__map_swap_tables(&slots, &grown);
+			migrate_cursor = 0;
+			migrations += 1;
+			kigu__migrate(KIGU_MAP_MIGRATE_SLOTS);
+		}else{
+			kigu__rehash((slots.count) ? slots.count*2 : KIGU_MAP_MIN_CAPACITY);
+		}
+	}
+	if(incremental && stable_allocator && count == hashes.space){
+		kigu__map_stabilize(&hashes, count*KIGU_ARRAY_GROWTH_FACTOR, stable_allocator);
+		kigu__map_stabilize(&keys, count*KIGU_ARRAY_GROWTH_FACTOR, stable_allocator);
+		kigu__map_stabilize(&data, count*KIGU_ARRAY_GROWTH_FACTOR, stable_allocator);
+	}
 	hashes.add(hashed);
+	keys.add(key);
 	data.add(value);
+	kigu__insert_slot(hashed, count);
 	count++;
 	return count-1;
 }
 
-template<typename Key, typename Value, typename HashStruct> inline void map<Key,Value,HashStruct>::
+template<typename Key, typename Value, typename HashStruct, typename EqualStruct> inline void map<Key,Value,HashStruct,EqualStruct>::
+insert_batch(const Key* in_keys, const Value* values, u32 n){
+	kigu__insert_batch(n, [in_keys](u32 i) -> const Key&{ return in_keys[i]; }, [values](u32 i) -> const Value&{ return values[i]; });
+}
+
+template<typename Key, typename Value, typename HashStruct, typename EqualStruct> inline void map<Key,Value,HashStruct,EqualStruct>::
+build_from(carray<pair<Key,Value>> pairs){
+	clear();
+	pair<Key,Value>* p = pairs.data;
+	kigu__insert_batch((u32)pairs.count, [p](u32 i) -> const Key&{ return p[i].first; }, [p](u32 i) -> const Value&{ return p[i].second; });
+}
+
+template<typename Key, typename Value, typename HashStruct, typename EqualStruct> inline void map<Key,Value,HashStruct,EqualStruct>::
 remove(const Key& key){DPZoneScoped;
+	if(old_slots.count) kigu__migrate(KIGU_MAP_MIGRATE_SLOTS);
+	else if(old_slots.space) kigu__release_old_slots_step();
 	u32 hashed = HashStruct{}(key);
-	forI(hashes.count){
-		if(hashed == hashes[i]){
-			data.remove(i);
-			hashes.remove(i);
-			count--;
-			return;
+	u32 slot = kigu__find_slot(key, hashed);
+	if(slot == -1){
+		//keys that are still in the old table are marked removed, since its slots can't shift while it's being moved
+		u32 old_slot = kigu__find_old_slot(key, hashed);
+		if(old_slot == -1) return;
+		kigu__remove_index(old_slots.data[old_slot].index-1);
+		old_slots.data[old_slot].index = KIGU__MAP_SLOT_REMOVED;
+		return;
+	}
+	u32 idx = slots.data[slot].index-1;
+
+	//backward shift deletion: pull later entries of the probe run back into the hole, stopping at an empty slot or an entry
+	//that is already at its home slot
+	u32 mask = slots.count-1;
+	u32 hole = slot;
+	for(u32 i = (hole+1) & mask; slots.data[i].index; i = (i+1) & mask){
+		u32 home = kigu__map_home(slots.data[i].hash, mask);
+		if(((i - home) & mask) >= ((i - hole) & mask)){
+			slots.data[hole] = slots.data[i];
+			hole = i;
 		}
 	}
+	slots.data[hole] = MapSlot{};
+	kigu__remove_index(idx);
 }
 
-template<typename Key, typename Value, typename HashStruct> inline void map<Key,Value,HashStruct>::
+template<typename Key, typename Value, typename HashStruct, typename EqualStruct> inline void map<Key,Value,HashStruct,EqualStruct>::
 swap(u32 idx1, u32 idx2){DPZoneScoped;
+	MapSlot* slot1 = kigu__find_slot_of(idx1);
+	MapSlot* slot2 = kigu__find_slot_of(idx2);
+	slot1->index = idx2+1;
+	slot2->index = idx1+1;
 	hashes.swap(idx1, idx2);
+	keys.swap(idx1, idx2);
 	data.swap(idx1, idx2);
 }
 
-template<typename Key, typename Value, typename HashStruct> inline bool map<Key,Value,HashStruct>::
+template<typename Key, typename Value, typename HashStruct, typename EqualStruct> inline bool map<Key,Value,HashStruct,EqualStruct>::
 has(const Key& key)const{DPZoneScoped;
-	u32 hashed = HashStruct{}(key);
-	forI(hashes.count){ if(hashed == hashes[i]){ return true; } }
-	return false;
+	return kigu__find(key, HashStruct{}(key)) != 0;
 }
 
-template<typename Key, typename Value, typename HashStruct> inline Value* map<Key,Value,HashStruct>::
+template<typename Key, typename Value, typename HashStruct, typename EqualStruct> inline Value* map<Key,Value,HashStruct,EqualStruct>::
 at(const Key& key){DPZoneScoped;
-	u32 hashed = HashStruct{}(key);
-	forI(hashes.count){ if(hashed == hashes[i]){ return &data[i]; } }
+	if(old_slots.count) kigu__migrate(KIGU_MAP_MIGRATE_SLOTS);
+	else if(old_slots.space) kigu__release_old_slots_step();
+	MapSlot* slot = kigu__find(key, HashStruct{}(key));
+	if(slot){ return &data[slot->index-1]; }
 	return 0;
 }
 
-template<typename Key, typename Value, typename HashStruct> inline Value map<Key,Value,HashStruct>::
+template<typename Key, typename Value, typename HashStruct, typename EqualStruct> inline Value map<Key,Value,HashStruct,EqualStruct>::
 atPtrVal(const Key& key){DPZoneScoped;
-	u32 hashed = HashStruct{}(key);
-	forI(hashes.count){ if(hashed == hashes[i]){ return data[i]; } }
+	MapSlot* slot = kigu__find(key, HashStruct{}(key));
+	if(slot){ return data[slot->index-1]; }
 	return 0;
 }
 
-template<typename Key, typename Value, typename HashStruct> inline Value* map<Key,Value,HashStruct>::
+template<typename Key, typename Value, typename HashStruct, typename EqualStruct> inline Value* map<Key,Value,HashStruct,EqualStruct>::
 atIdx(u32 index){DPZoneScoped;
 	return &data[index];
 }
 
-template<typename Key, typename Value, typename HashStruct> inline Value map<Key,Value,HashStruct>::
+template<typename Key, typename Value, typename HashStruct, typename EqualStruct> inline Value map<Key,Value,HashStruct,EqualStruct>::
 atIdxPtrVal(u32 index){DPZoneScoped;
 	return data[index];
 }
 
 
-template<typename Key, typename Value, typename HashStruct> inline u32 map<Key,Value,HashStruct>::
+template<typename Key, typename Value, typename HashStruct, typename EqualStruct> inline u32 map<Key,Value,HashStruct,EqualStruct>::
 findkey(const Key& key)const{
-	u32 hashed = HashStruct{}(key);
-	forI(hashes.count){ if(hashed == hashes[i]){ return i; } }
+	const MapSlot* slot = kigu__find(key, HashStruct{}(key));
+	if(slot){ return slot->index-1; }
 	return -1;
 }
 
 
-#endif //KIGU_MAP_H
\ No newline at end of file
+#endif //KIGU_MAP_H
@@ -0,0 +1,429 @@
+/* kigu map_image module
+WHAT:
+This module serializes a kigu `map` into a flat binary image that can be searched in place: the header, slot table, keys,
+values, and string contents are laid out back to back and refer to each other by offsets from the start of the image, so the
+image works wherever it's loaded. map_image_open() maps an image file into memory and a `map_image` answers lookups straight
+from the mapped pages.
+
+WHY:
+Large lookup tables (`map<str8,u32>` and the like) were rebuilt from text at every process start, which took seconds. Building
+the image once and mapping it makes startup O(1) (pages are read in as they're touched), and every process on the machine
+that maps the same file shares one copy of it in the page cache.
+
+NOTES:
+- Image layout (every section starts on a KIGU_MAP_IMAGE_ALIGNMENT boundary):
+    MapImageHeader
+    MapSlot slots[slot_count]   //same open addressed table as `map` (kigu__map_home() and linear probing), at most half full
+    stored  keys[count]         //map_image_key<Key>::stored
+    Value   values[count]
+    u8      strings[]           //contents of str8 keys, each null-terminated
+- Values and keys other than str8 are copied byte for byte, so they must be trivially copyable and can't be pointers (which
+  wouldn't mean anything in another process). Specialize map_image_key<> for other key types that point to their contents.
+- Slots store the hash the map computed, and lookups hash with the same HashStruct, so HashStruct must give the same result
+  in every process (the default hash<> does; hash_aes64() and hashes of addresses don't).
+- Images are written in the byte order of the machine that built them and rejected on a machine with the other byte order.
+- map_image_from_memory() and map_image_open() only check the header, which is O(1). Images that might be corrupt or come
+  from somewhere untrusted should be checked with map_image_validate() first, which compares a CRC32C of the whole image.
+- A `map_image` never writes to its image, and nothing in it needs to be fixed up after loading, so it can be used from any
+  number of threads at once.
+
+INDEX:
+@map_image
+  KIGU_MAP_IMAGE_MAGIC
+  KIGU_MAP_IMAGE_VERSION
+  KIGU_MAP_IMAGE_ALIGNMENT
+  MapImageHeader: struct
+  map_image_key<Key>
+    stored: type
+    store(const Key& key, arrayT<u8>* strings) -> stored
+    load(const stored& key, const u8* strings) -> Key
+  map_image<Key,Value,HashStruct,EqualStruct>
+    at(const Key& key) -> const Value*
+    has(const Key& key) -> bool
+    findkey(const Key& key) -> u32
+    key(u32 index) -> Key
+    value(u32 index) -> const Value&
+@map_image_build
+  map_image_build(map<Key,Value,HashStruct,EqualStruct>* m, upt* out_size, Allocator* allocator) -> void*
+  map_image_write_file(const char* path, const void* image, upt size) -> b32
+@map_image_load
+  map_image_validate(const void* data, upt size) -> b32
+  map_image_from_memory(map_image<Key,Value,HashStruct,EqualStruct>* image, const void* data, upt size) -> b32
+  map_image_open(map_image<Key,Value,HashStruct,EqualStruct>* image, const char* path) -> b32
+  map_image_close(map_image<Key,Value,HashStruct,EqualStruct>* image) -> void
+@map_image_tests
+*/
+#pragma once
+#ifndef KIGU_MAP_IMAGE_H
+#define KIGU_MAP_IMAGE_H
+
+
+#ifndef KIGU_MAP_IMAGE_ALIGNMENT
+#  define KIGU_MAP_IMAGE_ALIGNMENT 16 //alignment of each section of an image (and of the image itself)
+#endif
+
+
+#include <cstdio>
+#include <type_traits>
+#include "common.h"
+#include "memory.h"
+#include "arrayT.h"
+#include "unicode.h"
+#include "hash.h"
+#include "map.h"
+#include "profiling.h"
+
+
+//-////////////////////////////////////////////////////////////////////////////////////////////////
+//// @map_image
+
+
+#define KIGU_MAP_IMAGE_MAGIC   0x50414D4B //"KMAP" in little endian (and "PAMK" in big endian, which fails the check)
+#define KIGU_MAP_IMAGE_VERSION 1
+
+struct MapImageHeader{
+	u32 magic;
+	u32 version;
+	u64 size; //bytes in the whole image, including this header
+	u32 count;
+	u32 slot_count; //always a power of two
+	u32 key_size;   //sizeof(map_image_key<Key>::stored), to catch loading an image with the wrong types
+	u32 value_size;
+	u64 slots_offset; //offsets of each section from the start of the image
+	u64 keys_offset;
+	u64 values_offset;
+	u64 strings_offset;
+	u64 strings_size;
+	u32 checksum; //hash_crc32c() of everything after the header
+	u32 reserved;
+};
+
+//How keys are stored in an image: by default the key itself, copied byte for byte
+template<typename Key>
+struct map_image_key{
+	static_assert(std::is_trivially_copyable<Key>::value && !std::is_pointer<Key>::value,
+				  "map_image keys must be trivially copyable and not pointers (specialize map_image_key<> otherwise)");
+	typedef Key stored;
+	static stored store(const Key& key, arrayT<u8>* strings){ return key; }
+	static Key    load(const stored& key, const u8* strings){ return key; }
+};
+
+//str8 keys are stored as an offset into the image's strings, and loaded as a str8 pointing into the image
+template<>
+struct map_image_key<str8>{
+	struct stored{ u64 offset; u64 count; };
+	static stored store(const str8& key, arrayT<u8>* strings){
+		stored result{strings->count, (u64)key.count};
+		forI(key.count) strings->add(key.str[i]);
+		strings->add('\0');
+		return result;
+	}
+	static str8 load(const stored& key, const u8* strings){ return str8{(u8*)strings + key.offset, (s64)key.count}; }
+};
+
+template<typename Key, typename Value, typename HashStruct = hash<Key>, typename EqualStruct = hash_equal<Key>>
+struct map_image{
+	typedef typename map_image_key<Key>::stored stored;
+	
+	const MapImageHeader* header;
+	const MapSlot* slots;
+	const stored*  keys;
+	const Value*   values;
+	const u8*      strings;
+	u32 count;
+	void* mapping; //memory mapped by map_image_open(), zero if the image came from map_image_from_memory()
+	upt   mapping_size;
+	
+	//Returns the index of `key` in the image, or -1 if it's not in it
+	u32 findkey(const Key& key)const{DPZoneScoped;
+		if(!count) return -1;
+		u32 hashed = HashStruct{}(key);
+		u32 mask = header->slot_count-1;
+		for(u32 i = kigu__map_home(hashed, mask);; i = (i+1) & mask){
+			const MapSlot& slot = slots[i];
+			if(!slot.index) return -1;
+			if(slot.hash == hashed && EqualStruct{}(map_image_key<Key>::load(keys[slot.index-1], strings), key)) return slot.index-1;
+		}
+	}
+	
+	//Returns a pointer to the value of `key` in the image, or 0 if it's not in it
+	const Value* at(const Key& key)const{
+		u32 index = findkey(key);
+		return (index != -1) ? &values[index] : 0;
+	}
+	
+	//Returns true if `key` is in the image
+	bool has(const Key& key)const{ return findkey(key) != -1; }
+	
+	//Returns the key at `index` (keys are in the map's order when the image was built)
+	Key key(u32 index)const{
+		Assert(index < count);
+		return map_image_key<Key>::load(keys[index], strings);
+	}
+	
+	//Returns the value at `index`
+	const Value& value(u32 index)const{
+		Assert(index < count);
+		return values[index];
+	}
+};
+
+
+//-////////////////////////////////////////////////////////////////////////////////////////////////
+//// @map_image_build
+
+
+//Returns an image of `m` reserved from `allocator` and sets `out_size` to its size in bytes, the image must be released with
+//  allocator_release_aligned(allocator, image, KIGU_MAP_IMAGE_ALIGNMENT)
+template<typename Key, typename Value, typename HashStruct, typename EqualStruct> global void*
+map_image_build(map<Key,Value,HashStruct,EqualStruct>* m, upt* out_size, Allocator* allocator = stl_allocator){DPZoneScoped;
+	typedef typename map_image_key<Key>::stored stored;
+	static_assert(std::is_trivially_copyable<Value>::value && !std::is_pointer<Value>::value,
+				  "map_image values must be trivially copyable and not pointers");
+	static_assert(alignof(stored) <= KIGU_MAP_IMAGE_ALIGNMENT && alignof(Value) <= KIGU_MAP_IMAGE_ALIGNMENT,
+				  "map_image keys and values can't be aligned more than KIGU_MAP_IMAGE_ALIGNMENT");
+	
+	u32 slot_count = 16;
+	while(slot_count < 2*(u64)m->count) slot_count *= 2;
+	
+	arrayT<u8> strings;
+	arrayT<stored> keys(m->count);
+	forI(m->count) keys.add(map_image_key<Key>::store(m->keys.data[i], &strings));
+	
+	MapImageHeader header{};
+	header.magic          = KIGU_MAP_IMAGE_MAGIC;
+	header.version        = KIGU_MAP_IMAGE_VERSION;
+	header.count          = m->count;
+	header.slot_count     = slot_count;
+	header.key_size       = sizeof(stored);
+	header.value_size     = sizeof(Value);
+	header.slots_offset   = AlignToPow2((u64)sizeof(MapImageHeader), KIGU_MAP_IMAGE_ALIGNMENT);
+	header.keys_offset    = AlignToPow2(header.slots_offset + (u64)slot_count*sizeof(MapSlot), KIGU_MAP_IMAGE_ALIGNMENT);
+	header.values_offset  = AlignToPow2(header.keys_offset + (u64)m->count*sizeof(stored), KIGU_MAP_IMAGE_ALIGNMENT);
+	header.strings_offset = AlignToPow2(header.values_offset + (u64)m->count*sizeof(Value), KIGU_MAP_IMAGE_ALIGNMENT);
+	header.strings_size   = strings.count;
+	header.size           = header.strings_offset + header.strings_size;
+	
+	//padding is zeroed so the same map always gives the same image
+	u8* image = (u8*)allocator_reserve_aligned(allocator, header.size, KIGU_MAP_IMAGE_ALIGNMENT);
+	if(!image) return 0;
+	ZeroMemory(image, header.size);
+	
+	//slots are rebuilt from the dense arrays (rather than copied) so the image doesn't depend on the map being mid migration
+	MapSlot* slots = (MapSlot*)(image + header.slots_offset);
+	forI(m->count){
+		u32 hashed = m->hashes.data[i];
+		u32 slot = kigu__map_home(hashed, slot_count-1);
+		while(slots[slot].index) slot = (slot+1) & (slot_count-1);
+		slots[slot].hash  = hashed;
+		slots[slot].index = i+1;
+	}
+	if(m->count){
+		CopyMemory(image + header.keys_offset, keys.data, m->count*sizeof(stored));
+		CopyMemory(image + header.values_offset, m->data.data, m->count*sizeof(Value));
+	}
+	if(strings.count) CopyMemory(image + header.strings_offset, strings.data, strings.count);
+	
+	header.checksum = hash_crc32c(image + sizeof(MapImageHeader), header.size - sizeof(MapImageHeader));
+	CopyMemory(image, &header, sizeof(MapImageHeader));
+	*out_size = header.size;
+	return image;
+}
+
+
+//Writes `size` bytes of `image` to the file at `path`, replacing it, returns false if it couldn't be written
+global b32
+map_image_write_file(const char* path, const void* image, upt size){DPZoneScoped;
+	FILE* file = fopen(path, "wb");
+	if(!file) return false;
+	b32 result = (fwrite(image, 1, size, file) == size);
+	if(fclose(file) != 0) result = false;
+	return result;
+}
+
+
+//-////////////////////////////////////////////////////////////////////////////////////////////////
+//// @map_image_load
+
+
+//Returns true if the `size` bytes at `data` have a valid image header and the image's contents match its checksum
+global b32
+map_image_validate(const void* data, upt size){DPZoneScoped;
+	if(size < sizeof(MapImageHeader)) return false;
+	const MapImageHeader* header = (const MapImageHeader*)data;
+	if(header->magic != KIGU_MAP_IMAGE_MAGIC || header->version != KIGU_MAP_IMAGE_VERSION) return false;
+	if(header->size < sizeof(MapImageHeader) || header->size > size) return false;
+	return hash_crc32c((const u8*)data + sizeof(MapImageHeader), header->size - sizeof(MapImageHeader)) == header->checksum;
+}
+
+
+//Points `image` at the image in the `size` bytes at `data`, which must stay valid (and unchanged) while `image` is used,
+//  returns false if the header isn't valid for these key and value types
+//NOTE only the header is checked, see map_image_validate()
+template<typename Key, typename Value, typename HashStruct, typename EqualStruct> global b32
+map_image_from_memory(map_image<Key,Value,HashStruct,EqualStruct>* image, const void* data, upt size){DPZoneScoped;
+	typedef typename map_image_key<Key>::stored stored;
+	*image = map_image<Key,Value,HashStruct,EqualStruct>{};
+	if(!data || ((upt)data & (KIGU_MAP_IMAGE_ALIGNMENT-1)) || size < sizeof(MapImageHeader)) return false;
+	
+	const MapImageHeader* header = (const MapImageHeader*)data;
+	if(header->magic != KIGU_MAP_IMAGE_MAGIC || header->version != KIGU_MAP_IMAGE_VERSION) return false;
+	if(header->key_size != sizeof(stored) || header->value_size != sizeof(Value)) return false;
+	if(header->size > size || !IsPow2(header->slot_count) || (u64)header->count >= header->slot_count) return false;
+	if(header->slots_offset < sizeof(MapImageHeader)
+	   || header->keys_offset    < header->slots_offset + (u64)header->slot_count*sizeof(MapSlot)
+	   || header->values_offset  < header->keys_offset + (u64)header->count*sizeof(stored)
+	   || header->strings_offset < header->values_offset + (u64)header->count*sizeof(Value)
+	   || header->strings_offset + header->strings_size > header->size) return false;
+	if((header->slots_offset | header->keys_offset | header->values_offset) & (KIGU_MAP_IMAGE_ALIGNMENT-1)) return false;
+	
+	const u8* base = (const u8*)data;
+	image->header  = header;
+	image->slots   = (const MapSlot*)(base + header->slots_offset);
+	image->keys    = (const stored*)(base + header->keys_offset);
+	image->values  = (const Value*)(base + header->values_offset);
+	image->strings = base + header->strings_offset;
+	image->count   = header->count;
+	return true;
+}
+
+
+//Maps the image file at `path` into memory and points `image` at it, returns false if it can't be mapped or its header isn't
+//  valid for these key and value types
+//NOTE only the header is checked, see map_image_validate()
+template<typename Key, typename Value, typename HashStruct, typename EqualStruct> global b32
+map_image_open(map_image<Key,Value,HashStruct,EqualStruct>* image, const char* path){DPZoneScoped;
+	upt size = 0;
+	void* data = os_file_map(path, &size);
+	if(!data || !map_image_from_memory(image, data, size)){
+		if(data) os_file_unmap(data, size);
+		*image = map_image<Key,Value,HashStruct,EqualStruct>{};
+		return false;
+	}
+	image->mapping = data;
+	image->mapping_size = size;
+	return true;
+}
+
+
+//Unmaps the file mapped by map_image_open() (if any) and clears `image`
+template<typename Key, typename Value, typename HashStruct, typename EqualStruct> global void
+map_image_close(map_image<Key,Value,HashStruct,EqualStruct>* image){DPZoneScoped;
+	if(image->mapping) os_file_unmap(image->mapping, image->mapping_size);
+	*image = map_image<Key,Value,HashStruct,EqualStruct>{};
+}
+
+
+//-////////////////////////////////////////////////////////////////////////////////////////////////
+//// @map_image_tests
+#ifdef KIGU_UNIT_TESTS
+
+
+global void kigu__map_image_unit_tests()
+{
+	{//// str8 keys ////
+		map<str8,u32> names;
+		names.add(STR8("alpha"), 1);
+		names.add(STR8("beta"), 2);
+		names.add(str8{}, 3);
+		char name[32];
+		forI(10000){
+			int length = snprintf(name, sizeof(name), "name_%d", (int)i);
+			str8 key = str8{(u8*)stl_allocator->reserve(length), (s64)length}; //map doesn't copy the contents of str8 keys
+			CopyMemory(key.str, name, length);
+			names.add(key, 100 + i);
+		}
+		
+		upt size = 0;
+		void* built = map_image_build(&names, &size);
+		AssertAlways(built && size > sizeof(MapImageHeader));
+		AssertAlways(map_image_validate(built, size));
+		
+		map_image<str8,u32> image;
+		AssertAlways(map_image_from_memory(&image, built, size));
+		AssertAlways(image.count == names.count);
+		AssertAlways(*image.at(STR8("alpha")) == 1 && *image.at(STR8("beta")) == 2 && *image.at(str8{}) == 3);
+		AssertAlways(!image.has(STR8("gamma")) && image.at(STR8("alph")) == 0);
+		forI(10000){
+			int length = snprintf(name, sizeof(name), "name_%d", (int)i);
+			const u32* value = image.at(str8{(u8*)name, (s64)length});
+			AssertAlways(value && *value == 100 + i);
+		}
+		forI(names.count){
+			AssertAlways(str8_equal_lazy(image.key(i), names.keys[i]) && image.value(i) == names.data[i]);
+			AssertAlways(image.key(i).str[image.key(i).count] == '\0');
+		}
+		
+		//the image works at any (aligned) address since it only holds offsets
+		void* moved = allocator_reserve_aligned(stl_allocator, size, KIGU_MAP_IMAGE_ALIGNMENT);
+		CopyMemory(moved, built, size);
+		allocator_release_aligned(stl_allocator, built, KIGU_MAP_IMAGE_ALIGNMENT);
+		AssertAlways(map_image_from_memory(&image, moved, size));
+		AssertAlways(*image.at(STR8("name_1234")) == 1334 && image.findkey(STR8("name_10000")) == -1);
+		
+		//through a file
+		const char* path = "kigu_map_image_test.bin";
+		AssertAlways(map_image_write_file(path, moved, size));
+		map_image<str8,u32> mapped;
+		AssertAlways(map_image_open(&mapped, path));
+		AssertAlways(mapped.mapping && mapped.mapping != moved && mapped.count == names.count);
+		AssertAlways(map_image_validate(mapped.header, mapped.mapping_size));
+		AssertAlways(*mapped.at(STR8("name_9999")) == 10099 && !mapped.has(STR8("name_")));
+		map_image_close(&mapped);
+		AssertAlways(mapped.count == 0 && !mapped.has(STR8("alpha")));
+		remove(path);
+		AssertAlways(!map_image_open(&mapped, path));
+		
+		//corrupt images
+		u8* bytes = (u8*)moved;
+		bytes[size-1] ^= 1;
+		AssertAlways(!map_image_validate(moved, size));
+		AssertAlways(map_image_from_memory(&image, moved, size)); //only the header is checked
+		bytes[size-1] ^= 1;
+		AssertAlways(!map_image_from_memory(&image, moved, size-1));
+		AssertAlways(!map_image_validate(moved, size-1));
+		map_image<str8,u64> wrong_value;
+		AssertAlways(!map_image_from_memory(&wrong_value, moved, size));
+		((MapImageHeader*)moved)->magic = 0;
+		AssertAlways(!map_image_from_memory(&image, moved, size) && !map_image_validate(moved, size));
+		AssertAlways(!map_image_from_memory(&image, bytes + 1, size - 1));
+		allocator_release_aligned(stl_allocator, moved, KIGU_MAP_IMAGE_ALIGNMENT);
+		for(u32 i = 3; i < names.count; i += 1) stl_allocator->release(names.keys[i].str);
+	}
+	
+	{//// plain keys and values ////
+		struct Vec{ f32 x, y, z; };
+		map<u64,Vec> positions;
+		forI(1000) positions.add((u64)i*i, Vec{(f32)i, (f32)i*2, -(f32)i});
+		positions.remove(25);
+		
+		upt size = 0;
+		void* built = map_image_build(&positions, &size);
+		map_image<u64,Vec> image;
+		AssertAlways(map_image_from_memory(&image, built, size) && image.count == 999);
+		AssertAlways(!image.has(25) && !image.has(2));
+		forI(1000){
+			if(i == 5) continue;
+			const Vec* v = image.at((u64)i*i);
+			AssertAlways(v && v->x == (f32)i && v->y == (f32)i*2 && v->z == -(f32)i);
+		}
+		
+		//the same map always builds the same image
+		upt size2 = 0;
+		void* built2 = map_image_build(&positions, &size2);
+		AssertAlways(size2 == size && memcmp(built, built2, size) == 0);
+		allocator_release_aligned(stl_allocator, built2, KIGU_MAP_IMAGE_ALIGNMENT);
+		allocator_release_aligned(stl_allocator, built, KIGU_MAP_IMAGE_ALIGNMENT);
+		
+		//empty maps
+		map<u64,Vec> empty;
+		built = map_image_build(&empty, &size);
+		AssertAlways(map_image_validate(built, size) && map_image_from_memory(&image, built, size));
+		AssertAlways(image.count == 0 && !image.has(0));
+		allocator_release_aligned(stl_allocator, built, KIGU_MAP_IMAGE_ALIGNMENT);
+	}
+}
+
+
+#endif //#ifdef KIGU_UNIT_TESTS
+#endif //#ifndef KIGU_MAP_IMAGE_H
@@ -0,0 +1,327 @@
+/* kigu memory module
+WHAT:
+This module provides thin wrappers over the OS virtual memory functions (reserving address space, committing and
+decommitting pages, and releasing the address space) and a way to expose stateful allocators (arenas, pools, etc)
+through the stateless `Allocator` struct defined in common.h.
+
+WHY:
+`Allocator` only holds plain function pointers so that libc functions (malloc, free, realloc) can be plugged straight into
+it, but that means the functions have no way of knowing which arena or pool they belong to. Rather than changing every
+allocator signature in kigu, allocator_bind() hands out one of a fixed set of static `Allocator`s whose functions forward to
+context-taking functions through a slot table. Each slot's functions are unique, so the `Allocator*` itself identifies the
+context.
+
+NOTES:
+- os_memory_reserve() returns address space that can not be touched until it is committed with os_memory_commit().
+- Freshly committed pages are always zero filled; decommitted pages read as zero once committed again.
+- Sizes passed to the os_memory functions should be multiples of os_memory_page_size().
+- os_memory_remap() is only supported on Linux (mremap); elsewhere it returns 0 so callers fall back to copying.
+- os_file_map() maps a whole file read-only and shared, so every process that maps the same file shares its page cache.
+- There are KIGU_ALLOCATOR_BIND_SLOTS (64) bound allocators available at once (the count is fixed by the list of slot functions
+  in @memory_bind); allocator_bind() crashes with AssertAlways when they run out, even in release builds.
+- Bound allocators start without any AllocatorFlags and with an unknown alignment; whoever binds one can set its `flags` and
+  `alignment` to what the bound functions guarantee (they are reset by allocator_unbind()).
+- The slot table, the bound allocators, and their functions are shared by every translation unit that includes memory.h, so
+  an allocator bound in one translation unit can be unbound in another.
+
+INDEX:
+@memory_os
+  os_memory_page_size() -> upt
+  os_memory_reserve(upt size) -> void*
+  os_memory_commit(void* ptr, upt size) -> b32
+  os_memory_decommit(void* ptr, upt size) -> void
+  os_memory_remap(void* ptr, upt old_size, upt new_size) -> void*
+  os_memory_advise_huge(void* ptr, upt size) -> void
+  os_memory_release(void* ptr, upt size) -> void
+  os_file_map(const char* path, upt* out_size) -> void*
+  os_file_unmap(void* ptr, upt size) -> void
+@memory_bind
+  allocator_bind(void* context, reserve, release, resize) -> Allocator*
+  allocator_unbind(Allocator* allocator) -> void
+  allocator_context(Allocator* allocator) -> void*
+*/
+#pragma once
+#ifndef KIGU_MEMORY_H
+#define KIGU_MEMORY_H
+
+
+#include "common.h"
+
+#if OS_WINDOWS
+#  ifndef WIN32_LEAN_AND_MEAN
+#    define WIN32_LEAN_AND_MEAN
+#  endif
+#  include <windows.h>
+#  include <intrin.h>
+#elif OS_LINUX || OS_MAC
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <fcntl.h>
+#  include <unistd.h>
+#else
+#  error "unhandled os for virtual memory"
+#endif //#if OS_WINDOWS
+
+
+//spin lock on a `volatile s32` that is 0 while unlocked and atomic accesses/fences, used by the thread safe allocators and maps
+//NOTE msvc gives volatile accesses acquire/release semantics by default
+#if COMPILER_CL
+#  define kigu__spin_lock(lock) STMNT( while(_InterlockedExchange((volatile long*)(lock), 1)){ _mm_pause(); } )
+#  define kigu__spin_unlock(lock) _InterlockedExchange((volatile long*)(lock), 0)
+#  define kigu__load_acquire(ptr) (*(ptr))
+#  define kigu__store_release(ptr,value) (*(ptr) = (value))
+#  define kigu__load_relaxed(ptr) (*(ptr))
+#  define kigu__store_relaxed(ptr,value) (*(ptr) = (value))
+#  define kigu__fence_acquire() _ReadWriteBarrier()
+#  define kigu__fence_release() _ReadWriteBarrier()
+#  define kigu__atomic_add(ptr,value) _InterlockedExchangeAdd((volatile long*)(ptr), (value)) //returns the previous value
+#  define kigu__atomic_cas(ptr,expected,value) (_InterlockedCompareExchange((volatile long*)(ptr), (value), (expected)) == (long)(expected))
+#  define kigu__fence_full() MemoryBarrier()
+#else
+#  define kigu__spin_lock(lock) STMNT( while(__sync_lock_test_and_set((lock), 1)){ while(__atomic_load_n((lock), __ATOMIC_RELAXED)){} } )
+#  define kigu__spin_unlock(lock) __sync_lock_release(lock)
+#  define kigu__load_acquire(ptr) __atomic_load_n((ptr), __ATOMIC_ACQUIRE)
+#  define kigu__store_release(ptr,value) __atomic_store_n((ptr), (value), __ATOMIC_RELEASE)
+#  define kigu__load_relaxed(ptr) __atomic_load_n((ptr), __ATOMIC_RELAXED)
+#  define kigu__store_relaxed(ptr,value) __atomic_store_n((ptr), (value), __ATOMIC_RELAXED)
+#  define kigu__fence_acquire() __atomic_thread_fence(__ATOMIC_ACQUIRE)
+#  define kigu__fence_release() __atomic_thread_fence(__ATOMIC_RELEASE)
+#  define kigu__atomic_add(ptr,value) __atomic_fetch_add((ptr), (value), __ATOMIC_RELAXED) //returns the previous value
+#  define kigu__atomic_cas(ptr,expected,value) __sync_bool_compare_and_swap((ptr), (expected), (value)) //returns true if swapped
+#  define kigu__fence_full() __atomic_thread_fence(__ATOMIC_SEQ_CST)
+#endif //#if COMPILER_CL
+
+
+StartLinkageC();
+//-////////////////////////////////////////////////////////////////////////////////////////////////
+//// @memory_os
+
+
+//Returns the size of a page of virtual memory on this system
+global upt
+os_memory_page_size(){
+	persist upt page_size = 0;
+	if(!page_size){
+#if OS_WINDOWS
+		SYSTEM_INFO info;
+		GetSystemInfo(&info);
+		page_size = info.dwPageSize;
+#else
+		page_size = (upt)sysconf(_SC_PAGESIZE);
+#endif //#if OS_WINDOWS
+	}
+	return page_size;
+}
+
+
+//Reserves `size` bytes of address space without backing it by physical memory, returns 0 on failure
+global void*
+os_memory_reserve(upt size){
+#if OS_WINDOWS
+	return VirtualAlloc(0, size, MEM_RESERVE, PAGE_NOACCESS);
+#else
+	void* result = mmap(0, size, PROT_NONE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_NORESERVE, -1, 0);
+	return (result == MAP_FAILED) ? 0 : result;
+#endif //#if OS_WINDOWS
+}
+
+
+//Commits `size` bytes of previously reserved address space starting at `ptr` so that it can be read and written
+global b32
+os_memory_commit(void* ptr, upt size){
+#if OS_WINDOWS
+	return VirtualAlloc(ptr, size, MEM_COMMIT, PAGE_READWRITE) != 0;
+#else
+	return mprotect(ptr, size, PROT_READ|PROT_WRITE) == 0;
+#endif //#if OS_WINDOWS
+}
+
+
+//Returns the physical pages of `size` bytes starting at `ptr` to the OS, but keeps the address space reserved
+global void
+os_memory_decommit(void* ptr, upt size){
+#if OS_WINDOWS
+	VirtualFree(ptr, size, MEM_DECOMMIT);
+#else
+	//NOTE mapping over the range drops the pages and guarantees they are zero when committed again (madvise doesn't on mac)
+	mmap(ptr, size, PROT_NONE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_NORESERVE|MAP_FIXED, -1, 0);
+#endif //#if OS_WINDOWS
+}
+
+
+//Advises the OS to back `size` bytes of committed memory starting at `ptr` with huge pages (only supported on Linux, where
+//  `ptr` and `size` should be multiples of 2MB)
+global void
+os_memory_advise_huge(void* ptr, upt size){
+#if OS_LINUX
+	madvise(ptr, size, MADV_HUGEPAGE);
+#endif //#if OS_LINUX
+}
+
+
+//Resizes the committed range of `old_size` bytes at `ptr` to `new_size` bytes by remapping its pages rather than copying them,
+//  the range may move; returns 0 if the OS doesn't support remapping or it failed (in which case `ptr` is untouched)
+global void*
+os_memory_remap(void* ptr, upt old_size, upt new_size){
+#if OS_LINUX
+	//NOTE mremap requires _GNU_SOURCE, which g++ and clang++ define by default
+	void* result = mremap(ptr, old_size, new_size, MREMAP_MAYMOVE);
+	return (result == MAP_FAILED) ? 0 : result;
+#else
+	return 0;
+#endif //#if OS_LINUX
+}
+
+
+//Releases the address space of `size` bytes starting at `ptr` which was reserved by os_memory_reserve()
+global void
+os_memory_release(void* ptr, upt size){
+#if OS_WINDOWS
+	VirtualFree(ptr, 0, MEM_RELEASE);
+#else
+	munmap(ptr, size);
+#endif //#if OS_WINDOWS
+}
+
+
+//Maps the whole file at `path` into memory read-only and sets `out_size` to its size, returns 0 on failure (or if it's empty)
+global void*
+os_file_map(const char* path, upt* out_size){
+	*out_size = 0;
+#if OS_WINDOWS
+	HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+	if(file == INVALID_HANDLE_VALUE) return 0;
+	LARGE_INTEGER size;
+	void* result = 0;
+	if(GetFileSizeEx(file, &size) && size.QuadPart > 0){
+		HANDLE mapping = CreateFileMappingA(file, 0, PAGE_READONLY, 0, 0, 0);
+		if(mapping){
+			result = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+			CloseHandle(mapping); //the view keeps the mapping alive
+		}
+	}
+	CloseHandle(file);
+	if(result) *out_size = (upt)size.QuadPart;
+	return result;
+#else
+	int file = open(path, O_RDONLY);
+	if(file < 0) return 0;
+	struct stat info;
+	void* result = 0;
+	if(fstat(file, &info) == 0 && info.st_size > 0){
+		result = mmap(0, (upt)info.st_size, PROT_READ, MAP_SHARED, file, 0);
+		if(result == MAP_FAILED) result = 0;
+	}
+	close(file); //the mapping keeps the file alive
+	if(result) *out_size = (upt)info.st_size;
+	return result;
+#endif //#if OS_WINDOWS
+}
+
+
+//Unmaps `size` bytes starting at `ptr` which was mapped by os_file_map()
+global void
+os_file_unmap(void* ptr, upt size){
+#if OS_WINDOWS
+	UnmapViewOfFile(ptr);
+#else
+	munmap(ptr, size);
+#endif //#if OS_WINDOWS
+}
+
+
+//-////////////////////////////////////////////////////////////////////////////////////////////////
+//// @memory_bind
+
+
+#define KIGU_ALLOCATOR_BIND_SLOTS 64 //must match KIGU__ALLOCATOR_BIND_SLOT_LIST
+
+typedef void* (*BoundAllocator_ReserveMemory_Func)(void* context, upt size);
+typedef void  (*BoundAllocator_ReleaseMemory_Func)(void* context, void* ptr);
+typedef void* (*BoundAllocator_ResizeMemory_Func)(void* context, void* ptr, upt size);
+
+typedef struct BoundAllocatorSlot{
+	void* context;
+	BoundAllocator_ReserveMemory_Func reserve;
+	BoundAllocator_ReleaseMemory_Func release;
+	BoundAllocator_ResizeMemory_Func  resize;
+	volatile s32 used;
+}BoundAllocatorSlot;
+
+inline BoundAllocatorSlot kigu__bound_allocator_slots[KIGU_ALLOCATOR_BIND_SLOTS];
+
+#if COMPILER_CL
+#  define kigu__bound_allocator_claim(slot) (_InterlockedCompareExchange((volatile long*)&(slot)->used, 1, 0) == 0)
+#else
+#  define kigu__bound_allocator_claim(slot) __sync_bool_compare_and_swap(&(slot)->used, 0, 1)
+#endif //#if COMPILER_CL
+
+#define KIGU__ALLOCATOR_BIND_SLOT_LIST(X) \
+  X(0)  X(1)  X(2)  X(3)  X(4)  X(5)  X(6)  X(7)  X(8)  X(9)  X(10) X(11) X(12) X(13) X(14) X(15) \
+  X(16) X(17) X(18) X(19) X(20) X(21) X(22) X(23) X(24) X(25) X(26) X(27) X(28) X(29) X(30) X(31) \
+  X(32) X(33) X(34) X(35) X(36) X(37) X(38) X(39) X(40) X(41) X(42) X(43) X(44) X(45) X(46) X(47) \
+  X(48) X(49) X(50) X(51) X(52) X(53) X(54) X(55) X(56) X(57) X(58) X(59) X(60) X(61) X(62) X(63)
+
+#define KIGU__ALLOCATOR_BIND_THUNKS(n)                                                                                          \
+  inline void* kigu__bound_allocator_reserve_##n(upt size){                                                                     \
+    return kigu__bound_allocator_slots[n].reserve(kigu__bound_allocator_slots[n].context, size); }                              \
+  inline void  kigu__bound_allocator_release_##n(void* ptr){                                                                    \
+    kigu__bound_allocator_slots[n].release(kigu__bound_allocator_slots[n].context, ptr); }                                      \
+  inline void* kigu__bound_allocator_resize_##n(void* ptr, upt size){                                                           \
+    return kigu__bound_allocator_slots[n].resize(kigu__bound_allocator_slots[n].context, ptr, size); }
+KIGU__ALLOCATOR_BIND_SLOT_LIST(KIGU__ALLOCATOR_BIND_THUNKS)
+#undef KIGU__ALLOCATOR_BIND_THUNKS
+
+#define KIGU__ALLOCATOR_BIND_ENTRY(n) {                                                                                         \
+    kigu__bound_allocator_reserve_##n, Allocator_ChangeMemory_Noop, Allocator_ChangeMemory_Noop,                                \
+    kigu__bound_allocator_release_##n, kigu__bound_allocator_resize_##n, 0, AllocatorFlags_None, 0 },
+inline Allocator kigu__bound_allocators[KIGU_ALLOCATOR_BIND_SLOTS] = { KIGU__ALLOCATOR_BIND_SLOT_LIST(KIGU__ALLOCATOR_BIND_ENTRY) };
+#undef KIGU__ALLOCATOR_BIND_ENTRY
+
+
+//Returns an `Allocator` whose functions call `reserve`, `release`, and `resize` with `context` as the first argument
+//  crashes if all KIGU_ALLOCATOR_BIND_SLOTS slots are in use
+global Allocator*
+allocator_bind(void* context, BoundAllocator_ReserveMemory_Func reserve, BoundAllocator_ReleaseMemory_Func release, BoundAllocator_ResizeMemory_Func resize){
+	forI(KIGU_ALLOCATOR_BIND_SLOTS){
+		BoundAllocatorSlot* slot = &kigu__bound_allocator_slots[i];
+		if(!slot->used && kigu__bound_allocator_claim(slot)){
+			slot->context = context;
+			slot->reserve = reserve;
+			slot->release = release;
+			slot->resize  = resize;
+			return &kigu__bound_allocators[i];
+		}
+	}
+	AssertAlways(!"ran out of bound allocator slots; every allocator_bind() needs an allocator_unbind()");
+	return 0;
+}
+
+
+//Returns the slot of `allocator` so it can be bound again, `allocator` must have been returned by allocator_bind()
+global void
+allocator_unbind(Allocator* allocator){
+	upt index = allocator - kigu__bound_allocators;
+	Assert(index < KIGU_ALLOCATOR_BIND_SLOTS, "allocator was not returned by allocator_bind()");
+	BoundAllocatorSlot* slot = &kigu__bound_allocator_slots[index];
+	slot->context = 0;
+	slot->reserve = 0;
+	slot->release = 0;
+	slot->resize  = 0;
+	allocator->flags     = AllocatorFlags_None;
+	allocator->alignment = 0;
+	slot->used    = 0;
+}
+
+
+//Returns the `context` that `allocator` was bound with, `allocator` must have been returned by allocator_bind()
+global void*
+allocator_context(Allocator* allocator){
+	upt index = allocator - kigu__bound_allocators;
+	Assert(index < KIGU_ALLOCATOR_BIND_SLOTS, "allocator was not returned by allocator_bind()");
+	return kigu__bound_allocator_slots[index].context;
+}
+
+
+EndLinkageC();
+#endif //#ifndef KIGU_MEMORY_H
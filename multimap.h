@@ -0,0 +1,270 @@
+/* kigu multimap module
+WHAT:
+This module provides `multimap`, which groups any number of values under each key. Every value is stored in one `arrayT` with
+the values of each key next to each other (a run), and a `map` from key to the run's offset and count finds them, so getting a
+key's values is one lookup and iterating them is a linear scan over contiguous memory.
+
+WHY:
+Records were grouped by key with `map<Key,arrayT<Value>>`, where every group owns its own heap allocation. That's an allocation
+(and usually a few reallocations) per key and the groups end up scattered over the heap. A multimap has two allocations for
+its values and runs in the order of their keys.
+
+NOTES:
+- build() groups unsorted keys and values in two passes: the first finds (or adds) the key of every record and counts the
+  records of each key, then the runs are laid out from those counts and the second pass copies every value into its run
+  without hashing again. Values keep their input order within a run.
+- Runs are in the order their keys were first seen, and `index` has the keys in the same order, so group(i) and key(i) can be
+  used to iterate the groups in order.
+- add() inserts into the middle of `values` (moving every value after the key's run) unless the key's run is the last one, and
+  remove() moves every value after the run down, so both are O(n); prefer build() for more than a few values.
+- Like map, pointers into a multimap (and carrays returned by get() and group()) are invalidated by add, remove, and build,
+  and removing a key moves the last key into its index.
+
+INDEX:
+@multimap
+  multimap<Key,Value,HashStruct,EqualStruct>(Allocator* allocator)
+    build(const Key* keys, const Value* values, u32 count) -> void
+    build(carray<pair<Key,Value>> records) -> void
+    add(const Key& key, const Value& value) -> void
+    remove(const Key& key) -> void
+    clear() -> void
+    has(const Key& key) -> bool
+    get(const Key& key) -> carray<Value>
+    key(u32 group_index) -> const Key&
+    group(u32 group_index) -> carray<Value>
+@multimap_tests
+*/
+#pragma once
+#ifndef KIGU_MULTIMAP_H
+#define KIGU_MULTIMAP_H
+
+
+#include "common.h"
+#include "arrayT.h"
+#include "hash.h"
+#include "map.h"
+#include "pair.h"
+#include "profiling.h"
+
+
+//-////////////////////////////////////////////////////////////////////////////////////////////////
+//// @multimap
+
+
+template<typename Key, typename Value, typename HashStruct = hash<Key>, typename EqualStruct = hash_equal<Key>>
+struct multimap{
+	struct run{
+		u32 offset; //index of the run's first value in `values`
+		u32 count;
+	};
+	
+	map<Key,run,HashStruct,EqualStruct> index;
+	arrayT<Value> values; //values grouped into runs by key
+	
+	multimap(Allocator* a = stl_allocator) : index(a), values(a){}
+	
+	void build(const Key* keys, const Value* in_values, u32 count);
+	void build(carray<pair<Key,Value>> records);
+	void add(const Key& key, const Value& value);
+	void remove(const Key& key);
+	void clear();
+	template<typename KeyOf, typename ValueOf> void kigu__build(u32 count, KeyOf key_of, ValueOf value_of);
+	
+	//Returns true if `key` has any values
+	bool has(const Key& key)const{ return index.has(key); }
+	
+	//Returns the values of `key`, which are empty if it has none
+	carray<Value> get(const Key& key){
+		run* r = index.at(key);
+		return (r) ? carray<Value>{values.data + r->offset, r->count} : carray<Value>{};
+	}
+	
+	//Returns the key of the group at `group_index` (from 0 to index.count)
+	const Key& key(u32 group_index)const{ return index.keys.data[group_index]; }
+	
+	//Returns the values of the group at `group_index` (from 0 to index.count)
+	carray<Value> group(u32 group_index){
+		run r = index.data.data[group_index];
+		return carray<Value>{values.data + r.offset, r.count};
+	}
+};
+
+//Replaces the contents of the multimap with `count` records whose keys and values are returned by `key_of(i)` and `value_of(i)`
+template<typename Key, typename Value, typename HashStruct, typename EqualStruct> template<typename KeyOf, typename ValueOf> inline void multimap<Key,Value,HashStruct,EqualStruct>::
+kigu__build(u32 count, KeyOf key_of, ValueOf value_of){DPZoneScoped;
+	clear();
+	if(!count) return;
+	
+	//first pass: count the records of each key, remembering the key of every record so they aren't hashed again
+	arrayT<u32> groups(values.allocator);
+	groups.resize(count);
+	forI(count){
+		u32 group_index = index.add(key_of(i));
+		index.data.data[group_index].count += 1;
+		groups.data[i] = group_index;
+	}
+	
+	//lay the runs out back to back, then copy every value to the end of its run
+	u32 offset = 0;
+	forI(index.count){
+		index.data.data[i].offset = offset;
+		offset += index.data.data[i].count;
+		index.data.data[i].count = 0;
+	}
+	values.resize(count);
+	forI(count){
+		run& r = index.data.data[groups.data[i]];
+		values.data[r.offset + r.count] = value_of(i);
+		r.count += 1;
+	}
+}
+
+//Replaces the contents of the multimap with `count` records of `keys[i]` and `in_values[i]`
+template<typename Key, typename Value, typename HashStruct, typename EqualStruct> inline void multimap<Key,Value,HashStruct,EqualStruct>::
+build(const Key* keys, const Value* in_values, u32 count){
+	kigu__build(count, [keys](u32 i) -> const Key&{ return keys[i]; }, [in_values](u32 i) -> const Value&{ return in_values[i]; });
+}
+
+//Replaces the contents of the multimap with the key and value of every pair in `records`
+template<typename Key, typename Value, typename HashStruct, typename EqualStruct> inline void multimap<Key,Value,HashStruct,EqualStruct>::
+build(carray<pair<Key,Value>> records){
+	pair<Key,Value>* data = records.data;
+	kigu__build((u32)records.count, [data](u32 i) -> const Key&{ return data[i].first; }, [data](u32 i) -> const Value&{ return data[i].second; });
+}
+
+//Adds `value` to the end of the values of `key`
+template<typename Key, typename Value, typename HashStruct, typename EqualStruct> inline void multimap<Key,Value,HashStruct,EqualStruct>::
+add(const Key& key, const Value& value){DPZoneScoped;
+	u32 group_index = index.add(key, run{values.count, 0});
+	run& r = index.data.data[group_index];
+	u32 end = r.offset + r.count;
+	if(end != values.count){
+		//every run after this one moves up by one
+		forI(index.count){
+			if(index.data.data[i].offset >= end) index.data.data[i].offset += 1;
+		}
+	}
+	values.insert(value, end);
+	r.count += 1;
+}
+
+//Removes `key` and all of its values
+template<typename Key, typename Value, typename HashStruct, typename EqualStruct> inline void multimap<Key,Value,HashStruct,EqualStruct>::
+remove(const Key& key){DPZoneScoped;
+	run* found = index.at(key);
+	if(!found) return;
+	run r = *found;
+	index.remove(key);
+	
+	for(u32 i = r.offset; i + r.count < values.count; i += 1){
+		values.data[i] = values.data[i + r.count];
+	}
+	if(r.count) values.pop(r.count);
+	forI(index.count){
+		if(index.data.data[i].offset > r.offset) index.data.data[i].offset -= r.count;
+	}
+}
+
+//Removes every key and value
+template<typename Key, typename Value, typename HashStruct, typename EqualStruct> inline void multimap<Key,Value,HashStruct,EqualStruct>::
+clear(){DPZoneScoped;
+	index.clear();
+	values.clear();
+}
+
+
+//-////////////////////////////////////////////////////////////////////////////////////////////////
+//// @multimap_tests
+#ifdef KIGU_UNIT_TESTS
+
+
+global void kigu__multimap_unit_tests()
+{
+	{//// build ////
+		const u32 record_count = 10000, key_count = 37;
+		arrayT<u32> keys;
+		arrayT<u64> values;
+		forI(record_count){
+			keys.add((i * 7919) % key_count);
+			values.add(i);
+		}
+		
+		multimap<u32,u64> groups;
+		groups.build(keys.data, values.data, record_count);
+		AssertAlways(groups.index.count == key_count && groups.values.count == record_count);
+		AssertAlways(groups.key(0) == 0 && groups.key(1) == 7919 % key_count);
+		
+		//every run is contiguous and has its key's values in input order
+		u32 total = 0;
+		forX(k, key_count){
+			carray<u64> run = groups.get(k);
+			u32 expected = 0;
+			forI(record_count) if(keys[i] == k) expected += 1;
+			AssertAlways(run.count == expected);
+			forI(run.count){
+				AssertAlways(keys[(u32)run[i]] == k);
+				if(i) AssertAlways(run[i] > run[i-1]);
+			}
+			total += run.count;
+		}
+		AssertAlways(total == record_count);
+		forI(groups.index.count){
+			carray<u64> run = groups.group(i);
+			AssertAlways(run.data == groups.get(groups.key(i)).data);
+			if(i) AssertAlways(run.data == groups.group(i-1).data + groups.group(i-1).count);
+		}
+		AssertAlways(!groups.has(key_count) && groups.get(key_count).count == 0);
+		
+		//building again replaces everything
+		groups.build(keys.data, values.data, 10);
+		AssertAlways(groups.values.count == 10 && groups.get(0).count == 1 && groups.get(0)[0] == 0);
+		groups.build(keys.data, values.data, 0);
+		AssertAlways(groups.values.count == 0 && groups.index.count == 0 && !groups.has(0));
+	}
+	
+	{//// pairs ////
+		pair<str8,s32> records[] = {
+			{STR8("b"), 1}, {STR8("a"), 2}, {STR8("b"), 3}, {STR8("c"), 4}, {STR8("a"), 5}, {STR8("b"), 6},
+		};
+		multimap<str8,s32> groups;
+		groups.build(carray<pair<str8,s32>>{records, ArrayCount(records)});
+		carray<s32> b = groups.get(STR8("b"));
+		carray<s32> a = groups.get(STR8("a"));
+		carray<s32> c = groups.get(STR8("c"));
+		AssertAlways(b.count == 3 && b[0] == 1 && b[1] == 3 && b[2] == 6);
+		AssertAlways(a.count == 2 && a[0] == 2 && a[1] == 5);
+		AssertAlways(c.count == 1 && c[0] == 4);
+		AssertAlways(b.data == groups.values.data && a.data == b.data + 3 && c.data == a.data + 2);
+	}
+	
+	{//// add/remove ////
+		multimap<u32,u32> groups;
+		groups.add(1, 10);
+		groups.add(2, 20);
+		groups.add(1, 11);
+		groups.add(3, 30);
+		groups.add(2, 21);
+		groups.add(1, 12);
+		AssertAlways(groups.values.count == 6);
+		u32 expected[] = {10, 11, 12, 20, 21, 30};
+		forI(6) AssertAlways(groups.values[i] == expected[i]);
+		AssertAlways(groups.get(2).data == groups.values.data + 3 && groups.get(3).data == groups.values.data + 5);
+		
+		groups.remove(1);
+		AssertAlways(!groups.has(1) && groups.values.count == 3 && groups.index.count == 2);
+		AssertAlways(groups.get(2).count == 2 && groups.get(2)[0] == 20 && groups.get(2)[1] == 21);
+		AssertAlways(groups.get(3).count == 1 && groups.get(3)[0] == 30);
+		groups.add(2, 22);
+		AssertAlways(groups.get(2).count == 3 && groups.get(2)[2] == 22 && groups.get(3)[0] == 30);
+		groups.remove(4);
+		groups.remove(3);
+		groups.remove(2);
+		AssertAlways(groups.values.count == 0 && groups.index.count == 0);
+		groups.add(5, 50);
+		AssertAlways(groups.get(5).count == 1 && groups.get(5)[0] == 50);
+	}
+}
+
+
+#endif //#ifdef KIGU_UNIT_TESTS
+#endif //#ifndef KIGU_MULTIMAP_H
@@ -0,0 +1,255 @@
+/* kigu perfect_hash module
+WHAT:
+This module builds perfect hash tables for fixed sets of string keys at compile time. A `perfect_hash<N>` maps each of its N
+keys to its own slot, so finding a str8 takes one hash of the string, one probe, and one memcmp against the only key that
+could match. ENUM_LIST_PERFECT_HASH() builds one from the same list macro as ENUM_LIST() to turn strings back into enums.
+
+WHY:
+Keyword and command tables in parsers are usually walked linearly comparing strings (or built into a `map` at startup). The
+keys are known at compile time, so the table can be too, and looking a string up costs about as much as hashing it.
+
+NOTES:
+- Tables are built with hash and displace: keys are spread over `bucket_count` buckets by the high half of their (mixed)
+  str8_hash64(), then for every bucket (biggest first) a displacement is searched for that mixes the hash of every key in
+  the bucket into a free slot. There are two slots per key (rounded up to a power of two) so the search is quick.
+- Construction has to happen in a constant expression (`constexpr auto table = perfect_hash_create(keys);`) so a duplicate
+  key fails to compile (the constructor reaches a throw).
+- find() hashes with str8_hash64() and find_static() with str8_static_hash64(), which give the same results, so tables can
+  also be searched at compile time.
+- Keys are not copied, so they must be string literals (or otherwise outlive the table).
+- ENUM_LIST_PERFECT_HASH() assumes the enum values count up from 0 in list order, which is what ENUM_LIST() generates.
+
+INDEX:
+@perfect_hash
+  perfect_hash<N>
+    find(str8 key) -> s32
+    find_static(str8_static_t key) constexpr -> s32
+  perfect_hash_create(const str8_static_t (&keys)[N]) constexpr -> perfect_hash<N>
+@perfect_hash_enum
+  ENUM_LIST_PERFECT_HASH(list_name, list_macro)
+    list_name##_static_strings[]: constexpr str8_static_t
+    list_name##_perfect_hash: constexpr perfect_hash<N>
+    list_name##_from_str8(str8 s, list_name* out) -> b32
+@perfect_hash_tests
+*/
+#pragma once
+#ifndef KIGU_PERFECT_HASH_H
+#define KIGU_PERFECT_HASH_H
+
+
+#include "common.h"
+#include "unicode.h"
+
+
+//-////////////////////////////////////////////////////////////////////////////////////////////////
+//// @perfect_hash
+
+
+//Returns the smallest power of two that is at least `value` at compile-time
+constexpr u64
+kigu__perfect_hash_pow2(u64 value){
+	u64 result = 1;
+	while(result < value) result *= 2;
+	return result;
+}
+
+//Returns `hashed` with every bit mixed into every other bit (the murmur3 finalizer), so the bucket and slot don't share bits
+//  with the hash that's stored and compared in the table
+constexpr u64
+kigu__perfect_hash_mix(u64 hashed){
+	hashed ^= hashed >> 33;
+	hashed *= 0xFF51AFD7ED558CCDull;
+	hashed ^= hashed >> 33;
+	hashed *= 0xC4CEB9FE1A85EC53ull;
+	hashed ^= hashed >> 33;
+	return hashed;
+}
+
+//Returns the bucket of the mixed hash `mixed` in a table with `bucket_count` buckets
+constexpr u32
+kigu__perfect_hash_bucket(u64 mixed, u32 bucket_count){
+	return (u32)(mixed >> 32) & (bucket_count-1);
+}
+
+//Returns the slot that the mixed hash `mixed` is moved to by `displacement` in a table with `slot_count` slots
+constexpr u32
+kigu__perfect_hash_slot(u64 mixed, u32 displacement, u32 slot_count){
+	return (u32)(((mixed ^ ((u64)displacement * 0x9E3779B97F4A7C15ull)) * 0xD6E8FEB86659FD93ull) >> 32) & (slot_count-1);
+}
+
+template<u64 N>
+struct perfect_hash{
+	static constexpr u32 bucket_count = (u32)kigu__perfect_hash_pow2((N > 1) ? N/2 : 1);
+	static constexpr u32 slot_count   = (u32)kigu__perfect_hash_pow2(2*N);
+	
+	const char* key_str[N]   = {};
+	u64         key_count[N] = {};
+	u64         key_hash[N]  = {};
+	u32 displacements[bucket_count] = {};
+	u32 slots[slot_count] = {}; //index of the key in the slot plus one, zero if the slot is empty
+	
+	constexpr perfect_hash(const str8_static_t (&keys)[N]){
+		forI(N){
+			key_str[i]   = keys[i].str;
+			key_count[i] = keys[i].count;
+			key_hash[i]  = str8_static_hash64(keys[i]);
+			for(u32 j = 0; j < i; j += 1){
+				if(key_hash[i] == key_hash[j]) throw "perfect_hash keys must be unique (or two keys' hashes collided)";
+			}
+		}
+		
+		u64 mixed[N] = {};
+		u32 bucket_sizes[bucket_count] = {};
+		u32 max_bucket_size = 0;
+		forI(N){
+			mixed[i] = kigu__perfect_hash_mix(key_hash[i]);
+			u32 bucket = kigu__perfect_hash_bucket(mixed[i], bucket_count);
+			bucket_sizes[bucket] += 1;
+			if(bucket_sizes[bucket] > max_bucket_size) max_bucket_size = bucket_sizes[bucket];
+		}
+		
+		//place the biggest buckets first while there are still many free slots
+		u32 bucket_slots[N] = {};
+		for(u32 size = max_bucket_size; size > 0; size -= 1){
+			for(u32 bucket = 0; bucket < bucket_count; bucket += 1){
+				if(bucket_sizes[bucket] != size) continue;
+				
+				for(u32 displacement = 0;; displacement += 1){
+					if(displacement == (1u << 20)) throw "perfect_hash failed to find a displacement";
+					
+					u32 placed = 0;
+					bool fits = true;
+					for(u32 key = 0; key < N && fits; key += 1){
+						if(kigu__perfect_hash_bucket(mixed[key], bucket_count) != bucket) continue;
+						u32 slot = kigu__perfect_hash_slot(mixed[key], displacement, slot_count);
+						if(slots[slot]) fits = false;
+						for(u32 other = 0; other < placed && fits; other += 1){
+							if(bucket_slots[other] == slot) fits = false;
+						}
+						bucket_slots[placed] = slot;
+						placed += 1;
+					}
+					if(!fits) continue;
+					
+					displacements[bucket] = displacement;
+					placed = 0;
+					for(u32 key = 0; key < N; key += 1){
+						if(kigu__perfect_hash_bucket(mixed[key], bucket_count) != bucket) continue;
+						slots[bucket_slots[placed]] = key + 1;
+						placed += 1;
+					}
+					break;
+				}
+			}
+		}
+	}
+	
+	//Returns the index of the key with the hash `hashed`, if it's `key`, otherwise -1
+	constexpr s32 kigu__find(u64 hashed, const char* key, u64 count)const{
+		u64 mixed = kigu__perfect_hash_mix(hashed);
+		u32 index = slots[kigu__perfect_hash_slot(mixed, displacements[kigu__perfect_hash_bucket(mixed, bucket_count)], slot_count)];
+		if(!index) return -1;
+		index -= 1;
+		if(key_hash[index] != hashed || key_count[index] != count) return -1;
+		forI(count){ if(key_str[index][i] != key[i]) return -1; }
+		return (s32)index;
+	}
+	
+	//Returns the index of `key` in the keys the table was created with, or -1 if it's not one of them
+	s32 find(str8 key)const{
+		u64 hashed = str8_hash64(key);
+		u64 mixed = kigu__perfect_hash_mix(hashed);
+		u32 index = slots[kigu__perfect_hash_slot(mixed, displacements[kigu__perfect_hash_bucket(mixed, bucket_count)], slot_count)];
+		if(!index) return -1;
+		index -= 1;
+		if(key_hash[index] != hashed || key_count[index] != (u64)key.count) return -1;
+		return (memcmp(key_str[index], key.str, key.count) == 0) ? (s32)index : -1;
+	}
+	
+	//Returns the index of `key` in the keys the table was created with, or -1 if it's not one of them, at compile-time
+	constexpr s32 find_static(str8_static_t key)const{
+		return kigu__find(str8_static_hash64(key), key.str, key.count);
+	}
+};
+
+//Returns a perfect hash table of `keys` (use in a constant expression)
+template<u64 N> constexpr perfect_hash<N>
+perfect_hash_create(const str8_static_t (&keys)[N]){
+	return perfect_hash<N>(keys);
+}
+
+
+//-////////////////////////////////////////////////////////////////////////////////////////////////
+//// @perfect_hash_enum
+
+
+//Defines `list_name##_static_strings`, a perfect hash table of them, and `list_name##_from_str8()`, which sets `out` to the
+//  enum value named by `s` and returns true, or returns false if no value has that name
+#define ENUM_LIST_STATIC_STRING(prefix,raw_enum) str8_static_t(STRINGIZE(raw_enum))
+#define ENUM_LIST_PERFECT_HASH(list_name, list_macro)                                                     \
+  constexpr str8_static_t list_name##_static_strings[] = { list_macro( ENUM_LIST_STATIC_STRING ) };       \
+  constexpr perfect_hash<ArrayCount(list_name##_static_strings)> list_name##_perfect_hash =              \
+    perfect_hash_create(list_name##_static_strings);                                                      \
+  FORCE_INLINE b32 list_name##_from_str8(str8 s, list_name* out){                                         \
+    s32 index = list_name##_perfect_hash.find(s);                                                         \
+    if(index < 0) return false;                                                                           \
+    *out = (list_name)index;                                                                              \
+    return true;                                                                                          \
+  }
+
+
+//-////////////////////////////////////////////////////////////////////////////////////////////////
+//// @perfect_hash_tests
+#ifdef KIGU_UNIT_TESTS
+
+
+#define KIGU__PERFECT_HASH_TEST_LIST(X) X(TestKeyword, if), X(TestKeyword, else), X(TestKeyword, while), X(TestKeyword, for), \
+                                        X(TestKeyword, return), X(TestKeyword, struct), X(TestKeyword, break)
+ENUM_LIST(TestKeyword, KIGU__PERFECT_HASH_TEST_LIST);
+ENUM_LIST_PERFECT_HASH(TestKeyword, KIGU__PERFECT_HASH_TEST_LIST);
+
+global void kigu__perfect_hash_unit_tests()
+{
+	{//// literal keys ////
+		constexpr str8_static_t keys[] = {"alpha", "beta", "gamma", "delta", "epsilon", "", "a", "ab"};
+		constexpr perfect_hash<ArrayCount(keys)> table = perfect_hash_create(keys);
+		static_assert(table.find_static("gamma") == 2, "");
+		static_assert(table.find_static("zeta") == -1, "");
+		static_assert(table.find_static("") == 5, "");
+		
+		forI(ArrayCount(keys)) AssertAlways(table.find(str8{(u8*)keys[i].str, (s64)keys[i].count}) == i);
+		AssertAlways(table.find(STR8("gamm")) == -1);
+		AssertAlways(table.find(STR8("gammaa")) == -1);
+		AssertAlways(table.find(STR8("b")) == -1);
+		
+		//every key has its own slot
+		u32 used = 0;
+		forI(table.slot_count) if(table.slots[i]) used += 1;
+		AssertAlways(used == ArrayCount(keys));
+	}
+	
+	{//// many keys ////
+		#define X8(p) p "0", p "1", p "2", p "3", p "4", p "5", p "6", p "7"
+		#define X64(p) X8(p "0"), X8(p "1"), X8(p "2"), X8(p "3"), X8(p "4"), X8(p "5"), X8(p "6"), X8(p "7")
+		constexpr str8_static_t keys[] = {X64("key_"), X64("name_"), X64("cmd_"), X64("x")};
+		#undef X64
+		#undef X8
+		constexpr perfect_hash<ArrayCount(keys)> table = perfect_hash_create(keys);
+		forI(ArrayCount(keys)) AssertAlways(table.find(str8{(u8*)keys[i].str, (s64)keys[i].count}) == i);
+		AssertAlways(table.find(STR8("key_8")) == -1);
+	}
+	
+	{//// ENUM_LIST ////
+		TestKeyword keyword = TestKeyword_if;
+		AssertAlways(TestKeyword_from_str8(STR8("while"), &keyword) && keyword == TestKeyword_while);
+		AssertAlways(TestKeyword_from_str8(STR8("break"), &keyword) && keyword == TestKeyword_break);
+		AssertAlways(!TestKeyword_from_str8(STR8("continue"), &keyword) && keyword == TestKeyword_break);
+		forI(ArrayCount(TestKeyword_strings)){
+			AssertAlways(TestKeyword_from_str8(TestKeyword_strings[i], &keyword) && keyword == (TestKeyword)i);
+		}
+	}
+}
+
+
+#endif //#ifdef KIGU_UNIT_TESTS
+#endif //#ifndef KIGU_PERFECT_HASH_H
@@ -0,0 +1,397 @@
+/* kigu pool module
+WHAT:
+This module provides a fixed-size block allocator. Blocks are carved from large chunks allocated with a backing allocator and
+freed blocks are kept on an intrusive free list (the first bytes of a free block point to the next free block), so reserving
+and releasing a block are both O(1) and blocks carry no per-allocation header.
+
+WHY:
+Trees and lists built from `TNode`/`Node` allocate one node at a time, usually through `stl_allocator`, so over time their
+nodes end up scattered across the heap with a malloc header in front of each one. Carving nodes out of the same chunks keeps
+nodes that were allocated together next to each other in memory, which keeps walks over siblings and children cache friendly.
+
+NOTES:
+- The block size is rounded up to KIGU_POOL_ALIGNMENT (16 by default), which is also the alignment of every block.
+- Reserved blocks are always zero filled (which kigu containers expect), even if the backing allocator doesn't zero its memory,
+  so pool_allocator() always has AllocatorFlags_ZeroReserve.
+- Blocks are carved from the newest chunk in address order, and released blocks are reused most recently released first.
+- pool_trim() releases chunks with no reserved blocks back to the backing allocator; it is O(free blocks * log(chunks))
+  and uses a scratch arena.
+- The `Allocator` returned by pool_allocator() asserts and returns 0 when asked for more than `block_size` bytes.
+- Pools are not thread safe.
+
+INDEX:
+@pool_init
+  Pool: struct
+  pool_init(Pool* pool, upt block_size, upt blocks_per_chunk, Allocator* backing) -> void
+  pool_init_for_type(Pool* pool, T type, upt blocks_per_chunk, Allocator* backing) -> void
+  pool_deinit(Pool* pool) -> void
+@pool_blocks
+  pool_reserve(Pool* pool) -> void*
+  pool_release(Pool* pool, void* block) -> void
+  pool_trim(Pool* pool) -> upt
+@pool_allocator
+  pool_allocator(Pool* pool) -> Allocator*
+@pool_tests
+*/
+#pragma once
+#ifndef KIGU_POOL_H
+#define KIGU_POOL_H
+
+
+#ifndef KIGU_POOL_ALIGNMENT
+#  define KIGU_POOL_ALIGNMENT 16
+#endif
+
+
+#include "common.h"
+#include "memory.h"
+#include "arena.h"
+
+
+StartLinkageC();
+//-////////////////////////////////////////////////////////////////////////////////////////////////
+//// @pool_init
+
+
+typedef struct PoolChunk{
+	struct PoolChunk* next;
+	upt free_count; //only valid during pool_trim()
+}PoolChunk;
+
+typedef struct PoolFreeBlock{
+	struct PoolFreeBlock* next;
+}PoolFreeBlock;
+
+typedef struct Pool{
+	upt block_size;           //bytes per block
+	upt blocks_per_chunk;     //blocks carved from each chunk
+	PoolFreeBlock* free_list; //released blocks
+	PoolChunk* chunks;        //all chunks, newest first
+	u8* carve_cursor;         //next uncarved block in the newest chunk
+	u8* carve_end;            //end of the newest chunk
+	upt chunk_count;          //number of chunks allocated
+	upt reserved_count;       //number of blocks currently reserved
+	Allocator* backing;       //allocator the chunks are allocated with
+	Allocator* allocator;     //allocator that reserves blocks from this pool (0 until pool_allocator() is called)
+}Pool;
+
+#define kigu__pool_chunk_header_size AlignToPow2(sizeof(PoolChunk), (upt)KIGU_POOL_ALIGNMENT)
+
+
+//Initializes `pool` to hand out blocks of `block_size` bytes from chunks of `blocks_per_chunk` blocks allocated with `backing`
+global void
+pool_init(Pool* pool, upt block_size, upt blocks_per_chunk, Allocator* backing){
+	pool->block_size       = AlignToPow2(Max(block_size, sizeof(PoolFreeBlock)), (upt)KIGU_POOL_ALIGNMENT);
+	pool->blocks_per_chunk = Max(blocks_per_chunk, (upt)1);
+	pool->free_list        = 0;
+	pool->chunks           = 0;
+	pool->carve_cursor     = 0;
+	pool->carve_end        = 0;
+	pool->chunk_count      = 0;
+	pool->reserved_count   = 0;
+	pool->backing          = backing;
+	pool->allocator        = 0;
+}
+
+//Initializes `pool` to hand out blocks that fit the type `T`
+#define pool_init_for_type(pool,T,blocks_per_chunk,backing) pool_init((pool), sizeof(T), (blocks_per_chunk), (backing))
+
+
+//Releases all of the chunks of `pool` back to its backing allocator (invalidating every block reserved from it)
+global void
+pool_deinit(Pool* pool){
+	for(PoolChunk* chunk = pool->chunks; chunk != 0; ){
+		PoolChunk* next = chunk->next;
+		pool->backing->release(chunk);
+		chunk = next;
+	}
+	if(pool->allocator) allocator_unbind(pool->allocator);
+	ZeroMemory(pool, sizeof(Pool));
+}
+
+
+//-////////////////////////////////////////////////////////////////////////////////////////////////
+//// @pool_blocks
+
+
+//Returns a zeroed block from `pool`, allocating a new chunk if there are no free blocks left
+global void*
+pool_reserve(Pool* pool){
+	void* result;
+	if(pool->free_list){
+		result = pool->free_list;
+		pool->free_list = pool->free_list->next;
+		ZeroMemory(result, pool->block_size);
+	}else{
+		if(pool->carve_cursor == pool->carve_end){
+			upt chunk_size = kigu__pool_chunk_header_size + pool->blocks_per_chunk*pool->block_size;
+			PoolChunk* chunk = (PoolChunk*)pool->backing->reserve(chunk_size);
+			if(!chunk){
+				Assert(!"failed to allocate pool chunk");
+				return 0;
+			}
+			chunk->next = pool->chunks;
+			pool->chunks = chunk;
+			pool->chunk_count += 1;
+			pool->carve_cursor = (u8*)chunk + kigu__pool_chunk_header_size;
+			pool->carve_end    = (u8*)chunk + chunk_size;
+		}
+		//carved blocks are zeroed too since the backing allocator might hand out dirty memory (or not zero it at all)
+		result = pool->carve_cursor;
+		pool->carve_cursor += pool->block_size;
+		ZeroMemory(result, pool->block_size);
+	}
+	pool->reserved_count += 1;
+	return result;
+}
+
+
+//Returns `block` (which must have been reserved from `pool`) to the free list of `pool`
+global void
+pool_release(Pool* pool, void* block){
+	if(!block) return;
+	PoolFreeBlock* free_block = (PoolFreeBlock*)block;
+	free_block->next = pool->free_list;
+	pool->free_list = free_block;
+	pool->reserved_count -= 1;
+}
+
+
+global int
+kigu__pool_compare_chunks(const void* a, const void* b){
+	u8* chunk_a = *(u8**)a;
+	u8* chunk_b = *(u8**)b;
+	return (chunk_a < chunk_b) ? -1 : (chunk_a > chunk_b) ? 1 : 0;
+}
+
+//Returns the chunk in the address-sorted `chunks` that contains `block`
+global PoolChunk*
+kigu__pool_find_chunk(PoolChunk** chunks, upt chunk_count, upt chunk_size, void* block){
+	upt lo = 0, hi = chunk_count;
+	while(lo < hi){
+		upt mid = lo + (hi - lo) / 2;
+		if((u8*)block < (u8*)chunks[mid]){
+			hi = mid;
+		}else if((u8*)block >= (u8*)chunks[mid] + chunk_size){
+			lo = mid + 1;
+		}else{
+			return chunks[mid];
+		}
+	}
+	return 0;
+}
+
+//Releases every chunk of `pool` that has no reserved blocks back to the backing allocator, returns the number released
+//  the chunk currently being carved is never released
+global upt
+pool_trim(Pool* pool){
+	if(pool->chunk_count < 2 || !pool->free_list) return 0;
+	upt chunk_size = kigu__pool_chunk_header_size + pool->blocks_per_chunk*pool->block_size;
+	
+	//sort the chunks by address so free blocks can find their chunk with a binary search
+	Scratch scratch = scratch_begin(0);
+	PoolChunk** sorted = (PoolChunk**)scratch.allocator->reserve(pool->chunk_count*sizeof(PoolChunk*));
+	upt sorted_count = 0;
+	for(PoolChunk* chunk = pool->chunks->next; chunk != 0; chunk = chunk->next){
+		chunk->free_count = 0;
+		sorted[sorted_count++] = chunk;
+	}
+	qsort(sorted, sorted_count, sizeof(PoolChunk*), kigu__pool_compare_chunks);
+	
+	//count the free blocks in each chunk
+	for(PoolFreeBlock* block = pool->free_list; block != 0; block = block->next){
+		PoolChunk* chunk = kigu__pool_find_chunk(sorted, sorted_count, chunk_size, block);
+		if(chunk) chunk->free_count += 1;
+	}
+	
+	//rebuild the free list without the blocks of empty chunks
+	PoolFreeBlock** link = &pool->free_list;
+	while(*link){
+		PoolChunk* chunk = kigu__pool_find_chunk(sorted, sorted_count, chunk_size, *link);
+		if(chunk && chunk->free_count == pool->blocks_per_chunk){
+			*link = (*link)->next;
+		}else{
+			link = &(*link)->next;
+		}
+	}
+	
+	//release the empty chunks
+	upt released = 0;
+	PoolChunk** chunk_link = &pool->chunks->next;
+	while(*chunk_link){
+		PoolChunk* chunk = *chunk_link;
+		if(chunk->free_count == pool->blocks_per_chunk){
+			*chunk_link = chunk->next;
+			pool->backing->release(chunk);
+			released += 1;
+		}else{
+			chunk_link = &chunk->next;
+		}
+	}
+	pool->chunk_count -= released;
+	
+	scratch_end(scratch);
+	return released;
+}
+
+
+//-////////////////////////////////////////////////////////////////////////////////////////////////
+//// @pool_allocator
+
+
+global void*
+kigu__pool_allocator_reserve(void* context, upt size){
+	Pool* pool = (Pool*)context;
+	if(size > pool->block_size){
+		Assert(!"requested more memory than the pool's block size");
+		return 0;
+	}
+	return pool_reserve(pool);
+}
+
+global void
+kigu__pool_allocator_release(void* context, void* ptr){
+	pool_release((Pool*)context, ptr);
+}
+
+global void*
+kigu__pool_allocator_resize(void* context, void* ptr, upt size){
+	Pool* pool = (Pool*)context;
+	if(!ptr) return kigu__pool_allocator_reserve(context, size);
+	if(size > pool->block_size){
+		Assert(!"requested more memory than the pool's block size");
+		return 0;
+	}
+	return ptr;
+}
+
+
+//Returns an `Allocator` that reserves blocks from `pool`, the same `Allocator` is returned on subsequent calls
+global Allocator*
+pool_allocator(Pool* pool){
+	if(!pool->allocator){
+		pool->allocator = allocator_bind(pool, kigu__pool_allocator_reserve, kigu__pool_allocator_release, kigu__pool_allocator_resize);
+		if(pool->allocator){
+			pool->allocator->flags     = AllocatorFlags_ZeroReserve;
+			pool->allocator->alignment = KIGU_POOL_ALIGNMENT;
+		}
+	}
+	return pool->allocator;
+}
+
+
+EndLinkageC();
+//-////////////////////////////////////////////////////////////////////////////////////////////////
+//// @pool_tests
+#ifdef KIGU_UNIT_TESTS
+
+
+#include "node.h"
+
+
+global void kigu__pool_unit_tests()
+{
+	{//// reserve/release ////
+		Pool pool;
+		pool_init(&pool, 20, 4, stl_allocator);
+		AssertAlways(pool.block_size == 32);
+		
+		u8* a = (u8*)pool_reserve(&pool);
+		u8* b = (u8*)pool_reserve(&pool);
+		AssertAlways(a != 0 && b == a + pool.block_size);
+		AssertAlways((upt)a % KIGU_POOL_ALIGNMENT == 0);
+		AssertAlways(pool.chunk_count == 1);
+		AssertAlways(pool.reserved_count == 2);
+		forI(32) a[i] = 0xff;
+		
+		//released blocks are reused first and zeroed
+		pool_release(&pool, a);
+		AssertAlways(pool.reserved_count == 1);
+		u8* c = (u8*)pool_reserve(&pool);
+		AssertAlways(c == a);
+		forI(32) AssertAlways(c[i] == 0);
+		
+		//a new chunk is allocated once the first is used up
+		pool_reserve(&pool);
+		pool_reserve(&pool);
+		AssertAlways(pool.chunk_count == 1);
+		pool_reserve(&pool);
+		AssertAlways(pool.chunk_count == 2);
+		
+		pool_deinit(&pool);
+		AssertAlways(pool.chunks == 0);
+	}
+	
+	{//// non-zeroing backing allocator ////
+		persist auto dirty_reserve = [](upt size) -> void*{ void* result = malloc(size); memset(result, 0xAB, size); return result; };
+		Allocator dirty{dirty_reserve, Allocator_ChangeMemory_Noop, Allocator_ChangeMemory_Noop, free, realloc, 0, AllocatorFlags_None, 0};
+		Pool pool;
+		pool_init(&pool, 48, 4, &dirty);
+		Allocator* allocator = pool_allocator(&pool);
+		AssertAlways(HasFlag(allocator->flags, AllocatorFlags_ZeroReserve));
+		u8* blocks[8];
+		forI(8){
+			blocks[i] = (u8*)allocator->reserve(48);
+			forX(j, 48) AssertAlways(blocks[i][j] == 0);
+			memset(blocks[i], 0xCD, 48);
+		}
+		forI(8) allocator->release(blocks[i]);
+		forI(8){
+			u8* block = (u8*)allocator->reserve(48);
+			forX(j, 48) AssertAlways(block[j] == 0);
+		}
+		pool_deinit(&pool);
+	}
+	
+	{//// trim ////
+		Pool pool;
+		pool_init(&pool, 16, 8, stl_allocator);
+		void* blocks[32];
+		forI(32) blocks[i] = pool_reserve(&pool);
+		AssertAlways(pool.chunk_count == 4);
+		
+		//free all of the first two chunks and half of the third
+		forI(20) pool_release(&pool, blocks[i]);
+		AssertAlways(pool_trim(&pool) == 2);
+		AssertAlways(pool.chunk_count == 2);
+		
+		//the free list only has blocks from the remaining chunks
+		upt free_count = 0;
+		for(PoolFreeBlock* block = pool.free_list; block != 0; block = block->next) free_count += 1;
+		AssertAlways(free_count == 4);
+		
+		pool_deinit(&pool);
+	}
+	
+	{//// allocator ////
+		Pool pool;
+		pool_init_for_type(&pool, TNode, 64, stl_allocator);
+		Allocator* allocator = pool_allocator(&pool);
+		AssertAlways(allocator != 0 && pool_allocator(&pool) == allocator);
+		
+		TNode* root = (TNode*)allocator->reserve(sizeof(TNode));
+		forI(100){
+			TNode* child = (TNode*)allocator->reserve(sizeof(TNode));
+			insert_last(root, child);
+		}
+		AssertAlways(root->child_count == 100);
+		AssertAlways(pool.reserved_count == 101);
+		
+		//siblings reserved one after another are adjacent
+		AssertAlways((u8*)root->first_child->next == (u8*)root->first_child + pool.block_size);
+		
+		for(TNode* it = root->first_child; it != 0; ){
+			TNode* next = it->next;
+			allocator->release(it);
+			it = next;
+		}
+		allocator->release(root);
+		AssertAlways(pool.reserved_count == 0);
+		
+		pool_deinit(&pool);
+	}
+}
+
+
+#endif //#ifdef KIGU_UNIT_TESTS
+#endif //#ifndef KIGU_POOL_H
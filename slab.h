@@ -0,0 +1,420 @@
+/* kigu slab module
+WHAT:
+This module provides a general purpose allocator built from size classes. Small requests are rounded up to one of
+KIGU_SLAB_CLASS_COUNT size classes (multiples of 16 up to 128, then four classes between each power of two up to
+KIGU_SLAB_MAX_CLASS_SIZE) and served from that class's free list, with new blocks carved out of 64KB spans of one large
+reserved address range. Requests bigger than the largest class are mapped directly from the OS.
+
+WHY:
+`stl_allocator` calls calloc for every reserve (so every allocation pays for zeroing) and realloc for every resize. Most
+allocations made by kigu strings and arrays are small and come in a handful of sizes, so a free list per size class turns them
+into a couple of pointer writes, and resizes that stay within a size class don't have to move at all.
+
+NOTES:
+- `slab_allocator` can replace `stl_allocator` as KIGU_ARRAY_ALLOCATOR, KIGU_STRING_ALLOCATOR, or KIGU_UNICODE_ALLOCATOR, as
+  long as slab.h is included before the headers that use those defines.
+- Reserved memory is zero filled, but only recycled blocks are explicitly zeroed since carved and mapped memory is fresh.
+  slab_reserve_uninitialized() (the allocator's `reserve_uninitialized`) skips zeroing recycled blocks.
+- Every block is aligned to 16 bytes.
+- Like realloc, resize() does not zero the memory beyond the old size.
+- Growing a directly mapped allocation remaps its pages with os_memory_remap() instead of copying them where supported.
+- Spans are never returned to the OS once carved; directly mapped allocations are unmapped on release.
+- The slab's state is a single inline variable, so every translation unit that includes slab.h shares the same slab and
+  memory reserved in one can be released in another.
+- The slab address range is reserved on the first allocation and its size is KIGU_SLAB_RESERVE_SIZE (64GB by default).
+- Each size class has its own spin lock, so threads only contend when allocating from the same size class.
+  slab_reserve_batch() and slab_release_batch() move many blocks per lock for front-ends like tcache.h.
+
+INDEX:
+@slab_classes
+  slab_class_index(upt size) -> u32
+  slab_class_size(u32 index) -> upt
+@slab_allocator
+  slab_reserve(upt size) -> void*
+  slab_reserve_uninitialized(upt size) -> void*
+  slab_release(void* ptr) -> void
+  slab_resize(void* ptr, upt size) -> void*
+  slab_reserve_batch(u32 index, u32 count, u32* out_count) -> SlabFreeBlock*
+  slab_release_batch(u32 index, SlabFreeBlock* first, SlabFreeBlock* last) -> void
+  slab_allocator: Allocator*
+@slab_tests
+*/
+#pragma once
+#ifndef KIGU_SLAB_H
+#define KIGU_SLAB_H
+
+
+#ifndef KIGU_SLAB_RESERVE_SIZE
+#  define KIGU_SLAB_RESERVE_SIZE Gigabytes(64)
+#endif
+#ifndef KIGU_SLAB_SPAN_SIZE
+#  define KIGU_SLAB_SPAN_SIZE Kilobytes(64)
+#endif
+
+
+#include "common.h"
+#include "memory.h"
+
+
+StartLinkageC();
+//-////////////////////////////////////////////////////////////////////////////////////////////////
+//// @slab_classes
+
+
+#define KIGU_SLAB_CLASS_COUNT 40
+#define KIGU_SLAB_MAX_CLASS_SIZE Kilobytes(32)
+#define KIGU_SLAB_LARGE_HEADER_SIZE 16
+
+//Returns the size class that fits `size` bytes (`size` must be no more than KIGU_SLAB_MAX_CLASS_SIZE)
+FORCE_INLINE u32
+slab_class_index(upt size){
+	if(size <= 128) return (size) ? (u32)((size + 15) >> 4) - 1 : 0;
+	upt s = size - 1;
+	u32 p = FloorLog2(s);
+	return 8 + (p - 7)*4 + (u32)(s >> (p - 2)) - 4;
+}
+
+
+//Returns the number of bytes a block of the size class `index` holds
+FORCE_INLINE upt
+slab_class_size(u32 index){
+	if(index < 8) return ((upt)index + 1) << 4;
+	u32 p = 7 + (index - 8) / 4;
+	return ((upt)1 << p) + ((upt)((index - 8) % 4) + 1)*((upt)1 << (p - 2));
+}
+
+
+//-////////////////////////////////////////////////////////////////////////////////////////////////
+//// @slab_allocator
+
+
+typedef struct SlabFreeBlock{
+	struct SlabFreeBlock* next;
+}SlabFreeBlock;
+
+typedef struct SlabClass{
+	volatile s32 lock;
+	SlabFreeBlock* free_list; //released blocks of this class
+	u8* carve_cursor;         //next uncarved block in this class's newest span
+	u8* carve_end;            //end of this class's newest span
+}SlabClass;
+
+typedef struct SlabState{
+	volatile s32 lock;        //guards initialization and carving spans
+	volatile s32 initialized;
+	u8* base;                 //start of the reserved span range
+	u8* cursor;               //next uncarved span
+	u8* end;                  //end of the reserved span range
+	u8* span_classes;         //size class of each carved span
+	SlabClass classes[KIGU_SLAB_CLASS_COUNT];
+}SlabState;
+
+//inline so every translation unit shares the same slab (a per-TU copy would release blocks into the wrong heap)
+inline SlabState kigu__slab;
+
+
+//Reserves the span range and the span class map the first time the slab allocator is used
+global b32
+kigu__slab_init(){
+	kigu__spin_lock(&kigu__slab.lock);
+	if(!kigu__slab.initialized){
+		upt map_size = AlignToPow2((upt)(KIGU_SLAB_RESERVE_SIZE / KIGU_SLAB_SPAN_SIZE), os_memory_page_size());
+		u8* map  = (u8*)os_memory_reserve(map_size);
+		u8* base = (u8*)os_memory_reserve(KIGU_SLAB_RESERVE_SIZE);
+		if(!map || !base || !os_memory_commit(map, map_size)){
+			Assert(!"failed to reserve slab address space");
+			kigu__spin_unlock(&kigu__slab.lock);
+			return false;
+		}
+		kigu__slab.base         = base;
+		kigu__slab.cursor       = base;
+		kigu__slab.end          = base + KIGU_SLAB_RESERVE_SIZE;
+		kigu__slab.span_classes = map;
+		kigu__store_release(&kigu__slab.initialized, 1);
+	}
+	kigu__spin_unlock(&kigu__slab.lock);
+	return true;
+}
+
+
+//Commits the next span and assigns it to the size class `index`, returns 0 if the span range is used up
+global u8*
+kigu__slab_carve_span(u32 index){
+	u8* span = 0;
+	kigu__spin_lock(&kigu__slab.lock);
+	if(kigu__slab.cursor < kigu__slab.end && os_memory_commit(kigu__slab.cursor, KIGU_SLAB_SPAN_SIZE)){
+		span = kigu__slab.cursor;
+		kigu__slab.span_classes[(span - kigu__slab.base) / KIGU_SLAB_SPAN_SIZE] = (u8)index;
+		kigu__slab.cursor += KIGU_SLAB_SPAN_SIZE;
+	}
+	kigu__spin_unlock(&kigu__slab.lock);
+	Assert(span, "ran out of slab address space; increase KIGU_SLAB_RESERVE_SIZE");
+	return span;
+}
+
+
+//Returns true if `ptr` was carved from a span rather than mapped directly
+FORCE_INLINE b32
+kigu__slab_owns(void* ptr){
+	return ((u8*)ptr >= kigu__slab.base) && ((u8*)ptr < kigu__slab.end);
+}
+
+
+//Returns the size class of the block `ptr` (which must have been carved from a span)
+FORCE_INLINE u32
+kigu__slab_class_of(void* ptr){
+	return kigu__slab.span_classes[((u8*)ptr - kigu__slab.base) / KIGU_SLAB_SPAN_SIZE];
+}
+
+
+//Returns `size` bytes, only zeroing recycled blocks if `zero` is true (carved and mapped memory is always zero)
+global void*
+kigu__slab_reserve(upt size, b32 zero){
+	if(!kigu__load_acquire(&kigu__slab.initialized) && !kigu__slab_init()) return 0;
+	
+	//large allocations are mapped directly and prefixed with their mapped size
+	if(size > KIGU_SLAB_MAX_CLASS_SIZE){
+		upt mapped_size = AlignToPow2(size + KIGU_SLAB_LARGE_HEADER_SIZE, os_memory_page_size());
+		u8* mapped = (u8*)os_memory_reserve(mapped_size);
+		if(!mapped || !os_memory_commit(mapped, mapped_size)){
+			Assert(!"failed to map large slab allocation");
+			return 0;
+		}
+		*(upt*)mapped = mapped_size;
+		return mapped + KIGU_SLAB_LARGE_HEADER_SIZE;
+	}
+	
+	u32 index = slab_class_index(size);
+	upt block_size = slab_class_size(index);
+	SlabClass* sc = &kigu__slab.classes[index];
+	void* result = 0;
+	kigu__spin_lock(&sc->lock);
+	if(sc->free_list){
+		result = sc->free_list;
+		sc->free_list = sc->free_list->next;
+		kigu__spin_unlock(&sc->lock);
+		if(zero) ZeroMemory(result, block_size);
+		return result;
+	}
+	if(sc->carve_cursor + block_size > sc->carve_end){
+		u8* span = kigu__slab_carve_span(index);
+		if(!span){
+			kigu__spin_unlock(&sc->lock);
+			return 0;
+		}
+		sc->carve_cursor = span;
+		sc->carve_end    = span + KIGU_SLAB_SPAN_SIZE;
+	}
+	result = sc->carve_cursor;
+	sc->carve_cursor += block_size;
+	kigu__spin_unlock(&sc->lock);
+	return result;
+}
+
+
+//Returns `size` zeroed bytes
+global void*
+slab_reserve(upt size){
+	return kigu__slab_reserve(size, true);
+}
+
+
+//Returns `size` bytes which are not guaranteed to be zeroed
+global void*
+slab_reserve_uninitialized(upt size){
+	return kigu__slab_reserve(size, false);
+}
+
+
+//Releases `ptr` (which must have been returned by slab_reserve() or slab_resize())
+global void
+slab_release(void* ptr){
+	if(!ptr) return;
+	if(!kigu__slab_owns(ptr)){
+		u8* mapped = (u8*)ptr - KIGU_SLAB_LARGE_HEADER_SIZE;
+		os_memory_release(mapped, *(upt*)mapped);
+		return;
+	}
+	
+	u32 index = kigu__slab_class_of(ptr);
+	SlabClass* sc = &kigu__slab.classes[index];
+	SlabFreeBlock* block = (SlabFreeBlock*)ptr;
+	kigu__spin_lock(&sc->lock);
+	block->next = sc->free_list;
+	sc->free_list = block;
+	kigu__spin_unlock(&sc->lock);
+}
+
+
+//Resizes `ptr` to `size` bytes, only moving it if `size` no longer fits in its size class (or mapping)
+global void*
+slab_resize(void* ptr, upt size){
+	if(!ptr) return slab_reserve(size);
+	
+	upt old_size;
+	if(kigu__slab_owns(ptr)){
+		u32 index = kigu__slab_class_of(ptr);
+		old_size = slab_class_size(index);
+		if(size <= old_size && (index == 0 || size > slab_class_size(index - 1))) return ptr;
+	}else{
+		u8* mapped = (u8*)ptr - KIGU_SLAB_LARGE_HEADER_SIZE;
+		upt mapped_size = *(upt*)mapped;
+		old_size = mapped_size - KIGU_SLAB_LARGE_HEADER_SIZE;
+		if(size <= old_size && size > KIGU_SLAB_MAX_CLASS_SIZE) return ptr;
+		
+		//grow large allocations by remapping their pages rather than copying them (if the OS supports it)
+		if(size > KIGU_SLAB_MAX_CLASS_SIZE){
+			upt new_mapped_size = AlignToPow2(size + KIGU_SLAB_LARGE_HEADER_SIZE, os_memory_page_size());
+			u8* remapped = (u8*)os_memory_remap(mapped, mapped_size, new_mapped_size);
+			if(remapped){
+				*(upt*)remapped = new_mapped_size;
+				return remapped + KIGU_SLAB_LARGE_HEADER_SIZE;
+			}
+		}
+	}
+	
+	void* result = slab_reserve(size);
+	if(!result) return 0;
+	CopyMemory(result, ptr, Min(old_size, size));
+	slab_release(ptr);
+	return result;
+}
+
+
+//Takes up to `count` blocks of the size class `index` (released blocks first, then newly carved ones) while locking the size
+//  class once, returns them as a list and sets `out_count` to the number of blocks taken; the blocks are not zeroed
+global SlabFreeBlock*
+slab_reserve_batch(u32 index, u32 count, u32* out_count){
+	*out_count = 0;
+	if(!kigu__load_acquire(&kigu__slab.initialized) && !kigu__slab_init()) return 0;
+	
+	upt block_size = slab_class_size(index);
+	SlabClass* sc = &kigu__slab.classes[index];
+	SlabFreeBlock* result = 0;
+	u32 taken = 0;
+	kigu__spin_lock(&sc->lock);
+	while(taken < count && sc->free_list){
+		SlabFreeBlock* block = sc->free_list;
+		sc->free_list = block->next;
+		block->next = result;
+		result = block;
+		taken += 1;
+	}
+	while(taken < count){
+		if(sc->carve_cursor + block_size > sc->carve_end){
+			u8* span = kigu__slab_carve_span(index);
+			if(!span) break;
+			sc->carve_cursor = span;
+			sc->carve_end    = span + KIGU_SLAB_SPAN_SIZE;
+		}
+		SlabFreeBlock* block = (SlabFreeBlock*)sc->carve_cursor;
+		sc->carve_cursor += block_size;
+		block->next = result;
+		result = block;
+		taken += 1;
+	}
+	kigu__spin_unlock(&sc->lock);
+	*out_count = taken;
+	return result;
+}
+
+
+//Returns the list of blocks from `first` to `last` (which must all be of the size class `index`) while locking the size
+//  class once
+global void
+slab_release_batch(u32 index, SlabFreeBlock* first, SlabFreeBlock* last){
+	SlabClass* sc = &kigu__slab.classes[index];
+	kigu__spin_lock(&sc->lock);
+	last->next = sc->free_list;
+	sc->free_list = first;
+	kigu__spin_unlock(&sc->lock);
+}
+
+
+global Allocator slab_allocator_{
+	slab_reserve,
+	Allocator_ChangeMemory_Noop,
+	Allocator_ChangeMemory_Noop,
+	slab_release,
+	slab_resize,
+	slab_reserve_uninitialized,
+	AllocatorFlags_ZeroReserve,
+	16
+};
+global Allocator* slab_allocator = &slab_allocator_;
+
+
+EndLinkageC();
+//-////////////////////////////////////////////////////////////////////////////////////////////////
+//// @slab_tests
+#ifdef KIGU_UNIT_TESTS
+
+
+global void kigu__slab_unit_tests()
+{
+	{//// classes ////
+		AssertAlways(slab_class_index(0) == 0);
+		AssertAlways(slab_class_index(1) == 0);
+		AssertAlways(slab_class_index(16) == 0);
+		AssertAlways(slab_class_index(17) == 1);
+		AssertAlways(slab_class_index(128) == 7);
+		AssertAlways(slab_class_index(129) == 8);
+		AssertAlways(slab_class_index(KIGU_SLAB_MAX_CLASS_SIZE) == KIGU_SLAB_CLASS_COUNT-1);
+		AssertAlways(slab_class_size(KIGU_SLAB_CLASS_COUNT-1) == KIGU_SLAB_MAX_CLASS_SIZE);
+		for(upt size = 1; size <= KIGU_SLAB_MAX_CLASS_SIZE; size += 1){
+			u32 index = slab_class_index(size);
+			AssertAlways(slab_class_size(index) >= size);
+			AssertAlways(index == 0 || slab_class_size(index-1) < size);
+		}
+	}
+	
+	{//// reserve/release ////
+		u8* a = (u8*)slab_allocator->reserve(24);
+		u8* b = (u8*)slab_allocator->reserve(24);
+		AssertAlways(a != 0 && b == a + 32);
+		forI(32) a[i] = 0xff;
+		
+		//released blocks are reused and zeroed
+		slab_allocator->release(a);
+		u8* c = (u8*)slab_allocator->reserve(30);
+		AssertAlways(c == a);
+		forI(32) AssertAlways(c[i] == 0);
+		
+		//large allocations
+		u8* d = (u8*)slab_allocator->reserve(Megabytes(1));
+		AssertAlways(d != 0 && !kigu__slab_owns(d));
+		AssertAlways(d[0] == 0 && d[Megabytes(1)-1] == 0);
+		slab_allocator->release(d);
+		
+		slab_allocator->release(b);
+		slab_allocator->release(c);
+	}
+	
+	{//// resize ////
+		u8* a = (u8*)slab_allocator->reserve(100);
+		forI(100) a[i] = (u8)i;
+		
+		//staying within the size class doesn't move
+		AssertAlways(slab_allocator->resize(a, 112) == a);
+		
+		//growing out of the size class moves and copies
+		u8* b = (u8*)slab_allocator->resize(a, 1000);
+		AssertAlways(b != a);
+		forI(100) AssertAlways(b[i] == (u8)i);
+		
+		//growing into and within the large path
+		u8* c = (u8*)slab_allocator->resize(b, Megabytes(1));
+		forI(100) AssertAlways(c[i] == (u8)i);
+		AssertAlways(slab_allocator->resize(c, Megabytes(1) - 10) == c);
+		
+		//shrinking back down to a size class
+		u8* d = (u8*)slab_allocator->resize(c, 50);
+		AssertAlways(kigu__slab_owns(d));
+		forI(50) AssertAlways(d[i] == (u8)i);
+		slab_allocator->release(d);
+	}
+}
+
+
+#endif //#ifdef KIGU_UNIT_TESTS
+#endif //#ifndef KIGU_SLAB_H
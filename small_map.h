@@ -0,0 +1,345 @@
+/* kigu small_map module
+WHAT:
+This module provides `small_map`, a key/value map that stores up to N keys inline (in the small_map itself) and only moves them
+into a heap allocated `map` once it outgrows them. While inline, finding a key compares its hash against the inline hashes
+four at a time (SSE2 on x86, NEON on ARM64, a scalar loop otherwise) and only compares keys whose hash matched.
+
+WHY:
+Most maps and sets attached to objects hold a handful of entries, but every `map` owns four arrayTs (plus their allocations)
+before it holds anything. Millions of small property maps were mostly allocator overhead; a small_map with a few entries never
+allocates, and is small enough to be scanned in one or two cache lines.
+
+NOTES:
+- N must be between 1 and 32. The inline hashes are padded to a multiple of 4 so every compare is a full vector; padding and
+  slots past `count` are masked off.
+- Once a small_map spills it stays spilled (even if keys are removed) until clear(), which frees the heap map and goes back to
+  storing keys inline.
+- Like map, keys and values are kept densely (key(i) and value(i) for i below `count`) and removing a key moves the last key
+  and value into its index, so indexes and pointers are invalidated by remove, and pointers are invalidated by add.
+- Iterating a small_map with a range for yields its values, like map.
+- Keys and values are assigned into inline arrays, so they must be default constructible. small_maps are not copyable.
+
+INDEX:
+@small_map_match
+  KIGU_SMALL_MAP_SSE2, KIGU_SMALL_MAP_NEON
+  kigu__small_map_match(const u32* hashes, u32 count, u32 hashed) -> u32
+@small_map
+  small_map<Key,Value,N,HashStruct,EqualStruct>(Allocator* allocator)
+    add(const Key& key) -> Value*
+    add(const Key& key, const Value& value) -> Value*
+    at(const Key& key) -> Value*
+    has(const Key& key) -> bool
+    operator[](const Key& key) -> Value&
+    remove(const Key& key) -> void
+    clear() -> void
+    spilled() -> bool
+    key(u32 index) -> const Key&
+    value(u32 index) -> Value&
+@small_map_tests
+*/
+#pragma once
+#ifndef KIGU_SMALL_MAP_H
+#define KIGU_SMALL_MAP_H
+
+
+#include <new>
+#include "common.h"
+#include "hash.h"
+#include "map.h"
+#include "profiling.h"
+
+#if ARCH_X64 || (ARCH_X86 && (defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)))
+#  define KIGU_SMALL_MAP_SSE2 1
+#  define KIGU_SMALL_MAP_NEON 0
+#  include <emmintrin.h>
+#elif ARCH_ARM64
+#  define KIGU_SMALL_MAP_SSE2 0
+#  define KIGU_SMALL_MAP_NEON 1
+#  include <arm_neon.h>
+#else
+#  define KIGU_SMALL_MAP_SSE2 0
+#  define KIGU_SMALL_MAP_NEON 0
+#endif
+
+
+//-////////////////////////////////////////////////////////////////////////////////////////////////
+//// @small_map_match
+
+
+//Returns a mask of the first `count` hashes in `hashes` (16 byte aligned, padded to a multiple of 4) that are `hashed`
+FORCE_INLINE u32
+kigu__small_map_match(const u32* hashes, u32 count, u32 hashed){
+	u32 mask = 0;
+#if KIGU_SMALL_MAP_SSE2
+	__m128i wanted = _mm_set1_epi32((int)hashed);
+	for(u32 i = 0; i < count; i += 4){
+		__m128i compare = _mm_cmpeq_epi32(_mm_load_si128((const __m128i*)(hashes + i)), wanted);
+		mask |= (u32)_mm_movemask_ps(_mm_castsi128_ps(compare)) << i;
+	}
+#elif KIGU_SMALL_MAP_NEON
+	const u32 lane_bits[4] = {1, 2, 4, 8};
+	uint32x4_t wanted = vdupq_n_u32(hashed);
+	uint32x4_t bits = vld1q_u32(lane_bits);
+	for(u32 i = 0; i < count; i += 4){
+		uint32x4_t compare = vceqq_u32(vld1q_u32(hashes + i), wanted);
+		mask |= vaddvq_u32(vandq_u32(compare, bits)) << i;
+	}
+#else
+	forI(count) if(hashes[i] == hashed) mask |= (u32)1 << i;
+#endif
+	return (count < 32) ? mask & (((u32)1 << count) - 1) : mask;
+}
+
+
+//-////////////////////////////////////////////////////////////////////////////////////////////////
+//// @small_map
+
+
+template<typename Key, typename Value, u32 N = 8, typename HashStruct = hash<Key>, typename EqualStruct = hash_equal<Key>>
+struct small_map{
+	static_assert(N > 0 && N <= 32, "small_map holds between 1 and 32 keys inline");
+	typedef map<Key,Value,HashStruct,EqualStruct> spill_map;
+	
+	alignas(16) u32 hashes[(N + 3) & ~3u];
+	Key   keys[N];
+	Value values[N];
+	u32 count;
+	spill_map* heap; //holds every key once the small_map has spilled, otherwise 0
+	Allocator* allocator;
+	
+	small_map(Allocator* a = stl_allocator);
+	~small_map();
+	small_map(const small_map&) = delete;
+	small_map& operator=(const small_map&) = delete;
+	
+	Value& operator[](const Key& key);
+	
+	void   clear(); //removes every key and frees the heap map if it spilled
+	Value* add(const Key& key); //returns the value of the added or existing key
+	Value* add(const Key& key, const Value& value);
+	void   remove(const Key& key);
+	bool   has(const Key& key) const;
+	Value* at(const Key& key);
+	bool   spilled() const{ return heap != 0; }
+	const Key& key(u32 index) const{ return (heap) ? heap->keys.data[index] : keys[index]; }
+	Value&     value(u32 index){ return (heap) ? heap->data.data[index] : values[index]; }
+	
+	u32  kigu__find(const Key& key, u32 hashed) const; //returns the inline index holding `key`, or -1
+	void kigu__spill();
+	
+	Value* begin(){DPZoneScoped; return (heap) ? heap->data.begin() : values; }
+	Value* end()  {DPZoneScoped; return (heap) ? heap->data.end() : values + count; }
+};
+
+/////////////////////
+//// @internals ////
+/////////////////////
+template<typename Key, typename Value, u32 N, typename HashStruct, typename EqualStruct> inline u32 small_map<Key,Value,N,HashStruct,EqualStruct>::
+kigu__find(const Key& key, u32 hashed)const{
+	for(u32 match = kigu__small_map_match(hashes, count, hashed); match; match &= match - 1){
+		u32 index = CountTrailingZeros64(match);
+		if(EqualStruct{}(keys[index], key)) return index;
+	}
+	return -1;
+}
+
+template<typename Key, typename Value, u32 N, typename HashStruct, typename EqualStruct> inline void small_map<Key,Value,N,HashStruct,EqualStruct>::
+kigu__spill(){DPZoneScoped;
+	heap = new(allocator->reserve(sizeof(spill_map))) spill_map(allocator);
+	heap->insert_batch(keys, values, count);
+	forI(N){
+		keys[i].~Key();
+		values[i].~Value();
+		memset((void*)&keys[i],   0, sizeof(Key));
+		memset((void*)&values[i], 0, sizeof(Value));
+	}
+}
+
+//////////////////////
+//// @contructors ////
+//////////////////////
+template<typename Key, typename Value, u32 N, typename HashStruct, typename EqualStruct> inline small_map<Key,Value,N,HashStruct,EqualStruct>::
+small_map(Allocator* a) : hashes{}, keys{}, values{}{DPZoneScoped;
+	count     = 0;
+	heap      = 0;
+	allocator = a;
+}
+
+template<typename Key, typename Value, u32 N, typename HashStruct, typename EqualStruct> inline small_map<Key,Value,N,HashStruct,EqualStruct>::
+~small_map(){
+	if(heap){
+		heap->~spill_map();
+		allocator->release(heap);
+		heap = 0;
+	}
+}
+
+////////////////////
+//// @operators ////
+////////////////////
+template<typename Key, typename Value, u32 N, typename HashStruct, typename EqualStruct> inline Value& small_map<Key,Value,N,HashStruct,EqualStruct>::
+operator[](const Key& key){DPZoneScoped;
+	Value* value = at(key);
+	if(value){ return *value; }
+	throw "nokey";
+}
+
+////////////////////
+//// @functions ////
+////////////////////
+template<typename Key, typename Value, u32 N, typename HashStruct, typename EqualStruct> inline void small_map<Key,Value,N,HashStruct,EqualStruct>::
+clear(){DPZoneScoped;
+	if(heap){
+		heap->~spill_map();
+		allocator->release(heap);
+		heap = 0;
+	}else{
+		forI(count){
+			keys[i]   = Key();
+			values[i] = Value();
+		}
+	}
+	count = 0;
+}
+
+template<typename Key, typename Value, u32 N, typename HashStruct, typename EqualStruct> inline Value* small_map<Key,Value,N,HashStruct,EqualStruct>::
+add(const Key& key){DPZoneScoped;
+	return add(key, Value());
+}
+
+template<typename Key, typename Value, u32 N, typename HashStruct, typename EqualStruct> inline Value* small_map<Key,Value,N,HashStruct,EqualStruct>::
+add(const Key& key, const Value& value){DPZoneScoped;
+	if(!heap){
+		u32 hashed = HashStruct{}(key);
+		u32 index = kigu__find(key, hashed);
+		if(index != -1){ return &values[index]; }
+		if(count < N){
+			hashes[count] = hashed;
+			keys[count]   = key;
+			values[count] = value;
+			count++;
+			return &values[count-1];
+		}
+		kigu__spill();
+	}
+	u32 index = heap->add(key, value);
+	count = heap->count;
+	return &heap->data.data[index];
+}
+
+template<typename Key, typename Value, u32 N, typename HashStruct, typename EqualStruct> inline void small_map<Key,Value,N,HashStruct,EqualStruct>::
+remove(const Key& key){DPZoneScoped;
+	if(heap){
+		heap->remove(key);
+		count = heap->count;
+		return;
+	}
+	u32 index = kigu__find(key, HashStruct{}(key));
+	if(index == -1) return;
+	u32 last = count-1;
+	if(index != last){
+		hashes[index] = hashes[last];
+		keys[index]   = keys[last];
+		values[index] = values[last];
+	}
+	keys[last]   = Key();
+	values[last] = Value();
+	count--;
+}
+
+template<typename Key, typename Value, u32 N, typename HashStruct, typename EqualStruct> inline bool small_map<Key,Value,N,HashStruct,EqualStruct>::
+has(const Key& key)const{DPZoneScoped;
+	if(heap) return heap->has(key);
+	return kigu__find(key, HashStruct{}(key)) != -1;
+}
+
+template<typename Key, typename Value, u32 N, typename HashStruct, typename EqualStruct> inline Value* small_map<Key,Value,N,HashStruct,EqualStruct>::
+at(const Key& key){DPZoneScoped;
+	if(heap) return heap->at(key);
+	u32 index = kigu__find(key, HashStruct{}(key));
+	if(index != -1){ return &values[index]; }
+	return 0;
+}
+
+
+//-////////////////////////////////////////////////////////////////////////////////////////////////
+//// @small_map_tests
+#ifdef KIGU_UNIT_TESTS
+
+
+global void kigu__small_map_unit_tests()
+{
+	{//// hash matching ////
+		alignas(16) u32 hashes[8] = {5, 1, 5, 2, 3, 5, 5, 5};
+		AssertAlways(kigu__small_map_match(hashes, 8, 5) == 0xE5);
+		AssertAlways(kigu__small_map_match(hashes, 6, 5) == 0x25); //past `count` is masked off
+		AssertAlways(kigu__small_map_match(hashes, 1, 5) == 0x1);
+		AssertAlways(kigu__small_map_match(hashes, 8, 4) == 0);
+		AssertAlways(kigu__small_map_match(hashes, 0, 5) == 0);
+		alignas(16) u32 full[32];
+		forI(32) full[i] = (u32)i % 3;
+		u32 expected = 0;
+		forI(32) if(i % 3 == 0) expected |= (u32)1 << i;
+		AssertAlways(kigu__small_map_match(full, 32, 0) == expected);
+	}
+	
+	{//// inline ////
+		small_map<u32,u32,8> m;
+		forI(8) AssertAlways(*m.add(i * 10, i) == i);
+		AssertAlways(m.count == 8 && !m.spilled());
+		forI(8) AssertAlways(m.has(i * 10) && *m.at(i * 10) == i && m[i * 10] == i);
+		AssertAlways(!m.has(5) && m.at(5) == 0);
+		
+		//adding an existing key returns its value and doesn't change it
+		AssertAlways(*m.add(30, 99) == 3 && m.count == 8 && !m.spilled());
+		
+		m.remove(30);
+		AssertAlways(m.count == 7 && !m.has(30) && m.key(3) == 70 && m.value(3) == 7);
+		m.remove(30);
+		AssertAlways(m.count == 7);
+		m.add(30, 3);
+		u32 sum = 0;
+		for(u32 v : m) sum += v;
+		AssertAlways(sum == 28 && !m.spilled());
+	}
+	
+	{//// keys with the same hash ////
+		struct ZeroHash{ u32 operator()(const u32& v)const{ return 0; } };
+		small_map<u32,u32,5,ZeroHash> m;
+		forI(5) m.add(i, i + 100);
+		forI(5) AssertAlways(*m.at(i) == i + 100);
+		AssertAlways(!m.has(5));
+		m.remove(0);
+		AssertAlways(!m.has(0) && *m.at(4) == 104);
+	}
+	
+	{//// spilling ////
+		small_map<str8,s32,4> m;
+		str8 names[] = {STR8("a"), STR8("b"), STR8("c"), STR8("d"), STR8("e"), STR8("f")};
+		forI(4) m.add(names[i], i);
+		AssertAlways(!m.spilled());
+		m.add(names[4], 4);
+		AssertAlways(m.spilled() && m.count == 5);
+		forI(5) AssertAlways(*m.at(names[i]) == i && str8_equal_lazy(m.key(i), names[i]));
+		AssertAlways(!m.has(names[5]));
+		m.remove(names[0]);
+		AssertAlways(m.spilled() && m.count == 4 && !m.has(names[0]) && *m.at(names[4]) == 4);
+		s32 sum = 0;
+		for(s32 v : m) sum += v;
+		AssertAlways(sum == 10);
+		
+		m.clear();
+		AssertAlways(!m.spilled() && m.count == 0 && !m.has(names[1]));
+		m.add(names[5], 5);
+		AssertAlways(!m.spilled() && *m.at(names[5]) == 5);
+		
+		small_map<u32,u32,32> big;
+		forI(1000) big.add(i, i * 2);
+		AssertAlways(big.spilled() && big.count == 1000);
+		forI(1000) AssertAlways(big[i] == i * 2);
+	}
+}
+
+
+#endif //#ifdef KIGU_UNIT_TESTS
+#endif //#ifndef KIGU_SMALL_MAP_H
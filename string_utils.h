@@ -2,6 +2,7 @@
 #ifndef KIGU_STRING_UTILS_H
 #define KIGU_STRING_UTILS_H
 
+#include "arena.h"
 #include "arrayT.h"
 #include "cstring.h"
 #include "color.h"
@@ -101,18 +102,44 @@ to_dstr8(T x, Allocator* a = KIGU_STRING_ALLOCATOR){DPZoneScoped;
 	return builder;
 }
 
+//NOTE the temporary strings are built on a scratch arena that doesn't conflict with `allocator`
 template<class... T> global dstr8
 to_dstr8v(Allocator* allocator, T... args){DPZoneScoped;
-	dstr8 str; dstr8_init(&str, {0}, allocator);
+	Scratch scratch = scratch_begin(allocator);
 	constexpr auto arg_count{sizeof...(T)};
-	dstr8 arr[arg_count] = { to_dstr8(args, allocator)... };
+	dstr8 arr[arg_count] = { to_dstr8(args, scratch.allocator)... };
+	s64 total = 0;
+	forI(arg_count) total += arr[i].count;
+	
+	//the result is reserved once with room for every piece and the null-terminator
+	dstr8 str;
+	str.count     = 0;
+	str.space     = RoundUpTo(total+1, KIGU_STR8BUILDER_BYTE_ALIGNMENT);
+	str.str       = (u8*)allocator->reserve(str.space*sizeof(u8)); Assert(str.str, "Failed to allocate memory");
+	str.allocator = allocator;
 	forI(arg_count){
 		dstr8_append(&str, arr[i].fin);
-		dstr8_deinit(&arr[i]);
-	} 
+	}
+	str.str[str.count] = '\0';
+	scratch_end(scratch);
 	return str;
 }
 
+template<class... T> global void
+dstr8_append(dstr8* builder, T... args){DPZoneScoped;
+	Scratch scratch = scratch_begin(builder->allocator);
+	constexpr auto arg_count{sizeof...(T)};
+	dstr8 arr[arg_count] = { to_dstr8(args, scratch.allocator)... };
+	s64 total = 0;
+	forI(arg_count) total += arr[i].count;
+	
+	if(builder->space < builder->count+total+1) dstr8_grow(builder, (builder->count+total+1) - builder->space);
+	forI(arg_count){
+		dstr8_append(builder, arr[i].fin);
+	}
+	scratch_end(scratch);
+}
+
 ///////////////
 //// @find ////
 ///////////////
@@ -0,0 +1,282 @@
+/* kigu tcache module
+WHAT:
+This module provides a thread caching front-end for the slab allocator (slab.h). Each thread keeps a small cache of free
+blocks per size class, so most reserves and releases are a push or pop on a thread local list. When a thread's cache for a
+size class runs dry it takes a batch of blocks from the slab, and when it gets too full it hands half of them back, both while
+locking the shared size class only once.
+
+WHY:
+Kigu containers default to the process global `stl_allocator`, so when many worker threads build arrays and strings at once,
+they all fight over malloc's locks. The slab already splits its locks by size class, but threads building the same kind of
+containers still reserve from the same size classes. With thread caches, threads only touch shared state once per batch.
+
+NOTES:
+- `tcache_allocator` is stateless (like `stl_allocator`), so it can be used as KIGU_ARRAY_ALLOCATOR, KIGU_STRING_ALLOCATOR, or
+  KIGU_UNICODE_ALLOCATOR as long as tcache.h is included before the headers that use those defines.
+- Memory reserved on one thread can be released on any other thread; the block just ends up in the releasing thread's cache.
+- Each thread's cache is a single inline thread_local, so it is shared by every translation unit that includes tcache.h.
+- Memory can be mixed freely between `tcache_allocator` and `slab_allocator` (they share the same size classes and spans).
+- Each thread caches at most about KIGU_TCACHE_BIN_BYTES (64KB) per size class (and at least 4 blocks).
+- Requests bigger than KIGU_SLAB_MAX_CLASS_SIZE go straight to the slab allocator.
+- Call tcache_flush_thread() before a thread that used the allocator exits, otherwise the blocks in its cache are never
+  reused (they aren't leaked to the OS since spans are never returned anyway).
+
+INDEX:
+@tcache_allocator
+  tcache_reserve(upt size) -> void*
+  tcache_reserve_uninitialized(upt size) -> void*
+  tcache_release(void* ptr) -> void
+  tcache_resize(void* ptr, upt size) -> void*
+  tcache_flush_thread() -> void
+  tcache_allocator: Allocator*
+@tcache_tests
+*/
+#pragma once
+#ifndef KIGU_TCACHE_H
+#define KIGU_TCACHE_H
+
+
+#ifndef KIGU_TCACHE_BIN_BYTES
+#  define KIGU_TCACHE_BIN_BYTES Kilobytes(64)
+#endif
+
+
+#include "common.h"
+#include "slab.h"
+
+
+StartLinkageC();
+//-////////////////////////////////////////////////////////////////////////////////////////////////
+//// @tcache_allocator
+
+
+typedef struct TCacheBin{
+	SlabFreeBlock* blocks;
+	u32 count;
+}TCacheBin;
+
+//inline so a thread has one cache no matter which translation unit reserves or releases through it
+inline thread_local TCacheBin kigu__tcache_bins[KIGU_SLAB_CLASS_COUNT];
+
+
+//Returns the most blocks the size class `index` can hold in a thread's cache
+FORCE_INLINE u32
+kigu__tcache_bin_limit(u32 index){
+	return (u32)Max(KIGU_TCACHE_BIN_BYTES / slab_class_size(index), (upt)4);
+}
+
+
+//Returns a block from the calling thread's cache for `size` bytes (which must fit in a size class), refilling it if needed
+//  the block is only zeroed if `zero` is true
+global void*
+kigu__tcache_reserve(upt size, b32 zero){
+	u32 index = slab_class_index(size);
+	TCacheBin* bin = &kigu__tcache_bins[index];
+	if(!bin->blocks){
+		bin->blocks = slab_reserve_batch(index, kigu__tcache_bin_limit(index) / 2, &bin->count);
+		if(!bin->blocks) return 0;
+	}
+	SlabFreeBlock* result = bin->blocks;
+	bin->blocks = result->next;
+	bin->count -= 1;
+	if(zero){
+		ZeroMemory(result, slab_class_size(index));
+	}else{
+		result->next = 0;
+	}
+	return result;
+}
+
+
+//Returns `size` zeroed bytes
+global void*
+tcache_reserve(upt size){
+	if(size > KIGU_SLAB_MAX_CLASS_SIZE) return slab_reserve(size);
+	return kigu__tcache_reserve(size, true);
+}
+
+
+//Returns `size` bytes which are not guaranteed to be zeroed
+global void*
+tcache_reserve_uninitialized(upt size){
+	if(size > KIGU_SLAB_MAX_CLASS_SIZE) return slab_reserve(size);
+	return kigu__tcache_reserve(size, false);
+}
+
+
+//Releases `ptr` (which must have been reserved by the tcache or slab allocators) into the calling thread's cache, handing
+//  half of the cache back to the slab if it is full
+global void
+tcache_release(void* ptr){
+	if(!ptr) return;
+	if(!kigu__slab_owns(ptr)){
+		slab_release(ptr);
+		return;
+	}
+	
+	u32 index = kigu__slab_class_of(ptr);
+	TCacheBin* bin = &kigu__tcache_bins[index];
+	SlabFreeBlock* block = (SlabFreeBlock*)ptr;
+	block->next = bin->blocks;
+	bin->blocks = block;
+	bin->count += 1;
+	
+	u32 limit = kigu__tcache_bin_limit(index);
+	if(bin->count > limit){
+		//keep the most recently released half (which are most likely still in cache) and return the rest
+		SlabFreeBlock* last_kept = bin->blocks;
+		for(u32 i = 1; i < limit / 2; i += 1) last_kept = last_kept->next;
+		SlabFreeBlock* first = last_kept->next;
+		SlabFreeBlock* last  = first;
+		while(last->next) last = last->next;
+		last_kept->next = 0;
+		slab_release_batch(index, first, last);
+		bin->count = limit / 2;
+	}
+}
+
+
+//Resizes `ptr` to `size` bytes, only moving it if `size` no longer fits in its size class
+global void*
+tcache_resize(void* ptr, upt size){
+	if(!ptr) return tcache_reserve(size);
+	if(!kigu__slab_owns(ptr) || size > KIGU_SLAB_MAX_CLASS_SIZE) return slab_resize(ptr, size);
+	
+	u32 index = kigu__slab_class_of(ptr);
+	upt old_size = slab_class_size(index);
+	if(size <= old_size && (index == 0 || size > slab_class_size(index - 1))) return ptr;
+	
+	void* result = kigu__tcache_reserve(size, true);
+	if(!result) return 0;
+	CopyMemory(result, ptr, Min(old_size, size));
+	tcache_release(ptr);
+	return result;
+}
+
+
+//Returns every block in the calling thread's cache to the slab (call this before a thread that used the allocator exits)
+global void
+tcache_flush_thread(){
+	forI(KIGU_SLAB_CLASS_COUNT){
+		TCacheBin* bin = &kigu__tcache_bins[i];
+		if(bin->blocks){
+			SlabFreeBlock* last = bin->blocks;
+			while(last->next) last = last->next;
+			slab_release_batch(i, bin->blocks, last);
+			bin->blocks = 0;
+			bin->count  = 0;
+		}
+	}
+}
+
+
+global Allocator tcache_allocator_{
+	tcache_reserve,
+	Allocator_ChangeMemory_Noop,
+	Allocator_ChangeMemory_Noop,
+	tcache_release,
+	tcache_resize,
+	tcache_reserve_uninitialized,
+	AllocatorFlags_ZeroReserve,
+	16
+};
+global Allocator* tcache_allocator = &tcache_allocator_;
+
+
+EndLinkageC();
+//-////////////////////////////////////////////////////////////////////////////////////////////////
+//// @tcache_tests
+#ifdef KIGU_UNIT_TESTS
+
+
+#include <thread>
+
+
+global void kigu__tcache_unit_tests()
+{
+	{//// reserve/release ////
+		u8* a = (u8*)tcache_allocator->reserve(24);
+		AssertAlways(a != 0 && kigu__slab_owns(a));
+		AssertAlways(kigu__tcache_bins[slab_class_index(24)].count == kigu__tcache_bin_limit(slab_class_index(24))/2 - 1);
+		forI(24) a[i] = 0xff;
+		
+		//released blocks are reused first and zeroed
+		tcache_allocator->release(a);
+		u8* b = (u8*)tcache_allocator->reserve(32);
+		AssertAlways(b == a);
+		forI(32) AssertAlways(b[i] == 0);
+		tcache_allocator->release(b);
+		
+		//releasing more than the limit hands half back to the slab
+		u32 index = slab_class_index(KIGU_SLAB_MAX_CLASS_SIZE);
+		u32 limit = kigu__tcache_bin_limit(index);
+		void* blocks[64];
+		forI(limit+1) blocks[i] = tcache_allocator->reserve(KIGU_SLAB_MAX_CLASS_SIZE);
+		forI(limit+1) tcache_allocator->release(blocks[i]);
+		AssertAlways(kigu__tcache_bins[index].count <= limit);
+		
+		tcache_flush_thread();
+		forI(KIGU_SLAB_CLASS_COUNT) AssertAlways(kigu__tcache_bins[i].count == 0);
+	}
+	
+	{//// resize ////
+		u8* a = (u8*)tcache_allocator->reserve(100);
+		forI(100) a[i] = (u8)i;
+		AssertAlways(tcache_allocator->resize(a, 112) == a);
+		u8* b = (u8*)tcache_allocator->resize(a, 5000);
+		forI(100) AssertAlways(b[i] == (u8)i);
+		AssertAlways(b[4999] == 0);
+		u8* c = (u8*)tcache_allocator->resize(b, Megabytes(1));
+		forI(100) AssertAlways(c[i] == (u8)i);
+		tcache_allocator->release(c);
+		tcache_flush_thread();
+	}
+	
+	{//// cross thread release ////
+		//producers reserve blocks and hand them to consumers, which check them and release them while reserving and releasing
+		//  their own blocks; a block handed out twice would have its tag overwritten by the other owner
+		const u32 pair_count = 4, block_count = 50000;
+		u64** handoff = (u64**)stl_allocator->reserve(pair_count*block_count*sizeof(u64*));
+		volatile u32 failures = 0;
+		std::thread threads[pair_count*2];
+		forX(t, pair_count){
+			u64** slots = handoff + t*block_count;
+			threads[t] = std::thread([slots, t, &failures](){
+				forI(block_count){
+					upt size = 16 + (i % 64)*16;
+					u64* block = (u64*)tcache_allocator->reserve(size);
+					if(!block || block[size/8 - 1] != 0) kigu__atomic_add(&failures, 1);
+					block[0] = ((u64)t << 32) | i;
+					block[size/8 - 1] = ~block[0];
+					kigu__store_release(&slots[i], block);
+				}
+				tcache_flush_thread();
+			});
+			threads[pair_count+t] = std::thread([slots, t, &failures](){
+				u64* own[16] = {0};
+				forI(block_count){
+					u64* block;
+					while(!(block = kigu__load_acquire(&slots[i]))){}
+					upt size = 16 + (i % 64)*16;
+					if(block[0] != (((u64)t << 32) | i) || block[size/8 - 1] != ~block[0]) kigu__atomic_add(&failures, 1);
+					tcache_allocator->release(block);
+					
+					u64*& mine = own[i % 16];
+					if(mine && *mine != (((u64)(pair_count+t) << 32) | (i % 16))) kigu__atomic_add(&failures, 1);
+					tcache_allocator->release(mine);
+					mine = (u64*)tcache_allocator->reserve(16 + (i % 48)*16);
+					*mine = ((u64)(pair_count+t) << 32) | (i % 16);
+				}
+				forI(16) tcache_allocator->release(own[i]);
+				tcache_flush_thread();
+			});
+		}
+		forI(pair_count*2) threads[i].join();
+		AssertAlways(failures == 0);
+		stl_allocator->release(handoff);
+	}
+}
+
+
+#endif //#ifdef KIGU_UNIT_TESTS
+#endif //#ifndef KIGU_TCACHE_H
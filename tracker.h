@@ -0,0 +1,400 @@
+/* kigu tracker module
+WHAT:
+This module provides an allocator that wraps another allocator and records statistics about the memory that passes through
+it: live and peak bytes, reserve/release/resize counts, how many resizes had to move the memory, and a histogram of requested
+sizes. Allocations can be attributed to named tags (one `Allocator` per tag) so the statistics can be broken down by the
+container or call site that allocated the memory.
+
+WHY:
+Tracy shows where memory goes while it's connected, but most of the time we just want to know which containers allocate the
+most or reallocate the most so that they can be given a better initial size. A tracker can be swapped in for any allocator
+and dumped at any point, and it still feeds Tracy's memory zones when TRACY_ENABLE is set.
+
+NOTES:
+- Every allocation is prefixed with a KIGU_TRACKER_HEADER_SIZE (16) byte header holding its size and tag, so pointers keep
+  the alignment of the backing allocator up to 16 bytes.
+- Memory can be released or resized through any of a tracker's allocators; it stays attributed to the tag that reserved it.
+- Whether reserved memory is zero filled depends on the backing allocator, so the tracker's allocators copy its AllocatorFlags.
+- There are KIGU_TRACKER_MAX_TAGS (32) tags per tracker, including the untagged tag 0, and each tag uses a bound allocator
+  slot (see memory.h) once its allocator is requested.
+- Histogram bucket `i` counts requested sizes in [2^i, 2^(i+1)), bucket 0 also counts 0 byte requests and the last bucket
+  counts everything bigger. Both reserves and resizes are counted by their new size.
+- Tag names are not copied (Tracy requires the same of its memory zone names), so they should be string literals.
+- Trackers are not thread safe.
+
+INDEX:
+@tracker_init
+  AllocatorStats: struct
+  Tracker: struct
+  tracker_init(Tracker* tracker, Allocator* backing) -> void
+  tracker_deinit(Tracker* tracker) -> void
+@tracker_allocator
+  tracker_allocator(Tracker* tracker) -> Allocator*
+  tracker_tag(Tracker* tracker, const char* name) -> Allocator*
+@tracker_stats
+  tracker_stats(Tracker* tracker) -> AllocatorStats
+  tracker_tag_stats(Tracker* tracker, const char* name) -> AllocatorStats
+  tracker_dump(Tracker* tracker, FILE* file) -> void
+@tracker_tests
+*/
+#pragma once
+#ifndef KIGU_TRACKER_H
+#define KIGU_TRACKER_H
+
+
+#ifndef KIGU_TRACKER_MAX_TAGS
+#  define KIGU_TRACKER_MAX_TAGS 32
+#endif
+
+
+#include "common.h"
+#include "memory.h"
+#include "profiling.h"
+
+
+StartLinkageC();
+//-////////////////////////////////////////////////////////////////////////////////////////////////
+//// @tracker_init
+
+
+#define KIGU_TRACKER_HEADER_SIZE 16
+#define KIGU_TRACKER_HISTOGRAM_BUCKETS 32
+
+typedef struct AllocatorStats{
+	upt live_bytes;    //bytes currently reserved
+	upt peak_bytes;    //most bytes reserved at once
+	upt total_bytes;   //bytes requested by all reserves and growing resizes
+	u64 live_count;    //allocations currently reserved
+	u64 reserve_count;
+	u64 release_count;
+	u64 resize_count;
+	u64 move_count;    //resizes that returned a different pointer
+	u64 histogram[KIGU_TRACKER_HISTOGRAM_BUCKETS];
+}AllocatorStats;
+
+typedef struct TrackerTag{
+	const char* name;
+	struct Tracker* tracker;
+	Allocator* allocator;     //allocator that attributes its allocations to this tag (0 until requested)
+	AllocatorStats stats;
+}TrackerTag;
+
+typedef struct Tracker{
+	Allocator* backing;       //allocator the tracked memory is allocated with
+	AllocatorStats stats;     //stats of all tags combined
+	u32 tag_count;
+	TrackerTag tags[KIGU_TRACKER_MAX_TAGS];
+}Tracker;
+
+typedef struct TrackerHeader{
+	upt size;
+	u32 tag;
+}TrackerHeader;
+StaticAssert(sizeof(TrackerHeader) <= KIGU_TRACKER_HEADER_SIZE);
+
+
+//Initializes `tracker` to record the allocations it forwards to `backing`
+global void
+tracker_init(Tracker* tracker, Allocator* backing){
+	ZeroMemory(tracker, sizeof(Tracker));
+	tracker->backing = backing;
+	tracker->tag_count = 1;
+	tracker->tags[0].name = "untagged";
+	tracker->tags[0].tracker = tracker;
+}
+
+
+//Unbinds the allocators of `tracker` (memory still reserved through them is not released)
+global void
+tracker_deinit(Tracker* tracker){
+	forI(tracker->tag_count){
+		if(tracker->tags[i].allocator) allocator_unbind(tracker->tags[i].allocator);
+	}
+	ZeroMemory(tracker, sizeof(Tracker));
+}
+
+
+//-////////////////////////////////////////////////////////////////////////////////////////////////
+//// @tracker_allocator
+
+
+FORCE_INLINE u32
+kigu__tracker_histogram_bucket(upt size){
+	return (size) ? Min(FloorLog2(size), (u32)KIGU_TRACKER_HISTOGRAM_BUCKETS-1) : 0;
+}
+
+FORCE_INLINE void
+kigu__tracker_add(AllocatorStats* stats, upt old_size, upt new_size){
+	stats->live_bytes = stats->live_bytes - old_size + new_size;
+	stats->peak_bytes = Max(stats->peak_bytes, stats->live_bytes);
+	if(new_size > old_size) stats->total_bytes += new_size - old_size;
+	stats->histogram[kigu__tracker_histogram_bucket(new_size)] += 1;
+}
+
+global void*
+kigu__tracker_reserve(void* context, upt size){
+	TrackerTag* tag = (TrackerTag*)context;
+	Tracker* tracker = tag->tracker;
+	TrackerHeader* header = (TrackerHeader*)tracker->backing->reserve(KIGU_TRACKER_HEADER_SIZE + size);
+	if(!header) return 0;
+	header->size = size;
+	header->tag  = (u32)(tag - tracker->tags);
+	
+	kigu__tracker_add(&tracker->stats, 0, size);
+	kigu__tracker_add(&tag->stats, 0, size);
+	tracker->stats.reserve_count += 1;
+	tracker->stats.live_count    += 1;
+	tag->stats.reserve_count     += 1;
+	tag->stats.live_count        += 1;
+	
+	void* result = (u8*)header + KIGU_TRACKER_HEADER_SIZE;
+	DPTracyAllocN(result, size, tag->name);
+	return result;
+}
+
+global void
+kigu__tracker_release(void* context, void* ptr){
+	if(!ptr) return;
+	Tracker* tracker = ((TrackerTag*)context)->tracker;
+	TrackerHeader* header = (TrackerHeader*)((u8*)ptr - KIGU_TRACKER_HEADER_SIZE);
+	TrackerTag* tag = &tracker->tags[header->tag];
+	DPTracyFreeN(ptr, tag->name);
+	
+	tracker->stats.live_bytes    -= header->size;
+	tracker->stats.live_count    -= 1;
+	tracker->stats.release_count += 1;
+	tag->stats.live_bytes        -= header->size;
+	tag->stats.live_count        -= 1;
+	tag->stats.release_count     += 1;
+	
+	tracker->backing->release(header);
+}
+
+global void*
+kigu__tracker_resize(void* context, void* ptr, upt size){
+	if(!ptr) return kigu__tracker_reserve(context, size);
+	Tracker* tracker = ((TrackerTag*)context)->tracker;
+	TrackerHeader* header = (TrackerHeader*)((u8*)ptr - KIGU_TRACKER_HEADER_SIZE);
+	TrackerTag* tag = &tracker->tags[header->tag];
+	upt old_size = header->size;
+	
+	header = (TrackerHeader*)tracker->backing->resize(header, KIGU_TRACKER_HEADER_SIZE + size);
+	if(!header) return 0;
+	header->size = size;
+	void* result = (u8*)header + KIGU_TRACKER_HEADER_SIZE;
+	DPTracyFreeN(ptr, tag->name);
+	DPTracyAllocN(result, size, tag->name);
+	
+	kigu__tracker_add(&tracker->stats, old_size, size);
+	kigu__tracker_add(&tag->stats, old_size, size);
+	tracker->stats.resize_count += 1;
+	tag->stats.resize_count     += 1;
+	if(result != ptr){
+		tracker->stats.move_count += 1;
+		tag->stats.move_count     += 1;
+	}
+	return result;
+}
+
+
+//Returns the `Allocator` of `tag`, binding it the first time it is requested
+FORCE_INLINE Allocator*
+kigu__tracker_tag_allocator(TrackerTag* tag){
+	if(!tag->allocator){
+		tag->allocator = allocator_bind(tag, kigu__tracker_reserve, kigu__tracker_release, kigu__tracker_resize);
+		if(tag->allocator){
+			Allocator* backing = tag->tracker->backing;
+			tag->allocator->flags     = backing->flags & (AllocatorFlags_ZeroReserve | AllocatorFlags_ZeroResize);
+			tag->allocator->alignment = (u32)Min(allocator_alignment(backing), (upt)KIGU_TRACKER_HEADER_SIZE);
+		}
+	}
+	return tag->allocator;
+}
+
+
+//Returns the untagged `Allocator` of `tracker`, the same `Allocator` is returned on subsequent calls
+global Allocator*
+tracker_allocator(Tracker* tracker){
+	return kigu__tracker_tag_allocator(&tracker->tags[0]);
+}
+
+
+//Returns the `TrackerTag` of `tracker` named `name`, or 0 if there isn't one
+global TrackerTag*
+kigu__tracker_find_tag(Tracker* tracker, const char* name){
+	forI(tracker->tag_count){
+		if(tracker->tags[i].name == name || strcmp(tracker->tags[i].name, name) == 0) return &tracker->tags[i];
+	}
+	return 0;
+}
+
+
+//Returns an `Allocator` that attributes its allocations to the tag `name` of `tracker`, creating the tag if necessary
+//  returns 0 (and asserts) if `tracker` already has KIGU_TRACKER_MAX_TAGS tags
+global Allocator*
+tracker_tag(Tracker* tracker, const char* name){
+	TrackerTag* tag = kigu__tracker_find_tag(tracker, name);
+	if(!tag){
+		if(tracker->tag_count == KIGU_TRACKER_MAX_TAGS){
+			Assert(!"ran out of tracker tags; increase KIGU_TRACKER_MAX_TAGS");
+			return 0;
+		}
+		tag = &tracker->tags[tracker->tag_count++];
+		tag->name = name;
+		tag->tracker = tracker;
+	}
+	return kigu__tracker_tag_allocator(tag);
+}
+
+
+//-////////////////////////////////////////////////////////////////////////////////////////////////
+//// @tracker_stats
+
+
+//Returns the combined stats of all tags of `tracker`
+global AllocatorStats
+tracker_stats(Tracker* tracker){
+	return tracker->stats;
+}
+
+
+//Returns the stats of the tag `name` of `tracker`, or zeroed stats if there is no such tag
+global AllocatorStats
+tracker_tag_stats(Tracker* tracker, const char* name){
+	TrackerTag* tag = kigu__tracker_find_tag(tracker, name);
+	if(tag) return tag->stats;
+	AllocatorStats result;
+	ZeroMemory(&result, sizeof(AllocatorStats));
+	return result;
+}
+
+
+global void
+kigu__tracker_dump_stats(FILE* file, const char* name, AllocatorStats* stats){
+	fprintf(file, "%-24s live %8.2f %-2s (%llu allocations)  peak %8.2f %-2s  reserves %llu  releases %llu  resizes %llu (%llu moved)\n",
+			name, (f64)stats->live_bytes / bytesDivisor(stats->live_bytes), (char*)bytesUnit(stats->live_bytes).str,
+			(u64)stats->live_count, (f64)stats->peak_bytes / bytesDivisor(stats->peak_bytes), (char*)bytesUnit(stats->peak_bytes).str,
+			(u64)stats->reserve_count, (u64)stats->release_count, (u64)stats->resize_count, (u64)stats->move_count);
+}
+
+//Prints the stats of `tracker` to `file`: the combined stats, the size histogram, then each tag ordered by most resizes
+global void
+tracker_dump(Tracker* tracker, FILE* file){
+	kigu__tracker_dump_stats(file, "total", &tracker->stats);
+	
+	fprintf(file, "size histogram:\n");
+	forI(KIGU_TRACKER_HISTOGRAM_BUCKETS){
+		if(tracker->stats.histogram[i] == 0) continue;
+		fprintf(file, "  %s2^%-2d %llu\n", (i == KIGU_TRACKER_HISTOGRAM_BUCKETS-1) ? ">=" : "  ", (int)i, (u64)tracker->stats.histogram[i]);
+	}
+	
+	//insertion sort the tags by resize count since those are the containers that could use a better initial size
+	TrackerTag* sorted[KIGU_TRACKER_MAX_TAGS];
+	forI(tracker->tag_count){
+		upt j = i;
+		while(j > 0 && sorted[j-1]->stats.resize_count < tracker->tags[i].stats.resize_count){
+			sorted[j] = sorted[j-1];
+			j -= 1;
+		}
+		sorted[j] = &tracker->tags[i];
+	}
+	fprintf(file, "tags:\n");
+	forI(tracker->tag_count){
+		kigu__tracker_dump_stats(file, sorted[i]->name, &sorted[i]->stats);
+	}
+}
+
+
+EndLinkageC();
+//-////////////////////////////////////////////////////////////////////////////////////////////////
+//// @tracker_tests
+#ifdef KIGU_UNIT_TESTS
+
+
+#include "array.h"
+
+
+global void kigu__tracker_unit_tests()
+{
+	{//// reserve/release ////
+		Tracker tracker;
+		tracker_init(&tracker, stl_allocator);
+		Allocator* allocator = tracker_allocator(&tracker);
+		AssertAlways(allocator != 0 && tracker_allocator(&tracker) == allocator);
+		
+		void* a = allocator->reserve(100);
+		void* b = allocator->reserve(1000);
+		AssertAlways((upt)a % 16 == 0 && (upt)b % 16 == 0);
+		AllocatorStats stats = tracker_stats(&tracker);
+		AssertAlways(stats.live_bytes == 1100 && stats.peak_bytes == 1100);
+		AssertAlways(stats.live_count == 2 && stats.reserve_count == 2);
+		AssertAlways(stats.histogram[6] == 1 && stats.histogram[9] == 1);
+		
+		allocator->release(b);
+		stats = tracker_stats(&tracker);
+		AssertAlways(stats.live_bytes == 100 && stats.peak_bytes == 1100);
+		AssertAlways(stats.live_count == 1 && stats.release_count == 1);
+		
+		a = allocator->resize(a, 5000);
+		stats = tracker_stats(&tracker);
+		AssertAlways(stats.live_bytes == 5000 && stats.peak_bytes == 5000);
+		AssertAlways(stats.total_bytes == 6000 && stats.resize_count == 1);
+		AssertAlways(stats.histogram[12] == 1);
+		
+		allocator->release(a);
+		AssertAlways(tracker_stats(&tracker).live_bytes == 0);
+		tracker_deinit(&tracker);
+	}
+	
+	{//// tags ////
+		Tracker tracker;
+		tracker_init(&tracker, stl_allocator);
+		Allocator* ints_allocator = tracker_tag(&tracker, "ints");
+		Allocator* chars_allocator = tracker_tag(&tracker, "chars");
+		AssertAlways(ints_allocator != chars_allocator && tracker_tag(&tracker, "ints") == ints_allocator);
+		
+		u32* ints;
+		array_init(ints, 1, ints_allocator);
+		forI(1000) array_push_value(ints, (u32)i);
+		char* chars;
+		array_init(chars, 1024, chars_allocator);
+		forI(1000) array_push_value(chars, 'a');
+		
+		//only the array that started small had to grow
+		AllocatorStats ints_stats = tracker_tag_stats(&tracker, "ints");
+		AllocatorStats chars_stats = tracker_tag_stats(&tracker, "chars");
+		AssertAlways(ints_stats.resize_count > 0 && chars_stats.resize_count == 0);
+		AssertAlways(ints_stats.live_count == 1 && chars_stats.live_count == 1);
+		AssertAlways(tracker_stats(&tracker).live_bytes == ints_stats.live_bytes + chars_stats.live_bytes);
+		
+		//memory stays attributed to the tag that reserved it
+		void* p = ints_allocator->reserve(64);
+		tracker_allocator(&tracker)->release(p);
+		AssertAlways(tracker_tag_stats(&tracker, "ints").live_count == 1);
+		
+		//dump into a temporary file and check the tags are ordered by resizes
+		FILE* file = tmpfile();
+		AssertAlways(file != 0);
+		tracker_dump(&tracker, file);
+		char dump[4096] = {0};
+		rewind(file);
+		fread(dump, 1, sizeof(dump)-1, file);
+		fclose(file);
+		AssertAlways(strncmp(dump, "total", 5) == 0);
+		char* histogram = strstr(dump, "size histogram:\n");
+		char* tags = strstr(dump, "tags:\n");
+		AssertAlways(histogram && tags && histogram < tags);
+		char* ints_line = strstr(tags, "ints");
+		char* chars_line = strstr(tags, "chars");
+		AssertAlways(ints_line && chars_line && ints_line < chars_line);
+		
+		array_deinit(ints);
+		array_deinit(chars);
+		AssertAlways(tracker_stats(&tracker).live_bytes == 0);
+		tracker_deinit(&tracker);
+	}
+}
+
+
+#endif //#ifdef KIGU_UNIT_TESTS
+#endif //#ifndef KIGU_TRACKER_H
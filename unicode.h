@@ -5,7 +5,8 @@ Notes:
   internally and don't assume they are included in the count (NOTE this assumes the allocators fill memory to zero).
 - str16 and str32 use big endian UTF encodings.
 - A codepoint can not start with another codepoint, but it can end with another one.
-- All functions with allocators expect the memory to be zero filled on allocation.
+- All functions with allocators expect the memory to be zero filled on allocation, except for the ones that write every byte
+  they reserve (like str8_copy() and str8_concat()) which use `reserve_uninitialized` and write the null-terminator themselves.
 
 Terminology:
 codepoint       the value or set of values that represent one unicode character
@@ -952,30 +953,33 @@ str8_skip_int(str8 a){
 //Allocates and returns a new copy of the utf8 string `a` using `allocator`
 global str8
 str8_copy(str8 a, Allocator* allocator = KIGU_UNICODE_ALLOCATOR){DPZoneScoped;
-	str8 result{(u8*)allocator->reserve((a.count+1)*sizeof(u8)), a.count};
+	str8 result{(u8*)allocator_reserve_uninitialized(allocator, (a.count+1)*sizeof(u8)), a.count};
 	Assert(result.str, "failed to allocate memory");
 	CopyMemory(result.str, a.str, a.count*sizeof(u8));
+	result.str[result.count] = '\0';
 	return result;
 }
 
 //Allocates and returns a utf8 string of `a` with `b` appended to it using `allocator`
 global str8
 str8_concat(str8 a, str8 b, Allocator* allocator = KIGU_UNICODE_ALLOCATOR){DPZoneScoped;
-	str8 result{(u8*)allocator->reserve((a.count+b.count+1)*sizeof(u8)), a.count+b.count};
+	str8 result{(u8*)allocator_reserve_uninitialized(allocator, (a.count+b.count+1)*sizeof(u8)), a.count+b.count};
 	Assert(result.str, "failed to allocate memory");
 	CopyMemory(result.str,         a.str, a.count*sizeof(u8));
 	CopyMemory(result.str+a.count, b.str, b.count*sizeof(u8));
+	result.str[result.count] = '\0';
 	return result;
 }
 
 //Allocates and returns a utf8 string of `a` with `b` and then `c` appended to it using `allocator`
 global str8
 str8_concat3(str8 a, str8 b, str8 c, Allocator* allocator = KIGU_UNICODE_ALLOCATOR){DPZoneScoped;
-	str8 result{(u8*)allocator->reserve((a.count+b.count+c.count+1)*sizeof(u8)), a.count+b.count+c.count};
+	str8 result{(u8*)allocator_reserve_uninitialized(allocator, (a.count+b.count+c.count+1)*sizeof(u8)), a.count+b.count+c.count};
 	Assert(result.str, "failed to allocate memory");
 	CopyMemory(result.str,                 a.str, a.count*sizeof(u8));
 	CopyMemory(result.str+a.count,         b.str, b.count*sizeof(u8));
 	CopyMemory(result.str+a.count+b.count, c.str, c.count*sizeof(u8));
+	result.str[result.count] = '\0';
 	return result;
 }
 
@@ -1072,16 +1076,6 @@ dstr8_remove_codepoint_at_byteoffset(dstr8* builder, u64 byte_offset){DPZoneScop
 // 	return str.fin;
 // }
 
-template<class... T> global void
-dstr8_append(dstr8* builder, T... args){DPZoneScoped;
-	constexpr auto arg_count{sizeof...(T)};
-	dstr8 arr[arg_count] = {to_dstr8(args, builder->allocator)...};
-	forI(arg_count){
-		dstr8_append(builder, arr[i].fin);
-		dstr8_deinit(&arr[i]);
-	}
-}
-
 // replaces all instances of the codepoint 'find' with a different codepoint
 global
 void dstr8_replace_codepoint(dstr8* builder, u32 find, u32 replace){
@@ -1099,46 +1093,28 @@ void dstr8_replace_codepoint(dstr8* builder, u32 find, u32 replace){
 //// @str8_hashing
 struct str8_static_t{const char* str; u64 count; template<u64 N> constexpr str8_static_t(const char(&a)[N]): str(a), count(N-1){}};
 
-//Returns a 32bit FNV-1a hash of the string `a` seeded with `seed` at compile-time
+//Returns a 32bit hash of the string `a` seeded with `seed` at compile-time (the same as str8_hash32())
 constexpr u64
-str8_static_hash32(str8_static_t a, u64 seed = 2166136261){ //32bit FNV_offset_basis
-	while(a.count-- != 0){
-		seed ^= (u8)*a.str;
-		seed *= 16777619; //32bit FNV_prime
-		a.str++;
-	}
-	return seed;
+str8_static_hash32(str8_static_t a, u64 seed = 0){
+	return (u32)HashStatic64(a.str, a.count, seed);
 }
 
-//Returns a 32bit FNV-1a hash of the string `a` seeded with `seed`
+//Returns a 32bit hash of the string `a` seeded with `seed`
 global u64
-str8_hash32(str8 a, u64 seed = 2166136261){DPZoneScoped; //32bit FNV_offset_basis
-	while(a.count-- != 0){
-		seed ^= *a.str++;
-		seed *= 16777619; //32bit FNV_prime
-	}
-	return seed;
+str8_hash32(str8 a, u64 seed = 0){DPZoneScoped;
+	return (u32)Hash64(a.str, a.count, seed);
 }
 
-//Returns a 64bit FNV-1a hash of the string `a` seeded with `seed` at compile-time
+//Returns a 64bit hash of the string `a` seeded with `seed` at compile-time (the same as str8_hash64())
 constexpr u64
-str8_static_hash64(str8_static_t a, u64 seed = 14695981039346656037){ //64bit FNV_offset_basis
-	while(a.count-- != 0){
-		seed ^= (u8)*a.str;
-		seed *= 1099511628211; //64bit FNV_prime
-		a.str++;
-	}
-	return seed;
+str8_static_hash64(str8_static_t a, u64 seed = 0){
+	return HashStatic64(a.str, a.count, seed);
 }
 
-//Returns a 64bit FNV-1a hash of the string `a` seeded with `seed`
+//Returns a 64bit hash of the string `a` seeded with `seed`
 global u64
-str8_hash64(str8 a, u64 seed = 14695981039346656037){DPZoneScoped; //64bit FNV_offset_basis
-	while(a.count-- != 0){
-		seed ^= *a.str++;
-		seed *= 1099511628211; //64bit FNV_prime
-	}
-	return seed;
+str8_hash64(str8 a, u64 seed = 0){DPZoneScoped;
+	return Hash64(a.str, a.count, seed);
 }
 
 //-////////////////////////////////////////////////////////////////////////////////////////////////
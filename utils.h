@@ -10,14 +10,14 @@
 #include <cmath>
 
 namespace Utils{
-	///////////////////////////////
-	//// FNV-1a hash functions ////
-	///////////////////////////////
+	////////////////////////
+	//// hash functions ////
+	////////////////////////
 	
-	u32 dataHash32(void* data, size_t data_size, u32 seed = 2166136261); //32bit FNV_offset_basis
-	u64 dataHash64(void* data, size_t data_size, u64 seed = 14695981039346656037); //64bit FNV_offset_basis
-	u32 stringHash32(char* data, size_t data_size = 0, u32 seed = 2166136261); //32bit FNV_offset_basis
-	u64 stringHash64(char* data, size_t data_size = 0, u64 seed = 14695981039346656037); //64bit FNV_offset_basis
+	u32 dataHash32(void* data, size_t data_size, u32 seed = 0);
+	u64 dataHash64(void* data, size_t data_size, u64 seed = 0);
+	u32 stringHash32(char* data, size_t data_size = 0, u32 seed = 0); //data_size of 0 hashes up to the null-terminator
+	u64 stringHash64(char* data, size_t data_size = 0, u64 seed = 0); //data_size of 0 hashes up to the null-terminator
 	
 	///////////////////////////////
 	//// std::string functions ////
@@ -85,61 +85,27 @@ namespace Utils{
 }; //namespace Utils
 
 
-///////////////////////////////
-//// FNV-1a hash functions //// //ref: https://en.wikipedia.org/wiki/Fowler%E2%80%93Noll%E2%80%93Vo_hash_function
-/////////////////////////////// //ref: imgui.cpp ImHashData https://github.com/ocornut/imgui
+//////////////////////// //NOTE these wrap Hash64() in common.h
+//// hash functions ////
+////////////////////////
 inline u32 Utils::
-dataHash32(void* _data, size_t data_size, u32 seed){
-	const u8* data = (const u8*)_data;
-	while(data_size-- != 0){
-		seed ^= *data++;
-		seed *= 16777619; //32bit FNV_prime
-	}
-	return seed;
+dataHash32(void* data, size_t data_size, u32 seed){
+	return (u32)Hash64(data, data_size, seed);
 }
 
 inline u64 Utils::
-dataHash64(void* _data, size_t data_size, u64 seed){
-	const u8* data = (const u8*)_data;
-	while(data_size-- != 0){
-		seed ^= *data++;
-		seed *= 1099511628211; //64bit FNV_prime
-	}
-	return seed;
+dataHash64(void* data, size_t data_size, u64 seed){
+	return Hash64(data, data_size, seed);
 }
 
 inline u32 Utils::
-stringHash32(char* _data, size_t data_size, u32 seed){
-	const u8* data = (const u8*)_data;
-	if(data_size){
-		while(data_size-- != 0){
-			seed ^= *data++;
-			seed *= 16777619; //32bit FNV_prime
-		}
-	}else{
-		while(u8 c = *data++){
-			seed ^= c;
-			seed *= 16777619; //32bit FNV_prime
-		}
-	}
-	return seed;
+stringHash32(char* data, size_t data_size, u32 seed){
+	return (u32)Hash64(data, (data_size) ? data_size : strlen(data), seed);
 }
 
 inline u64 Utils::
-stringHash64(char* _data, size_t data_size, u64 seed){
-	const u8* data = (const u8*)_data;
-	if(data_size){
-		while(data_size-- != 0){
-			seed ^= *data++;
-			seed *= 1099511628211; //64bit FNV_prime
-		}
-	}else{
-		while(u8 c = *data++){
-			seed ^= c;
-			seed *= 1099511628211; //64bit FNV_prime
-		}
-	}
-	return seed;
+stringHash64(char* data, size_t data_size, u64 seed){
+	return Hash64(data, (data_size) ? data_size : strlen(data), seed);
 }
 
 
@@ -0,0 +1,477 @@
+/* kigu vmem module
+WHAT:
+This module provides allocators for very large buffers that grow without copying their contents:
+- `vmem_remap_allocator` gives every allocation its own mapping and resizes it by remapping its pages (mremap on Linux), so
+  the allocation might move to a new address, but its memory is never copied.
+- `vmem_stable_allocator` reserves KIGU_VMEM_STABLE_RESERVE_SIZE of address space for every allocation up front and commits
+  pages as it grows, so the allocation never moves and pointers into it stay valid (until it outgrows its reservation).
+- `vmem_huge_allocator` works like the stable allocator, but aligns its reservations to 2MB and asks the OS to back them with
+  transparent huge pages; allocations smaller than KIGU_VMEM_HUGE_THRESHOLD use the remap allocator instead.
+
+WHY:
+When arrays with hundreds of megabytes of items double their space, a realloc has to copy everything to the new location, which
+takes milliseconds and briefly needs twice the memory. Moving pages around in the page table (or just committing more of
+them) costs about the same no matter how big the buffer is. For buffers that span gigabytes, random access into them also
+misses the TLB a lot with 4KB pages, which huge pages cut down by a factor of 512.
+
+NOTES:
+- Every allocation takes up at least one page and starts with a KIGU_VMEM_HEADER_SIZE (64) byte header, so these allocators
+  are meant for large containers, not every container.
+- Reserved memory is zero filled and memory past the old size is zero filled when growing (AllocatorFlags_ZeroReserve and
+  AllocatorFlags_ZeroResize), and allocations are aligned to 64 bytes.
+- The remap allocator falls back to copying on OSes where os_memory_remap() isn't supported.
+- The stable allocator falls back to copying (and moving) if an allocation grows beyond its reservation; shrinking it
+  decommits the pages past the new size.
+- The huge allocator commits memory in 2MB steps. Whether the OS actually uses huge pages depends on its transparent huge page
+  setting (it has to be `always` or `madvise` on Linux), so vmem_huge_stats() reports how much memory ended up huge page
+  backed. Huge pages are only supported on Linux; elsewhere the huge allocator acts like the stable allocator.
+- All of the allocators are thread safe; only the huge allocator has state (a locked list of its allocations for stats, which
+  is shared by every translation unit that includes vmem.h).
+
+INDEX:
+@vmem_header
+  VmemHeader: struct
+@vmem_remap
+  vmem_remap_reserve(upt size) -> void*
+  vmem_remap_release(void* ptr) -> void
+  vmem_remap_resize(void* ptr, upt size) -> void*
+  vmem_remap_allocator: Allocator*
+@vmem_stable
+  vmem_stable_reserve(upt size) -> void*
+  vmem_stable_release(void* ptr) -> void
+  vmem_stable_resize(void* ptr, upt size) -> void*
+  vmem_stable_allocator: Allocator*
+@vmem_huge
+  VmemHugeStats: struct
+  vmem_huge_reserve(upt size) -> void*
+  vmem_huge_release(void* ptr) -> void
+  vmem_huge_resize(void* ptr, upt size) -> void*
+  vmem_huge_stats() -> VmemHugeStats
+  vmem_huge_allocator: Allocator*
+@vmem_tests
+*/
+#pragma once
+#ifndef KIGU_VMEM_H
+#define KIGU_VMEM_H
+
+
+#ifndef KIGU_VMEM_STABLE_RESERVE_SIZE
+#  define KIGU_VMEM_STABLE_RESERVE_SIZE Gigabytes(16)
+#endif
+#ifndef KIGU_VMEM_HUGE_RESERVE_SIZE
+#  define KIGU_VMEM_HUGE_RESERVE_SIZE Gigabytes(16)
+#endif
+#ifndef KIGU_VMEM_HUGE_THRESHOLD
+#  define KIGU_VMEM_HUGE_THRESHOLD Megabytes(2)
+#endif
+
+
+#include "common.h"
+#include "memory.h"
+
+
+StartLinkageC();
+//-////////////////////////////////////////////////////////////////////////////////////////////////
+//// @vmem_header
+
+
+#define KIGU_VMEM_HEADER_SIZE 64
+
+typedef struct VmemHeader{
+	upt size;      //bytes requested
+	upt committed; //bytes committed starting at the header
+	upt reserved;  //bytes of address space starting at the header
+	b32 huge;      //true if this was reserved by the huge allocator (and is in its list)
+	struct VmemHeader* prev; //links in the huge allocator's list
+	struct VmemHeader* next;
+}VmemHeader;
+StaticAssert(sizeof(VmemHeader) <= KIGU_VMEM_HEADER_SIZE);
+
+#define kigu__vmem_header(ptr) ((VmemHeader*)((u8*)(ptr) - KIGU_VMEM_HEADER_SIZE))
+#define kigu__vmem_commit_size(size) AlignToPow2((upt)(size) + KIGU_VMEM_HEADER_SIZE, os_memory_page_size())
+
+
+//Reserves `reserve_size` bytes of address space and commits enough of it for `size` bytes (plus the header)
+global void*
+kigu__vmem_reserve(upt size, upt reserve_size){
+	upt committed = kigu__vmem_commit_size(size);
+	reserve_size = Max(reserve_size, committed);
+	u8* base = (u8*)os_memory_reserve(reserve_size);
+	if(!base || !os_memory_commit(base, committed)){
+		Assert(!"failed to map vmem allocation");
+		if(base) os_memory_release(base, reserve_size);
+		return 0;
+	}
+	VmemHeader* header = (VmemHeader*)base;
+	header->size      = size;
+	header->committed = committed;
+	header->reserved  = reserve_size;
+	return base + KIGU_VMEM_HEADER_SIZE;
+}
+
+
+//Zeroes the bytes of `ptr` past `size` that will still be committed after it shrinks to `size` with `committed` bytes
+FORCE_INLINE void
+kigu__vmem_zero_shrunk(void* ptr, upt size, upt committed){
+	VmemHeader* header = kigu__vmem_header(ptr);
+	if(size < header->size){
+		upt capacity = committed - KIGU_VMEM_HEADER_SIZE;
+		ZeroMemory((u8*)ptr + size, Min(header->size, capacity) - size);
+	}
+}
+
+
+//Moves `ptr` to a new allocation of `size` bytes made by `reserve` by copying it, then frees `ptr` with `release`
+global void*
+kigu__vmem_move(void* ptr, upt size, Allocator_ReserveMemory_Func reserve, Allocator_ReleaseMemory_Func release){
+	void* result = reserve(size);
+	if(!result) return 0;
+	CopyMemory(result, ptr, Min(kigu__vmem_header(ptr)->size, size));
+	release(ptr);
+	return result;
+}
+
+
+//-////////////////////////////////////////////////////////////////////////////////////////////////
+//// @vmem_remap
+
+
+//Returns `size` zeroed bytes in a mapping of their own
+global void*
+vmem_remap_reserve(upt size){
+	return kigu__vmem_reserve(size, 0);
+}
+
+
+//Unmaps `ptr` (which must have been returned by vmem_remap_reserve() or vmem_remap_resize())
+global void
+vmem_remap_release(void* ptr){
+	if(!ptr) return;
+	VmemHeader* header = kigu__vmem_header(ptr);
+	os_memory_release(header, header->reserved);
+}
+
+
+//Resizes `ptr` to `size` bytes by remapping its pages, falls back to copying if the OS can't remap
+global void*
+vmem_remap_resize(void* ptr, upt size){
+	if(!ptr) return vmem_remap_reserve(size);
+	VmemHeader* header = kigu__vmem_header(ptr);
+	upt committed = kigu__vmem_commit_size(size);
+	kigu__vmem_zero_shrunk(ptr, size, committed);
+	
+	if(committed != header->committed){
+		VmemHeader* remapped = (VmemHeader*)os_memory_remap(header, header->committed, committed);
+		if(!remapped) return kigu__vmem_move(ptr, size, vmem_remap_reserve, vmem_remap_release);
+		header = remapped;
+		header->committed = committed;
+		header->reserved  = committed;
+	}
+	header->size = size;
+	return (u8*)header + KIGU_VMEM_HEADER_SIZE;
+}
+
+
+global Allocator vmem_remap_allocator_{
+	vmem_remap_reserve,
+	Allocator_ChangeMemory_Noop,
+	Allocator_ChangeMemory_Noop,
+	vmem_remap_release,
+	vmem_remap_resize,
+	0,
+	AllocatorFlags_ZeroReserve | AllocatorFlags_ZeroResize,
+	KIGU_VMEM_HEADER_SIZE
+};
+global Allocator* vmem_remap_allocator = &vmem_remap_allocator_;
+
+
+//-////////////////////////////////////////////////////////////////////////////////////////////////
+//// @vmem_stable
+
+
+//Returns `size` zeroed bytes at the start of a KIGU_VMEM_STABLE_RESERVE_SIZE reservation of address space
+global void*
+vmem_stable_reserve(upt size){
+	return kigu__vmem_reserve(size, KIGU_VMEM_STABLE_RESERVE_SIZE);
+}
+
+
+//Releases the reservation of `ptr` (which must have been returned by vmem_stable_reserve() or vmem_stable_resize())
+global void
+vmem_stable_release(void* ptr){
+	if(!ptr) return;
+	VmemHeader* header = kigu__vmem_header(ptr);
+	os_memory_release(header, header->reserved);
+}
+
+
+//Resizes `ptr` to `size` bytes in place by committing or decommitting pages of its reservation, falls back to copying it to
+//  a new reservation if `size` doesn't fit in the current one
+global void*
+vmem_stable_resize(void* ptr, upt size){
+	if(!ptr) return vmem_stable_reserve(size);
+	VmemHeader* header = kigu__vmem_header(ptr);
+	upt committed = kigu__vmem_commit_size(size);
+	if(committed > header->reserved) return kigu__vmem_move(ptr, size, vmem_stable_reserve, vmem_stable_release);
+	
+	kigu__vmem_zero_shrunk(ptr, size, committed);
+	if(committed > header->committed){
+		if(!os_memory_commit((u8*)header + header->committed, committed - header->committed)){
+			Assert(!"failed to commit vmem allocation");
+			return 0;
+		}
+	}else if(committed < header->committed){
+		os_memory_decommit((u8*)header + committed, header->committed - committed);
+	}
+	header->committed = committed;
+	header->size = size;
+	return ptr;
+}
+
+
+global Allocator vmem_stable_allocator_{
+	vmem_stable_reserve,
+	Allocator_ChangeMemory_Noop,
+	Allocator_ChangeMemory_Noop,
+	vmem_stable_release,
+	vmem_stable_resize,
+	0,
+	AllocatorFlags_ZeroReserve | AllocatorFlags_ZeroResize,
+	KIGU_VMEM_HEADER_SIZE
+};
+global Allocator* vmem_stable_allocator = &vmem_stable_allocator_;
+
+
+//-////////////////////////////////////////////////////////////////////////////////////////////////
+//// @vmem_huge
+
+
+#define KIGU_VMEM_HUGE_PAGE_SIZE Megabytes(2)
+
+typedef struct VmemHugeStats{
+	upt allocation_count; //huge allocations currently reserved
+	upt committed_bytes;  //bytes committed by huge allocations
+	upt huge_bytes;       //bytes of huge allocations the OS actually backed with huge pages
+}VmemHugeStats;
+
+//inline so every translation unit shares the same list and lock (huge allocations can be released from any of them)
+inline VmemHeader* kigu__vmem_huge_list;
+inline volatile s32 kigu__vmem_huge_lock;
+
+
+//Reserves `size` (a multiple of KIGU_VMEM_HUGE_PAGE_SIZE) bytes of address space aligned to KIGU_VMEM_HUGE_PAGE_SIZE
+global u8*
+kigu__vmem_reserve_huge_aligned(upt size){
+#if OS_LINUX
+	//over reserve then unmap the unaligned head and the tail
+	u8* raw = (u8*)os_memory_reserve(size + KIGU_VMEM_HUGE_PAGE_SIZE);
+	if(!raw) return 0;
+	u8* result = (u8*)AlignToPow2((upt)raw, (upt)KIGU_VMEM_HUGE_PAGE_SIZE);
+	if(result > raw) os_memory_release(raw, result - raw);
+	upt tail = (raw + size + KIGU_VMEM_HUGE_PAGE_SIZE) - (result + size);
+	if(tail) os_memory_release(result + size, tail);
+	return result;
+#else
+	return (u8*)os_memory_reserve(size);
+#endif //#if OS_LINUX
+}
+
+
+//Returns `size` zeroed bytes, backed by huge pages if `size` is at least KIGU_VMEM_HUGE_THRESHOLD
+global void*
+vmem_huge_reserve(upt size){
+	if(size < KIGU_VMEM_HUGE_THRESHOLD) return vmem_remap_reserve(size);
+	
+	upt committed = AlignToPow2(size + KIGU_VMEM_HEADER_SIZE, (upt)KIGU_VMEM_HUGE_PAGE_SIZE);
+	upt reserved  = Max(AlignToPow2((upt)KIGU_VMEM_HUGE_RESERVE_SIZE, (upt)KIGU_VMEM_HUGE_PAGE_SIZE), committed);
+	u8* base = kigu__vmem_reserve_huge_aligned(reserved);
+	if(!base || !os_memory_commit(base, committed)){
+		Assert(!"failed to map huge vmem allocation");
+		if(base) os_memory_release(base, reserved);
+		return 0;
+	}
+	os_memory_advise_huge(base, committed);
+	
+	VmemHeader* header = (VmemHeader*)base;
+	header->size      = size;
+	header->committed = committed;
+	header->reserved  = reserved;
+	header->huge      = true;
+	kigu__spin_lock(&kigu__vmem_huge_lock);
+	header->next = kigu__vmem_huge_list;
+	if(kigu__vmem_huge_list) kigu__vmem_huge_list->prev = header;
+	kigu__vmem_huge_list = header;
+	kigu__spin_unlock(&kigu__vmem_huge_lock);
+	return base + KIGU_VMEM_HEADER_SIZE;
+}
+
+
+//Releases `ptr` (which must have been returned by vmem_huge_reserve() or vmem_huge_resize())
+global void
+vmem_huge_release(void* ptr){
+	if(!ptr) return;
+	VmemHeader* header = kigu__vmem_header(ptr);
+	if(header->huge){
+		kigu__spin_lock(&kigu__vmem_huge_lock);
+		if(header->prev) header->prev->next = header->next;
+		else kigu__vmem_huge_list = header->next;
+		if(header->next) header->next->prev = header->prev;
+		kigu__spin_unlock(&kigu__vmem_huge_lock);
+	}
+	os_memory_release(header, header->reserved);
+}
+
+
+//Resizes `ptr` to `size` bytes, growing huge allocations in place within their reservation and moving allocations that grow
+//  past KIGU_VMEM_HUGE_THRESHOLD to huge pages
+global void*
+vmem_huge_resize(void* ptr, upt size){
+	if(!ptr) return vmem_huge_reserve(size);
+	VmemHeader* header = kigu__vmem_header(ptr);
+	if(!header->huge){
+		if(size < KIGU_VMEM_HUGE_THRESHOLD) return vmem_remap_resize(ptr, size);
+		return kigu__vmem_move(ptr, size, vmem_huge_reserve, vmem_huge_release);
+	}
+	
+	upt committed = AlignToPow2(size + KIGU_VMEM_HEADER_SIZE, (upt)KIGU_VMEM_HUGE_PAGE_SIZE);
+	if(committed > header->reserved) return kigu__vmem_move(ptr, size, vmem_huge_reserve, vmem_huge_release);
+	
+	kigu__vmem_zero_shrunk(ptr, size, committed);
+	if(committed > header->committed){
+		if(!os_memory_commit((u8*)header + header->committed, committed - header->committed)){
+			Assert(!"failed to commit huge vmem allocation");
+			return 0;
+		}
+		os_memory_advise_huge((u8*)header + header->committed, committed - header->committed);
+	}else if(committed < header->committed){
+		os_memory_decommit((u8*)header + committed, header->committed - committed);
+	}
+	header->committed = committed;
+	header->size = size;
+	return ptr;
+}
+
+
+//Returns how many huge allocations there are, how much memory they have committed, and how much of that memory the OS
+//  actually backed with huge pages (read from /proc/self/smaps on Linux, so this is slow and always 0 elsewhere)
+global VmemHugeStats
+vmem_huge_stats(){
+	VmemHugeStats result = {};
+	kigu__spin_lock(&kigu__vmem_huge_lock);
+	for(VmemHeader* it = kigu__vmem_huge_list; it != 0; it = it->next){
+		result.allocation_count += 1;
+		result.committed_bytes  += it->committed;
+	}
+#if OS_LINUX
+	FILE* file = fopen("/proc/self/smaps", "r");
+	if(file){
+		//sum the AnonHugePages of every mapping that overlaps a huge allocation
+		char line[512];
+		b32 overlaps = false;
+		while(fgets(line, sizeof(line), file)){
+			unsigned long long start, end, kilobytes;
+			if(sscanf(line, "%llx-%llx ", &start, &end) == 2){
+				overlaps = false;
+				for(VmemHeader* it = kigu__vmem_huge_list; it != 0; it = it->next){
+					if((upt)it < (upt)end && (upt)it + it->committed > (upt)start){
+						overlaps = true;
+						break;
+					}
+				}
+			}else if(overlaps && sscanf(line, "AnonHugePages: %llu kB", &kilobytes) == 1){
+				result.huge_bytes += (upt)kilobytes * 1024;
+			}
+		}
+		fclose(file);
+	}
+#endif //#if OS_LINUX
+	kigu__spin_unlock(&kigu__vmem_huge_lock);
+	return result;
+}
+
+
+global Allocator vmem_huge_allocator_{
+	vmem_huge_reserve,
+	Allocator_ChangeMemory_Noop,
+	Allocator_ChangeMemory_Noop,
+	vmem_huge_release,
+	vmem_huge_resize,
+	0,
+	AllocatorFlags_ZeroReserve | AllocatorFlags_ZeroResize,
+	KIGU_VMEM_HEADER_SIZE
+};
+global Allocator* vmem_huge_allocator = &vmem_huge_allocator_;
+
+
+EndLinkageC();
+//-////////////////////////////////////////////////////////////////////////////////////////////////
+//// @vmem_tests
+#ifdef KIGU_UNIT_TESTS
+
+
+#include "array.h"
+
+
+global void kigu__vmem_unit_tests()
+{
+	Allocator* allocators[3] = {vmem_remap_allocator, vmem_stable_allocator, vmem_huge_allocator};
+	forX(a, 3){
+		Allocator* allocator = allocators[a];
+		
+		{//// reserve/resize ////
+			u32* data = (u32*)allocator->reserve(Megabytes(1));
+			AssertAlways((upt)data % 64 == 0);
+			forI(Megabytes(1)/sizeof(u32)) AssertAlways(data[i] == 0);
+			forI(Megabytes(1)/sizeof(u32)) data[i] = (u32)i;
+			
+			//growing keeps the contents and zero fills the new memory
+			u32* grown = (u32*)allocator->resize(data, Megabytes(64));
+			AssertAlways(allocator != vmem_stable_allocator || grown == data);
+			forI(Megabytes(1)/sizeof(u32)) AssertAlways(grown[i] == (u32)i);
+			for(upt i = Megabytes(1)/sizeof(u32); i < Megabytes(64)/sizeof(u32); i += 1000) AssertAlways(grown[i] == 0);
+			
+			//shrinking then growing again zero fills what was cut off
+			u32* shrunk = (u32*)allocator->resize(grown, 10*sizeof(u32));
+			AssertAlways(shrunk[9] == 9);
+			u32* regrown = (u32*)allocator->resize(shrunk, 1000*sizeof(u32));
+			AssertAlways(regrown[9] == 9 && regrown[10] == 0 && regrown[999] == 0);
+			allocator->release(regrown);
+		}
+		
+		{//// array ////
+			u64* array;
+			array_init(array, 4, allocator);
+			u64* first = array;
+			forI(1000000) array_push_value(array, (u64)i);
+			AssertAlways(allocator != vmem_stable_allocator || array == first);
+			forI(1000000) AssertAlways(array[i] == (u64)i);
+			array_deinit(array);
+		}
+	}
+	
+	{//// huge ////
+		//small allocations don't use huge pages
+		void* small = vmem_huge_allocator->reserve(Kilobytes(64));
+		AssertAlways(vmem_huge_stats().allocation_count == 0);
+		
+		u8* data = (u8*)vmem_huge_allocator->reserve(Megabytes(64));
+		AssertAlways(((upt)data - KIGU_VMEM_HEADER_SIZE) % KIGU_VMEM_HUGE_PAGE_SIZE == 0);
+		forI(Megabytes(64)) data[i] = 1;
+		VmemHugeStats stats = vmem_huge_stats();
+		AssertAlways(stats.allocation_count == 1);
+		AssertAlways(stats.committed_bytes >= Megabytes(64) && stats.committed_bytes % KIGU_VMEM_HUGE_PAGE_SIZE == 0);
+		AssertAlways(stats.huge_bytes <= stats.committed_bytes);
+		
+		//small allocations that grow past the threshold move to huge pages
+		small = vmem_huge_allocator->resize(small, Megabytes(4));
+		AssertAlways(vmem_huge_stats().allocation_count == 2);
+		
+		vmem_huge_allocator->release(small);
+		vmem_huge_allocator->release(data);
+		AssertAlways(vmem_huge_stats().allocation_count == 0);
+	}
+}
+
+
+#endif //#ifdef KIGU_UNIT_TESTS
+#endif //#ifndef KIGU_VMEM_H